@@ -0,0 +1,7 @@
+package Plgd::Grid
+
+
+require Exporter;
+
+@ISA    = qw(Exporter);
+@EXPORT = qw();
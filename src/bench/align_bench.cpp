@@ -0,0 +1,373 @@
+#include "../common/defs.h"
+#include "../common/diff_gapalign.h"
+#include "../common/xdrop_gapalign.h"
+#include "../mecat2cns/dw.h"
+#include "../fsa/simple_align.hpp"
+
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* benchmarks the gapped extension kernels on synthetic PacBio-like read pairs.
+ *
+ * every pair is two reads sampled from the same random template, each with its own errors, and the
+ * extension starts from the template midpoint. the kernels are
+ *   diff		DiffAligner::go (mecat2pw, mecat2ref)
+ *   xdrop		XdropAligner::go (mecat2pw, mecat2ref, nanopore)
+ *   dw			ns_banded_sw::GetAlignment (mecat2cns)
+ *   simple		SimpleAlign::Align (fsa)
+ * each kernel runs with one thread and with -t threads, every run in a child process so that its
+ * peak memory can be measured on its own.
+ *
+ * output is tab separated, one line per run:
+ *   aligned		pairs with an alignment of at least kMinAlignSize
+ *   mcells_per_sec	cells of the aligned rectangles (qspan * tspan) per second, in millions
+ *   peak_rss_mb	peak resident memory of the run above the resident memory of the generated pairs
+ *   mean_ident		mean identity of the aligned pairs
+ *   ident_diff		mean absolute identity difference to diff over the pairs both aligned
+ *   consistent		whether the multi-threaded run gives the results of the single-threaded one
+ * the default error rate is PacBio-like. a kernel that aligns none of the pairs at the error rate
+ * (SimpleAlign at the default one) only times its give-up path; its row is reported as it is, with a
+ * note on stderr.
+ *
+ * usage: align_bench [-n pairs] [-l read size] [-e error rate] [-i indel ratio] [-s seed] [-t threads]
+ */
+
+using namespace std;
+
+static const int kMinAlignSize = 500;
+
+struct BenchOptions
+{
+	int num_pairs;
+	int read_size;
+	double error_rate;
+	double indel_ratio;
+	unsigned seed;
+	int num_threads;
+};
+
+struct ReadPair
+{
+	vector<char> qcodes, tcodes;
+	string qstr, tstr;
+	int qseed, tseed;
+};
+
+struct PairResult
+{
+	int aligned;
+	int qspan, tspan;
+	double ident;
+};
+
+// the read of a template with errors. pos_map[i] is the read position of template base i.
+static void
+mutate_template(const vector<char>& tmpl, const BenchOptions& opts, unsigned& seed, vector<char>& read, vector<int>& pos_map)
+{
+	read.clear();
+	pos_map.resize(tmpl.size());
+	for (size_t i = 0; i < tmpl.size(); ++i)
+	{
+		pos_map[i] = read.size();
+		const double r = rand_r(&seed) / (RAND_MAX + 1.0);
+		if (r >= opts.error_rate)
+		{
+			read.push_back(tmpl[i]);
+			continue;
+		}
+		if (r < opts.error_rate * opts.indel_ratio)
+		{
+			if (rand_r(&seed) & 1) continue;		// deletion
+			read.push_back(rand_r(&seed) & 3);		// insertion
+			read.push_back(tmpl[i]);
+		}
+		else
+		{
+			read.push_back((tmpl[i] + 1 + rand_r(&seed) % 3) & 3);
+		}
+	}
+}
+
+static void
+generate_pairs(const BenchOptions& opts, vector<ReadPair>& pairs)
+{
+	unsigned seed = opts.seed;
+	vector<char> tmpl(opts.read_size);
+	vector<int> qmap, tmap;
+	pairs.resize(opts.num_pairs);
+	for (int p = 0; p < opts.num_pairs; ++p)
+	{
+		for (int i = 0; i < opts.read_size; ++i) tmpl[i] = rand_r(&seed) & 3;
+		ReadPair& rp = pairs[p];
+		mutate_template(tmpl, opts, seed, rp.qcodes, qmap);
+		mutate_template(tmpl, opts, seed, rp.tcodes, tmap);
+		rp.qseed = min(qmap[opts.read_size / 2], (int)rp.qcodes.size() - 1);
+		rp.tseed = min(tmap[opts.read_size / 2], (int)rp.tcodes.size() - 1);
+		rp.qstr.resize(rp.qcodes.size());
+		rp.tstr.resize(rp.tcodes.size());
+		for (size_t i = 0; i < rp.qcodes.size(); ++i) rp.qstr[i] = "ACGT"[(int)rp.qcodes[i]];
+		for (size_t i = 0; i < rp.tcodes.size(); ++i) rp.tstr[i] = "ACGT"[(int)rp.tcodes[i]];
+	}
+}
+
+class BenchKernel
+{
+public:
+	virtual ~BenchKernel() {}
+	virtual void align(const ReadPair& rp, PairResult& r) = 0;
+};
+
+class GapAlignerKernel : public BenchKernel
+{
+public:
+	GapAlignerKernel(GapAligner* aligner) : aligner_(aligner) {}
+	virtual ~GapAlignerKernel() { delete aligner_; }
+	virtual void align(const ReadPair& rp, PairResult& r)
+	{
+		r.aligned = aligner_->go(rp.qcodes.data(), rp.qseed, rp.qcodes.size(), rp.tcodes.data(), rp.tseed, rp.tcodes.size(), kMinAlignSize);
+		r.qspan = aligner_->query_end() - aligner_->query_start();
+		r.tspan = aligner_->target_end() - aligner_->target_start();
+		r.ident = aligner_->calc_ident();
+	}
+
+private:
+	GapAligner* aligner_;
+};
+
+class DwKernel : public BenchKernel
+{
+public:
+	DwKernel() : drd_(ns_banded_sw::get_sw_parameters_small()), m5_(NewM5Record(MAX_SEQ_SIZE)) {}
+	virtual ~DwKernel() { DeleteM5Record(m5_); }
+	virtual void align(const ReadPair& rp, PairResult& r)
+	{
+		r.aligned = ns_banded_sw::GetAlignment(rp.qcodes.data(), rp.qseed, rp.qcodes.size(), rp.tcodes.data(), rp.tseed, rp.tcodes.size(),
+											   &drd_, *m5_, 0.15, kMinAlignSize);
+		r.qspan = r.aligned ? m5qend(*m5_) - m5qoff(*m5_) : 0;
+		r.tspan = r.aligned ? m5send(*m5_) - m5soff(*m5_) : 0;
+		r.ident = r.aligned ? drd_.result->ident : 0.0;
+	}
+
+private:
+	ns_banded_sw::DiffRunningData drd_;
+	M5Record* m5_;
+};
+
+// the use of fsa Assembly::ComputeSequenceSimilarity()
+class SimpleAlignKernel : public BenchKernel
+{
+public:
+	virtual void align(const ReadPair& rp, PairResult& r)
+	{
+		SimpleAlign sa(rp.tstr, 11);
+		SimpleAlign::Result sr = sa.Align(rp.qstr, 500, false);
+		r.qspan = sr.query_end - sr.query_start;
+		r.tspan = sr.target_end - sr.target_start;
+		r.aligned = r.qspan >= kMinAlignSize && r.tspan >= kMinAlignSize;
+		r.ident = (r.qspan + r.tspan > 0) ? 100.0 * (1.0 - 2.0 * sr.distance / (r.qspan + r.tspan)) : 0.0;
+	}
+};
+
+enum { kKernelDiff = 0, kKernelXdrop, kKernelDw, kKernelSimple, kNumKernels };
+
+static const char* kKernelNames[kNumKernels] = { "diff", "xdrop", "dw", "simple" };
+
+static BenchKernel*
+new_kernel(const int kernel)
+{
+	switch (kernel)
+	{
+		case kKernelDiff: return new GapAlignerKernel(new DiffAligner(0));
+		case kKernelXdrop: return new GapAlignerKernel(new XdropAligner(0));
+		case kKernelDw: return new DwKernel;
+		default: return new SimpleAlignKernel;
+	}
+}
+
+struct BenchThreadData
+{
+	int kernel;
+	const vector<ReadPair>* pairs;
+	vector<PairResult>* results;
+	int next_pair;
+};
+
+static void*
+bench_thread_func(void* arg)
+{
+	BenchThreadData* data = (BenchThreadData*)arg;
+	BenchKernel* kernel = new_kernel(data->kernel);
+	int i;
+	while ((i = __sync_fetch_and_add(&data->next_pair, 1)) < (int)data->pairs->size())
+	{
+		PairResult& r = (*data->results)[i];
+		memset(&r, 0, sizeof(PairResult));
+		kernel->align((*data->pairs)[i], r);
+	}
+	delete kernel;
+	return NULL;
+}
+
+static long
+read_status_kb(const char* field)
+{
+	FILE* in = fopen("/proc/self/status", "r");
+	if (!in) return 0;
+	char line[256];
+	long kb = 0;
+	const size_t n = strlen(field);
+	while (fgets(line, sizeof(line), in))
+		if (strncmp(line, field, n) == 0) { kb = atol(line + n + 1); break; }
+	fclose(in);
+	return kb;
+}
+
+struct RunSummary
+{
+	double seconds;
+	long peak_rss_kb;
+};
+
+// runs the kernel in a child process; the per pair results come back through a pipe
+static void
+run_kernel(const int kernel, const int num_threads, const vector<ReadPair>& pairs, vector<PairResult>& results, RunSummary& summary)
+{
+	results.resize(pairs.size());
+	int fds[2];
+	if (pipe(fds)) ERROR("pipe fail");
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) ERROR("fork fail");
+	if (pid == 0)
+	{
+		close(fds[0]);
+		// reset the peak resident set size (VmHWM) to the current one
+		FILE* cr = fopen("/proc/self/clear_refs", "w");
+		if (cr) { fputs("5", cr); fclose(cr); }
+		const long base_kb = read_status_kb("VmRSS:");
+
+		BenchThreadData data;
+		data.kernel = kernel;
+		data.pairs = &pairs;
+		data.results = &results;
+		data.next_pair = 0;
+		Timer timer;
+		timer.go();
+		pthread_t tids[num_threads];
+		for (int i = 0; i < num_threads; ++i) pthread_create(tids + i, NULL, bench_thread_func, (void*)&data);
+		for (int i = 0; i < num_threads; ++i) pthread_join(tids[i], NULL);
+		timer.stop();
+
+		RunSummary s;
+		s.seconds = timer.elapsed();
+		s.peak_rss_kb = read_status_kb("VmHWM:") - base_kb;
+		if (write(fds[1], &s, sizeof(s)) != sizeof(s)) _exit(1);
+		const size_t bytes = sizeof(PairResult) * results.size();
+		if (write(fds[1], results.data(), bytes) != (ssize_t)bytes) _exit(1);
+		close(fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+	FILE* in = fdopen(fds[0], "r");
+	if (fread(&summary, sizeof(summary), 1, in) != 1
+		||
+		fread(results.data(), sizeof(PairResult), results.size(), in) != results.size())
+		ERROR("%s: the benchmark process failed", kKernelNames[kernel]);
+	fclose(in);
+	int status;
+	waitpid(pid, &status, 0);
+}
+
+static void
+print_run(const int kernel, const int num_threads, const RunSummary& s, const vector<PairResult>& results,
+		  const vector<PairResult>& ref, const vector<PairResult>* single)
+{
+	int aligned = 0, num_cmp = 0;
+	double cells = 0, ident = 0, diff = 0;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const PairResult& r = results[i];
+		if (!r.aligned) continue;
+		++aligned;
+		cells += 1.0 * r.qspan * r.tspan;
+		ident += r.ident;
+		if (ref[i].aligned) { ++num_cmp; diff += fabs(r.ident - ref[i].ident); }
+	}
+	bool consistent = true;
+	if (single) consistent = memcmp(single->data(), results.data(), sizeof(PairResult) * results.size()) == 0;
+	printf("%s\t%d\t%d\t%d\t%.3f\t%.1f\t%.1f\t%.1f\t%.2f\t%.3f\t%s\n",
+		   kKernelNames[kernel], num_threads, (int)results.size(), aligned, s.seconds,
+		   results.size() / s.seconds, cells / s.seconds / 1e6, s.peak_rss_kb / 1024.0,
+		   aligned ? ident / aligned : 0.0, num_cmp ? diff / num_cmp : 0.0, consistent ? "yes" : "no");
+	fflush(stdout);
+	if (!aligned)
+		LOG(stderr, "note: %s aligned none of the %d pairs at this error rate, its timing is of the give-up path",
+			kKernelNames[kernel], (int)results.size());
+}
+
+static void
+print_usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-n pairs] [-l read size] [-e error rate] [-i indel ratio] [-s seed] [-t threads]\n", prog);
+}
+
+int main(int argc, char* argv[])
+{
+	BenchOptions opts;
+	opts.num_pairs = 100;
+	opts.read_size = 10000;
+	opts.error_rate = 0.15;
+	opts.indel_ratio = 0.85;
+	opts.seed = 7;
+	opts.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "n:l:e:i:s:t:")) != -1)
+	{
+		switch (opt_char)
+		{
+			case 'n': opts.num_pairs = atoi(optarg); break;
+			case 'l': opts.read_size = atoi(optarg); break;
+			case 'e': opts.error_rate = atof(optarg); break;
+			case 'i': opts.indel_ratio = atof(optarg); break;
+			case 's': opts.seed = strtoul(optarg, NULL, 10); break;
+			case 't': opts.num_threads = atoi(optarg); break;
+			default: print_usage(argv[0]); return 1;
+		}
+	}
+	if (opts.num_pairs < 1 || opts.read_size < 2 * kMinAlignSize || opts.read_size > MAX_SEQ_SIZE / 2
+		||
+		opts.error_rate < 0 || opts.error_rate >= 1 || opts.indel_ratio < 0 || opts.indel_ratio > 1)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+	if (opts.num_threads < 1) opts.num_threads = 1;
+
+	vector<ReadPair> pairs;
+	generate_pairs(opts, pairs);
+
+	printf("# align_bench pairs=%d read_size=%d error_rate=%g indel_ratio=%g seed=%u\n",
+		   opts.num_pairs, opts.read_size, opts.error_rate, opts.indel_ratio, opts.seed);
+	printf("kernel\tthreads\tpairs\taligned\tseconds\talns_per_sec\tmcells_per_sec\tpeak_rss_mb\tmean_ident\tident_diff\tconsistent\n");
+	vector<PairResult> ref, single, multi;
+	RunSummary s;
+	for (int k = 0; k < kNumKernels; ++k)
+	{
+		run_kernel(k, 1, pairs, single, s);
+		if (k == kKernelDiff) ref = single;
+		print_run(k, 1, s, single, ref, NULL);
+		if (opts.num_threads == 1) continue;
+		run_kernel(k, opts.num_threads, pairs, multi, s);
+		print_run(k, opts.num_threads, s, multi, ref, &single);
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include "../common/alignment.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+/* compares the read pairs of two mecat2pw outputs, typically the same reads seeded with the
+ * stride sampler (-m 0) and with minimizers (-m w), to measure the sensitivity of a seeding mode.
+ *
+ * a pair is the unordered (qid, sid) of a candidate or an overlap; text and binary record
+ * streams are accepted. output is tab separated:
+ *   base_pairs		distinct pairs of the baseline
+ *   test_pairs		distinct pairs of the tested output
+ *   common		pairs found by both
+ *   recall		common / base_pairs
+ *   extra		pairs only found by the tested output
+ *
+ * usage: seed_recall [-t can/m4] baseline tested
+ */
+
+using namespace std;
+
+typedef pair<idx_t, idx_t> ReadPair;
+
+static void
+print_usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-t can/m4] baseline tested\n", prog);
+	fprintf(stderr, "-t <string>\trecord type of text inputs, can = candidates (mecat2pw -j 0), m4 = overlaps (mecat2pw -j 1)\n\t\tdefault: can\n");
+}
+
+static inline ReadPair
+make_read_pair(idx_t a, idx_t b)
+{
+	return a < b ? ReadPair(a, b) : ReadPair(b, a);
+}
+
+static void
+load_read_pairs(const char* path, int record_type, vector<ReadPair>& pairs)
+{
+	const int binary_type = get_record_stream_type(path);
+	if (binary_type) record_type = binary_type;
+	RecordStreamReader in(path, record_type);
+	if (record_type == kRecordTypeExtensionCandidate)
+	{
+		ExtensionCandidate ec;
+		while (in.read(ec)) pairs.push_back(make_read_pair(ec.qid, ec.sid));
+	}
+	else
+	{
+		M4Record m4;
+		m4qext(m4) = m4sext(m4) = INVALID_IDX;
+		while (in.read(m4)) pairs.push_back(make_read_pair(m4qid(m4), m4sid(m4)));
+	}
+	sort(pairs.begin(), pairs.end());
+	pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+}
+
+int main(int argc, char* argv[])
+{
+	int record_type = kRecordTypeExtensionCandidate;
+	int opt_char;
+	opterr = 0;
+	while ((opt_char = getopt(argc, argv, "t:")) != -1)
+	{
+		if (opt_char == 't' && strcmp(optarg, "can") == 0) record_type = kRecordTypeExtensionCandidate;
+		else if (opt_char == 't' && strcmp(optarg, "m4") == 0) record_type = kRecordTypeM4Record;
+		else
+		{
+			print_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind != 2)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	vector<ReadPair> base, test;
+	load_read_pairs(argv[optind], record_type, base);
+	load_read_pairs(argv[optind + 1], record_type, test);
+	vector<ReadPair> common;
+	set_intersection(base.begin(), base.end(), test.begin(), test.end(), back_inserter(common));
+
+	printf("base_pairs\ttest_pairs\tcommon\trecall\textra\n");
+	printf("%zu\t%zu\t%zu\t%.4f\t%zu\n",
+		   base.size(), test.size(), common.size(),
+		   base.empty() ? 1.0 : (double)common.size() / base.size(),
+		   test.size() - common.size());
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "../common/defs.h"
+#include "../common/packed_seq.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* checks every vectorized 2-bit kernel of packed_seq.h this CPU supports against the scalar versions
+ * and reports the throughput of the scalar and of the selected ones.
+ *
+ * usage: unpack_bench [num_bases [num_rounds]]
+ */
+
+using namespace std;
+
+static int
+check_kernels(const u1_t* pac, const idx_t num_bases)
+{
+	const idx_t max_size = 3000;
+	vector<char> a(max_size + 64), b(max_size + 64);
+	vector<u1_t> pa(max_size / 4 + 8), pb(max_size / 4 + 8);
+	int num_errors = 0;
+	for (idx_t from = 0; from < 64; ++from)
+		for (idx_t size = 0; size <= max_size && from + size <= num_bases; size += (size < 200) ? 1 : 97)
+		{
+			unpack_bases(pac, from, size, a.data());
+			unpack_bases_scalar(pac, from, size, b.data());
+			if (memcmp(a.data(), b.data(), size)) { LOG(stderr, "unpack_bases mismatch: from = %lld, size = %lld", (long long)from, (long long)size); ++num_errors; }
+			unpack_bases_rc(pac, from, size, a.data());
+			unpack_bases_rc_scalar(pac, from, size, b.data());
+			if (memcmp(a.data(), b.data(), size)) { LOG(stderr, "unpack_bases_rc mismatch: from = %lld, size = %lld", (long long)from, (long long)size); ++num_errors; }
+			const idx_t nbytes = (size + 3) / 4;
+			extract_packed_bases(pac, from, size, pa.data());
+			extract_packed_bases_scalar(pac, from, size, pb.data());
+			if (memcmp(pa.data(), pb.data(), nbytes)) { LOG(stderr, "extract_packed_bases mismatch: from = %lld, size = %lld", (long long)from, (long long)size); ++num_errors; }
+		}
+	return num_errors;
+}
+
+typedef void (*unpack_func)(const u1_t*, const idx_t, const idx_t, char*);
+
+static double
+time_unpack(unpack_func f, const u1_t* pac, const idx_t num_bases, const vector<idx_t>& starts, const idx_t read_size, char* dst, const int num_rounds)
+{
+	Timer timer;
+	timer.go();
+	for (int r = 0; r < num_rounds; ++r)
+		for (size_t i = 0; i < starts.size(); ++i) f(pac, starts[i], read_size, dst);
+	timer.stop();
+	return timer.elapsed();
+}
+
+int main(int argc, char* argv[])
+{
+	idx_t num_bases = (argc > 1) ? atoll(argv[1]) : 20000000;
+	int num_rounds = (argc > 2) ? atoi(argv[2]) : 5;
+	if (num_bases < 100000) num_bases = 100000;
+	if (num_rounds < 1) num_rounds = 1;
+
+	srand(7);
+	vector<u1_t> pac((num_bases + 3) / 4);
+	for (size_t i = 0; i < pac.size(); ++i) pac[i] = rand() & 0xFF;
+
+	const string selected = packed_seq_kernel_name();
+	const char* kernels[] = { "ssse3", "avx2" };
+	int num_errors = 0;
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i)
+	{
+		if (!select_packed_seq_kernel(kernels[i]))
+		{
+			printf("check\t%s\tnot supported\n", kernels[i]);
+			continue;
+		}
+		const int kernel_errors = check_kernels(pac.data(), num_bases);
+		printf("check\t%s\t%s\n", kernels[i], kernel_errors ? "FAILED" : "passed");
+		num_errors += kernel_errors;
+	}
+	select_packed_seq_kernel(selected.c_str());
+	printf("kernel\t%s\n", packed_seq_kernel_name());
+	if (num_errors) return 1;
+
+	const idx_t read_size = 10000;
+	vector<idx_t> starts;
+	for (idx_t i = 0; i + read_size <= num_bases; i += read_size + 1 + rand() % 7) starts.push_back(i + rand() % 4);
+	while (!starts.empty() && starts.back() + read_size > num_bases) starts.pop_back();
+	vector<char> dst(read_size);
+	const double bases = 1.0 * read_size * starts.size() * num_rounds;
+
+	struct { const char* name; unpack_func f; } funcs[] = {
+		{ "unpack_scalar", unpack_bases_scalar },
+		{ "unpack", unpack_bases },
+		{ "unpack_rc_scalar", unpack_bases_rc_scalar },
+		{ "unpack_rc", unpack_bases_rc }
+	};
+	printf("name\tseconds\tmbases_per_sec\n");
+	for (size_t i = 0; i < sizeof(funcs) / sizeof(funcs[0]); ++i)
+	{
+		double t = time_unpack(funcs[i].f, pac.data(), num_bases, starts, read_size, dst.data(), num_rounds);
+		printf("%s\t%.4f\t%.1f\n", funcs[i].name, t, bases / t / 1e6);
+	}
+	return 0;
+}
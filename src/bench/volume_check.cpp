@@ -0,0 +1,107 @@
+#include "../common/defs.h"
+#include "../common/split_database.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/* checks that the reads split into volumes by split_raw_dataset() read back unchanged from every
+ * volume and that the volumes have the checksums the split reported, with volume sizes from all reads
+ * in one volume down to one read per volume (the small volumes of tight --mem-budget runs), and with
+ * one and several parser threads.
+ *
+ * usage: volume_check [num_reads]
+ */
+
+using namespace std;
+
+static void
+write_reads(const char* path, const vector<string>& reads)
+{
+	FILE* out = fopen(path, "w");
+	if (!out) ERROR("failed to open file \'%s\' for writing.", path);
+	for (size_t i = 0; i < reads.size(); ++i) fprintf(out, ">read%d\n%s\n", (int)i, reads[i].c_str());
+	fclose(out);
+}
+
+// number of reads that do not read back unchanged after splitting into volumes of at most max_volume_bases bases
+static int
+check_split(const char* reads_path, const char* wrk_dir, const vector<string>& reads, const idx_t max_volume_bases, const int num_threads)
+{
+	vector<uint64_t> checksums;
+	const int num_vols = split_raw_dataset(reads_path, wrk_dir, num_threads, max_volume_bases, &checksums);
+	char idx_file_name[1024];
+	generate_idx_file_name(wrk_dir, idx_file_name);
+	volume_names_t* vn = load_volume_names(idx_file_name, 0);
+	r_assert(vn->num_vols == num_vols);
+	r_assert((int)checksums.size() == num_vols);
+
+	const u1_t* encode_table = get_dna_encode_table();
+	vector<char> seq(MAX_SEQ_SIZE);
+	int num_errors = 0, rid = 0;
+	for (int i = 0; i < vn->num_vols; ++i)
+	{
+		volume_t* v = load_volume(get_vol_name(vn, i));
+		if (v->start_read_id != rid) { LOG(stderr, "volume %d starts at read %d, not %d", i, v->start_read_id, rid); ++num_errors; }
+		if (volume_checksum(v) != checksums[i]) { LOG(stderr, "volume %d does not have the checksum it was split with", i); ++num_errors; }
+		if (v->num_reads > 1 && v->curr > max_volume_bases) { LOG(stderr, "volume %d holds %d bases, more than %lld", i, v->curr, (long long)max_volume_bases); ++num_errors; }
+		for (int j = 0; j < v->num_reads && rid < (int)reads.size(); ++j, ++rid)
+		{
+			const string& read = reads[rid];
+			const int size = v->offset_list->offset_list[j].size;
+			bool same = (size == (int)read.size());
+			if (same)
+			{
+				extract_one_seq(v, j, seq.data());
+				for (int k = 0; k < size && same; ++k) same = (seq[k] == (char)encode_table[(u1_t)read[k]]);
+			}
+			if (!same) ++num_errors;
+		}
+		v = delete_volume_t(v);
+	}
+	if (rid != (int)reads.size()) { LOG(stderr, "%d of %d reads are in the volumes", rid, (int)reads.size()); ++num_errors; }
+	for (int i = 0; i < vn->num_vols; ++i) unlink(get_vol_name(vn, i));
+	unlink(idx_file_name);
+	printf("%lld\t%d\t%d\t%s\n", (long long)max_volume_bases, num_threads, num_vols, num_errors ? "FAILED" : "passed");
+	vn = delete_volume_names_t(vn);
+	return num_errors;
+}
+
+int main(int argc, char* argv[])
+{
+	int num_reads = (argc > 1) ? atoi(argv[1]) : 200;
+	if (num_reads < 1) num_reads = 1;
+
+	// lengths of every residue mod 4, so reads start at every phase of the packed bytes
+	srand(7);
+	vector<string> reads(num_reads);
+	idx_t num_bases = 0;
+	for (int i = 0; i < num_reads; ++i)
+	{
+		const int size = 1 + rand() % 3000;
+		reads[i].resize(size);
+		for (int k = 0; k < size; ++k) reads[i][k] = "ACGT"[rand() & 3];
+		num_bases += size;
+	}
+
+	const char* tmp = getenv("TMPDIR");
+	string wrk_dir = string((tmp && tmp[0]) ? tmp : "/tmp") + "/volume_check.XXXXXX";
+	if (!mkdtemp(&wrk_dir[0])) ERROR("failed to create a temporary folder \'%s\'.", wrk_dir.c_str());
+	const string reads_path = wrk_dir + "/reads.fasta";
+	write_reads(reads_path.c_str(), reads);
+
+	const idx_t volume_bases[] = { MCS, num_bases / 3 + 1, num_bases / 14 + 1, 4000, 1 };
+	int num_errors = 0;
+	printf("max_volume_bases\tthreads\tvolumes\tcheck\n");
+	for (size_t i = 0; i < sizeof(volume_bases) / sizeof(volume_bases[0]); ++i)
+		for (int num_threads = 1; num_threads <= 4; num_threads *= 4)
+			num_errors += check_split(reads_path.c_str(), wrk_dir.c_str(), reads, volume_bases[i], num_threads);
+
+	unlink(reads_path.c_str());
+	rmdir(wrk_dir.c_str());
+	return num_errors ? 1 : 0;
+}
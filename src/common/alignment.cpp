@@ -1,5 +1,6 @@
 #include "alignment.h"
 
+#include <cstring>
 #include <sstream>
 #include <string>
 
@@ -27,7 +28,7 @@ operator<<(std::ostream& out, const ExtensionCandidate& ec)
 		<< ec.sext << delim
 		<< ec.score << delim
 		<< ec.qsize << delim
-		<< ec.ssize << std::endl;
+		<< ec.ssize << '\n';
 	return out;
 }
 
@@ -77,6 +78,246 @@ std::ostream& operator<<(std::ostream& out, const M4Record& m4)
 	return out;
 }
 
+static inline void
+put_varint(std::vector<char>& buf, u8_t x)
+{
+	while (x >= 0x80)
+	{
+		buf.push_back((char)(x | 0x80));
+		x >>= 7;
+	}
+	buf.push_back((char)x);
+}
+
+static inline void
+put_svarint(std::vector<char>& buf, const i8_t x)
+{
+	put_varint(buf, ((u8_t)x << 1) ^ (u8_t)(x >> 63));
+}
+
+static inline u8_t
+get_varint(const char*& p, const char* end)
+{
+	u8_t x = 0;
+	for (int shift = 0; p < end && shift < 64; shift += 7)
+	{
+		const u1_t c = *p++;
+		x |= (u8_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) return x;
+	}
+	ERROR("corrupted record stream block");
+	return 0;
+}
+
+static inline i8_t
+get_svarint(const char*& p, const char* end)
+{
+	const u8_t x = get_varint(p, end);
+	return (i8_t)(x >> 1) ^ -(i8_t)(x & 1);
+}
+
+void
+write_record_stream_header(std::ostream& out, const int record_type, const int flags)
+{
+	record_stream_header_t hdr;
+	memset(&hdr, 0, sizeof(record_stream_header_t));
+	memcpy(hdr.magic, RECORD_STREAM_MAGIC, sizeof(hdr.magic));
+	hdr.version = RECORD_STREAM_VERSION;
+	hdr.record_type = record_type;
+	hdr.flags = flags;
+	out.write((const char*)&hdr, sizeof(record_stream_header_t));
+}
+
+static size_t
+begin_record_block(std::vector<char>& buf)
+{
+	const size_t start = buf.size();
+	buf.resize(start + 2 * sizeof(u4_t));
+	return start;
+}
+
+static void
+end_record_block(std::vector<char>& buf, const size_t start, const int n)
+{
+	const u4_t cnt[2] = { (u4_t)n, (u4_t)(buf.size() - start - 2 * sizeof(u4_t)) };
+	memcpy(buf.data() + start, cnt, sizeof(cnt));
+}
+
+void
+encode_record_block(const ExtensionCandidate* records, const int n, std::vector<char>& buf)
+{
+	if (n == 0) return;
+	const size_t start = begin_record_block(buf);
+	i8_t prev_qid = 0, prev_sid = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		const ExtensionCandidate& ec = records[i];
+		put_svarint(buf, ec.qid - prev_qid);
+		put_svarint(buf, ec.sid - prev_sid);
+		put_svarint(buf, ec.qdir);
+		put_svarint(buf, ec.sdir);
+		put_svarint(buf, ec.qext);
+		put_svarint(buf, ec.sext);
+		put_svarint(buf, ec.score);
+		put_svarint(buf, ec.qsize);
+		put_svarint(buf, ec.ssize);
+		prev_qid = ec.qid;
+		prev_sid = ec.sid;
+	}
+	end_record_block(buf, start, n);
+}
+
+void
+encode_record_block(const M4Record* records, const int n, std::vector<char>& buf)
+{
+	if (n == 0) return;
+	const size_t start = begin_record_block(buf);
+	i8_t prev_qid = 0, prev_sid = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		const M4Record& m4 = records[i];
+		put_svarint(buf, m4qid(m4) - prev_qid);
+		put_svarint(buf, m4sid(m4) - prev_sid);
+		const size_t p = buf.size();
+		buf.resize(p + sizeof(double));
+		memcpy(buf.data() + p, &m4ident(m4), sizeof(double));
+		put_svarint(buf, m4vscore(m4));
+		put_svarint(buf, m4qdir(m4));
+		put_svarint(buf, m4qoff(m4));
+		put_svarint(buf, m4qend(m4) - m4qoff(m4));
+		put_svarint(buf, m4qsize(m4));
+		put_svarint(buf, m4sdir(m4));
+		put_svarint(buf, m4soff(m4));
+		put_svarint(buf, m4send(m4) - m4soff(m4));
+		put_svarint(buf, m4ssize(m4));
+		put_svarint(buf, m4qext(m4));
+		put_svarint(buf, m4sext(m4));
+		prev_qid = m4qid(m4);
+		prev_sid = m4sid(m4);
+	}
+	end_record_block(buf, start, n);
+}
+
+int
+get_record_stream_type(const char* path, int* flags)
+{
+	std::ifstream in;
+	open_fstream(in, path, std::ios::in | std::ios::binary);
+	record_stream_header_t hdr;
+	in.read((char*)&hdr, sizeof(record_stream_header_t));
+	if (in.gcount() != sizeof(record_stream_header_t)) return 0;
+	if (memcmp(hdr.magic, RECORD_STREAM_MAGIC, sizeof(hdr.magic))) return 0;
+	if (flags) *flags = hdr.flags;
+	return hdr.record_type;
+}
+
+RecordStreamReader::RecordStreamReader(const char* path, const int record_type)
+	: path_(path), record_type_(record_type), is_binary_(false), flags_(0),
+	  curr_(NULL), num_left_(0), prev_qid_(0), prev_sid_(0)
+{
+	is_binary_ = get_record_stream_type(path) != 0;
+	open_fstream(in_, path, std::ios::in | std::ios::binary);
+}
+
+RecordStreamReader::~RecordStreamReader()
+{
+	close_fstream(in_);
+}
+
+void
+RecordStreamReader::x_read_header()
+{
+	record_stream_header_t hdr;
+	memcpy(hdr.magic, RECORD_STREAM_MAGIC, sizeof(hdr.magic));
+	const std::streamsize rest = sizeof(record_stream_header_t) - sizeof(hdr.magic);
+	in_.read((char*)&hdr + sizeof(hdr.magic), rest);
+	if (in_.gcount() != rest) ERROR("'%s': truncated record stream header", path_);
+	if (hdr.version != RECORD_STREAM_VERSION)
+		ERROR("'%s': record stream version %d is not supported (expected %d)", path_, hdr.version, RECORD_STREAM_VERSION);
+	if (hdr.record_type != record_type_)
+		ERROR("'%s': record stream holds record type %d, not %d", path_, hdr.record_type, record_type_);
+	flags_ = hdr.flags;
+}
+
+bool
+RecordStreamReader::x_next_block()
+{
+	while (1)
+	{
+		char head[sizeof(record_stream_header_t)];
+		in_.read(head, 2 * sizeof(u4_t));
+		if (in_.gcount() == 0) return false;
+		if (in_.gcount() != 2 * sizeof(u4_t)) ERROR("'%s': truncated record stream block", path_);
+		if (memcmp(head, RECORD_STREAM_MAGIC, 2 * sizeof(u4_t)) == 0)
+		{
+			x_read_header();
+			continue;
+		}
+		u4_t cnt[2];
+		memcpy(cnt, head, sizeof(cnt));
+		block_.resize(cnt[1]);
+		in_.read(block_.data(), cnt[1]);
+		if (in_.gcount() != (std::streamsize)cnt[1]) ERROR("'%s': truncated record stream block", path_);
+		if (cnt[0] == 0) continue;
+		curr_ = block_.data();
+		num_left_ = cnt[0];
+		prev_qid_ = prev_sid_ = 0;
+		return true;
+	}
+}
+
+bool
+RecordStreamReader::read(ExtensionCandidate& ec)
+{
+	r_assert(record_type_ == kRecordTypeExtensionCandidate);
+	if (!is_binary_) return (bool)(in_ >> ec);
+	if (num_left_ == 0 && !x_next_block()) return false;
+	const char* end = block_.data() + block_.size();
+	ec.qid = prev_qid_ + get_svarint(curr_, end);
+	ec.sid = prev_sid_ + get_svarint(curr_, end);
+	ec.qdir = get_svarint(curr_, end);
+	ec.sdir = get_svarint(curr_, end);
+	ec.qext = get_svarint(curr_, end);
+	ec.sext = get_svarint(curr_, end);
+	ec.score = get_svarint(curr_, end);
+	ec.qsize = get_svarint(curr_, end);
+	ec.ssize = get_svarint(curr_, end);
+	prev_qid_ = ec.qid;
+	prev_sid_ = ec.sid;
+	--num_left_;
+	return true;
+}
+
+bool
+RecordStreamReader::read(M4Record& m4)
+{
+	r_assert(record_type_ == kRecordTypeM4Record);
+	if (!is_binary_) return (bool)(in_ >> m4);
+	if (num_left_ == 0 && !x_next_block()) return false;
+	const char* end = block_.data() + block_.size();
+	m4qid(m4) = prev_qid_ + get_svarint(curr_, end);
+	m4sid(m4) = prev_sid_ + get_svarint(curr_, end);
+	if (end - curr_ < (idx_t)sizeof(double)) ERROR("'%s': corrupted record stream block", path_);
+	memcpy(&m4ident(m4), curr_, sizeof(double));
+	curr_ += sizeof(double);
+	m4vscore(m4) = get_svarint(curr_, end);
+	m4qdir(m4) = get_svarint(curr_, end);
+	m4qoff(m4) = get_svarint(curr_, end);
+	m4qend(m4) = m4qoff(m4) + get_svarint(curr_, end);
+	m4qsize(m4) = get_svarint(curr_, end);
+	m4sdir(m4) = get_svarint(curr_, end);
+	m4soff(m4) = get_svarint(curr_, end);
+	m4send(m4) = m4soff(m4) + get_svarint(curr_, end);
+	m4ssize(m4) = get_svarint(curr_, end);
+	m4qext(m4) = get_svarint(curr_, end);
+	m4sext(m4) = get_svarint(curr_, end);
+	if (!(flags_ & RECORD_STREAM_FLAG_M4_EXT)) m4qext(m4) = m4sext(m4) = INVALID_IDX;
+	prev_qid_ = m4qid(m4);
+	prev_sid_ = m4sid(m4);
+	--num_left_;
+	return true;
+}
+
 void PrintM5Record(std::ostream& out, const M5Record& m5, const int printAln)
 {
 	out << "(" << m5qid(m5) << ", " << m5qsize(m5) << ", " << m5qoff(m5) << ", " << m5qend(m5) << ", " << m5qdir(m5) << ")"
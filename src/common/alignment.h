@@ -2,6 +2,7 @@
 #define ALIGNMENT_H
 
 #include <fstream>
+#include <vector>
 
 #include "defs.h"
 
@@ -54,19 +55,89 @@ struct M4Record
 std::istream& operator>>(std::istream& in, M4Record& m4);
 std::ostream& operator<<(std::ostream& out, const M4Record& m4);
 
+/* binary record streams.
+ *
+ * a stream starts with a record_stream_header_t and is followed by blocks. every block is
+ * a (uint32 num_records, uint32 payload_bytes) pair and the varint coded records:
+ * ids are zigzag deltas to the previous record of the block, the other fields are zigzag varints,
+ * and M4Record::ident is stored as the raw 8-byte double.
+ * a header may also appear between blocks, so finished streams can be concatenated with cat.
+ */
+
+#define RECORD_STREAM_MAGIC		"MECATREC"
+#define RECORD_STREAM_VERSION	1
+
+enum { kRecordTypeExtensionCandidate = 1, kRecordTypeM4Record = 2 };
+
+// M4Record streams: qext and sext are valid
+#define RECORD_STREAM_FLAG_M4_EXT	1
+
+typedef struct
+{
+	char magic[8];
+	int version;
+	int record_type;
+	int flags;
+	int reserved;
+} record_stream_header_t;
+
+void
+write_record_stream_header(std::ostream& out, const int record_type, const int flags);
+
+// append one block holding records [0, n) to buf
+void
+encode_record_block(const ExtensionCandidate* records, const int n, std::vector<char>& buf);
+
+void
+encode_record_block(const M4Record* records, const int n, std::vector<char>& buf);
+
+// returns the record type of a binary record stream, or 0 if the file is not one
+int
+get_record_stream_type(const char* path, int* flags = NULL);
+
+/* reads ExtensionCandidate or M4Record records from either a text file or a binary record stream.
+ * the format is detected from the first bytes of the file.
+ */
+class RecordStreamReader
+{
+public:
+	RecordStreamReader(const char* path, const int record_type);
+	~RecordStreamReader();
+
+	bool read(ExtensionCandidate& ec);
+	bool read(M4Record& m4);
+
+	bool is_binary() const { return is_binary_; }
+	int flags() const { return flags_; }
+
+private:
+	bool x_next_block();
+	void x_read_header();
+
+private:
+	const char*			path_;
+	int					record_type_;
+	bool				is_binary_;
+	int					flags_;
+	std::ifstream		in_;
+	std::vector<char>	block_;
+	const char*			curr_;
+	u4_t				num_left_;
+	idx_t				prev_qid_;
+	idx_t				prev_sid_;
+};
+
 template <class ListT>
 void load_m4records_from_m4_file(const char* m4_file_name, ListT& m4v)
 {
-	std::ifstream in;
-	open_fstream(in, m4_file_name, std::ios::in);
+	RecordStreamReader in(m4_file_name, kRecordTypeM4Record);
 	M4Record m4;
 	m4qext(m4) = INVALID_IDX;
 	m4sext(m4) = INVALID_IDX;
-	while (in >> m4)
+	while (in.read(m4))
 	{
 		m4v.push_back(m4);
 	}
-	close_fstream(in);
 }
 
 inline void reverse_m4record(const M4Record& m4, M4Record& nm4)
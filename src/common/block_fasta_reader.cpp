@@ -0,0 +1,342 @@
+#include "block_fasta_reader.h"
+
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+enum { kFormatUnknown = 0, kFormatFasta, kFormatFastq };
+
+BlockFastaReader::BlockFastaReader(const char* file_name, const int num_threads, const bool encode_bases)
+	: file_name_(file_name), encode_bases_(encode_bases), num_threads_(num_threads < 1 ? 1 : num_threads),
+	  raw_head_(0), num_blocks_read_(0), num_blocks_consumed_(0), reading_done_(false), stop_(false),
+	  curr_block_(NULL), curr_record_(0)
+{
+	in_ = gzopen(file_name, "rb");
+	if (!in_) ERROR("cannot open file \'%s\' for reading", file_name);
+	gzbuffer(in_, 1 << 20);
+	max_blocks_in_flight_ = 2 * num_threads_ + 2;
+	pthread_mutex_init(&lock_, NULL);
+	pthread_cond_init(&raw_cond_, NULL);
+	pthread_cond_init(&space_cond_, NULL);
+	pthread_cond_init(&parsed_cond_, NULL);
+	pthread_create(&reader_tid_, NULL, reader_func, (void*)this);
+	worker_tids_.resize(num_threads_);
+	for (int i = 0; i < num_threads_; ++i) pthread_create(&worker_tids_[i], NULL, worker_func, (void*)this);
+}
+
+BlockFastaReader::~BlockFastaReader()
+{
+	pthread_mutex_lock(&lock_);
+	stop_ = true;
+	pthread_cond_broadcast(&raw_cond_);
+	pthread_cond_broadcast(&space_cond_);
+	pthread_cond_broadcast(&parsed_cond_);
+	pthread_mutex_unlock(&lock_);
+	pthread_join(reader_tid_, NULL);
+	for (int i = 0; i < num_threads_; ++i) pthread_join(worker_tids_[i], NULL);
+
+	delete curr_block_;
+	for (size_t i = raw_head_; i < raw_blocks_.size(); ++i) delete raw_blocks_[i];
+	for (map<idx_t, Block*>::iterator it = parsed_blocks_.begin(); it != parsed_blocks_.end(); ++it) delete it->second;
+	gzclose(in_);
+	pthread_mutex_destroy(&lock_);
+	pthread_cond_destroy(&raw_cond_);
+	pthread_cond_destroy(&space_cond_);
+	pthread_cond_destroy(&parsed_cond_);
+}
+
+void*
+BlockFastaReader::reader_func(void* arg)
+{
+	((BlockFastaReader*)arg)->x_read_blocks();
+	return NULL;
+}
+
+void*
+BlockFastaReader::worker_func(void* arg)
+{
+	((BlockFastaReader*)arg)->x_parse_blocks();
+	return NULL;
+}
+
+static inline const char*
+next_line(const char* p, const char* end)
+{
+	const char* q = (const char*)memchr(p, '\n', end - p);
+	return q ? q + 1 : end;
+}
+
+static int
+detect_format(const char* p, const char* end)
+{
+	while (p < end)
+	{
+		if (*p == '>') return kFormatFasta;
+		if (*p == '@') return kFormatFastq;
+		if (*p == '#' || *p == '!') p = next_line(p, end);
+		else if (isspace((unsigned char)*p)) ++p;
+		else return kFormatUnknown;
+	}
+	return kFormatUnknown;
+}
+
+// the last position > 0 of buf where a record starts, or -1
+static idx_t
+find_last_record_start(const char* buf, const idx_t size, const int format)
+{
+	const char* end = buf + size;
+	for (idx_t p = size - 1; p > 0; --p)
+	{
+		if (buf[p - 1] != '\n') continue;
+		if (format == kFormatFasta)
+		{
+			if (buf[p] == '>') return p;
+		}
+		else if (buf[p] == '@')
+		{
+			const char* l1 = next_line(buf + p, end);
+			const char* l2 = (l1 < end) ? next_line(l1, end) : end;
+			if (l2 < end && *l2 == '+') return p;
+		}
+	}
+	return -1;
+}
+
+void
+BlockFastaReader::x_read_blocks()
+{
+	vector<char> carry;
+	idx_t file_offset = 0;
+	idx_t id = 0;
+	int format = kFormatUnknown;
+	bool eof = false;
+	while (!eof)
+	{
+		Block* block = new Block;
+		block->raw.swap(carry);
+		idx_t want = kBlockSize;
+		while (1)
+		{
+			const idx_t old_size = block->raw.size();
+			block->raw.resize(old_size + want);
+			int n = gzread(in_, block->raw.data() + old_size, (unsigned)want);
+			if (n < 0)
+			{
+				int errnum;
+				ERROR("error reading \'%s\': %s", file_name_, gzerror(in_, &errnum));
+			}
+			block->raw.resize(old_size + n);
+			if (n < want) { eof = true; break; }
+			if (format == kFormatUnknown) format = detect_format(block->raw.data(), block->raw.data() + block->raw.size());
+			idx_t cut = find_last_record_start(block->raw.data(), block->raw.size(), format);
+			if (cut > 0)
+			{
+				carry.assign(block->raw.begin() + cut, block->raw.end());
+				block->raw.resize(cut);
+				break;
+			}
+			// a single record is larger than the block, read more
+			want = block->raw.size();
+		}
+		if (block->raw.empty()) { delete block; break; }
+		block->id = id++;
+		block->file_offset = file_offset;
+		file_offset += block->raw.size();
+
+		pthread_mutex_lock(&lock_);
+		while (!stop_ && num_blocks_read_ - num_blocks_consumed_ >= max_blocks_in_flight_) pthread_cond_wait(&space_cond_, &lock_);
+		if (stop_)
+		{
+			pthread_mutex_unlock(&lock_);
+			delete block;
+			break;
+		}
+		raw_blocks_.push_back(block);
+		++num_blocks_read_;
+		pthread_cond_signal(&raw_cond_);
+		pthread_mutex_unlock(&lock_);
+	}
+
+	pthread_mutex_lock(&lock_);
+	reading_done_ = true;
+	pthread_cond_broadcast(&raw_cond_);
+	pthread_cond_broadcast(&parsed_cond_);
+	pthread_mutex_unlock(&lock_);
+}
+
+void
+BlockFastaReader::x_parse_blocks()
+{
+	while (1)
+	{
+		pthread_mutex_lock(&lock_);
+		while (!stop_ && raw_head_ == raw_blocks_.size() && !reading_done_) pthread_cond_wait(&raw_cond_, &lock_);
+		if (stop_ || raw_head_ == raw_blocks_.size())
+		{
+			pthread_mutex_unlock(&lock_);
+			break;
+		}
+		Block* block = raw_blocks_[raw_head_++];
+		if (raw_head_ == raw_blocks_.size()) { raw_blocks_.clear(); raw_head_ = 0; }
+		pthread_mutex_unlock(&lock_);
+
+		x_parse_block(block);
+
+		pthread_mutex_lock(&lock_);
+		parsed_blocks_[block->id] = block;
+		pthread_cond_broadcast(&parsed_cond_);
+		pthread_mutex_unlock(&lock_);
+	}
+}
+
+// the plausibility check of FastaReader::x_check_data_line()
+static bool
+is_plausible_data_line(const char* line, const idx_t len)
+{
+	idx_t good = 0, bad = 0;
+	for (idx_t pos = 0; pos < len; ++pos)
+	{
+		const unsigned char c = line[pos];
+		if (isalpha(c) || c == '*' || c == '-') ++good;
+		else if (isspace(c) || (c >= '0' && c <= '9')) continue;
+		else if (c == ';') break;
+		else ++bad;
+	}
+	return !(bad >= good / 3 && (len > 3 || good == 0 || bad > good));
+}
+
+void
+BlockFastaReader::x_parse_block(Block* block)
+{
+	const u1_t* table = get_dna_encode_table();
+	const char* begin = block->raw.data();
+	const char* end = begin + block->raw.size();
+	const char* p = begin;
+	vector<char>& text = block->text;
+	text.reserve(block->raw.size());
+	Record* record = NULL;
+
+#define block_offset(q) ((long long)(block->file_offset + ((q) - begin)))
+#define finish_record() \
+	do { \
+		if (record && record->seq_size == 0) \
+			ERROR("BlockFastaReader: near byte %lld of \'%s\', sequence data is missing.", block_offset(p), file_name_); \
+		record = NULL; \
+	} while (0)
+
+	while (p < end)
+	{
+		const char* line = p;
+		p = next_line(p, end);
+		idx_t len = p - line;
+		if (len && line[len - 1] == '\n') --len;
+		if (len && line[len - 1] == '\r') --len;
+		if (len == 0) continue;
+		const char c = line[0];
+		if (c == '>' || c == '@')
+		{
+			finish_record();
+			if (len == 1) ERROR("BlockFastaReader: a sequence is given an empty header near byte %lld of \'%s\'.", block_offset(line), file_name_);
+			block->records.push_back(Record());
+			record = &block->records.back();
+			record->header_offset = text.size();
+			record->header_size = len - 1;
+			text.insert(text.end(), line + 1, line + len);
+			record->seq_offset = text.size();
+			record->seq_size = 0;
+		}
+		else if (c == '+')
+		{
+			if (!record) ERROR("BlockFastaReader: input doesn't start with a defline near byte %lld of \'%s\'.", block_offset(line), file_name_);
+			if (p >= end) ERROR("BlockFastaReader: quality score line is missing near byte %lld of \'%s\'.", block_offset(line), file_name_);
+			p = next_line(p, end);
+			finish_record();
+		}
+		else if (c == '#' || c == '!')
+		{
+			continue;
+		}
+		else if (!record)
+		{
+			ERROR("BlockFastaReader: input doesn't start with a defline or comment near byte %lld of \'%s\'.", block_offset(line), file_name_);
+		}
+		else
+		{
+			if (!is_plausible_data_line(line, len))
+				ERROR("BlockFastaReader: near byte %lld of \'%s\', there's a line that doesn't look like plausible data, but it's not marked as defline or comment.",
+					  block_offset(line), file_name_);
+			for (idx_t i = 0; i < len; ++i)
+			{
+				const unsigned char ch = line[i];
+				if (ch == ';') break;
+				if (table[ch] < 16) text.push_back(encode_bases_ ? (char)table[ch] : (char)ch);
+				else if (!isspace(ch))
+					ERROR("BlockFastaReader: there are invalid residue(s) around position %d of the line near byte %lld of \'%s\'.",
+						  (int)(i + 1), block_offset(line), file_name_);
+			}
+			record->seq_size = text.size() - record->seq_offset;
+		}
+	}
+	finish_record();
+
+#undef finish_record
+#undef block_offset
+
+	vector<char>().swap(block->raw);
+}
+
+bool
+BlockFastaReader::x_next_block()
+{
+	pthread_mutex_lock(&lock_);
+	if (curr_block_)
+	{
+		delete curr_block_;
+		curr_block_ = NULL;
+		++num_blocks_consumed_;
+		pthread_cond_signal(&space_cond_);
+	}
+	while (1)
+	{
+		map<idx_t, Block*>::iterator it = parsed_blocks_.find(num_blocks_consumed_);
+		if (it != parsed_blocks_.end())
+		{
+			curr_block_ = it->second;
+			parsed_blocks_.erase(it);
+			break;
+		}
+		if (reading_done_ && num_blocks_consumed_ == num_blocks_read_) break;
+		pthread_cond_wait(&parsed_cond_, &lock_);
+	}
+	pthread_mutex_unlock(&lock_);
+	curr_record_ = 0;
+	return curr_block_ != NULL;
+}
+
+bool
+BlockFastaReader::next_record(const char*& header, idx_t& header_size, const char*& seq, idx_t& seq_size)
+{
+	while (!curr_block_ || curr_record_ == curr_block_->records.size())
+		if (!x_next_block()) return false;
+	const Record& r = curr_block_->records[curr_record_++];
+	const char* text = curr_block_->text.data();
+	header = text + r.header_offset;
+	header_size = r.header_size;
+	seq = text + r.seq_offset;
+	seq_size = r.seq_size;
+	return true;
+}
+
+idx_t
+BlockFastaReader::read_one_seq(Sequence& seq)
+{
+	const char* header;
+	const char* s;
+	idx_t header_size, seq_size;
+	seq.clear();
+	if (!next_record(header, header_size, s, seq_size)) return -1;
+	seq.header().push_back(header, header_size);
+	seq.sequence().push_back(s, seq_size);
+	return seq_size;
+}
@@ -0,0 +1,89 @@
+#ifndef BLOCK_FASTA_READER_H
+#define BLOCK_FASTA_READER_H
+
+#include <pthread.h>
+#include <zlib.h>
+
+#include <map>
+#include <vector>
+
+#include "defs.h"
+#include "sequence.h"
+
+/* multi-threaded FASTA/FASTQ reader.
+ *
+ * a reader thread cuts the input into blocks of about kBlockSize bytes that end on a record boundary
+ * (a '>' line for FASTA, an '@' line followed two lines later by a '+' line for FASTQ).
+ * worker threads parse the blocks in parallel and the records are handed out in input order.
+ * the input is read through zlib, so gzip compressed files are accepted as they are.
+ *
+ * parsing follows FastaReader: multi-line FASTA, 4-line FASTQ, '#'/'!' comment lines, and ';' ends a data line.
+ * with encode_bases set, sequences are returned as get_dna_encode_table() codes instead of letters.
+ */
+
+class BlockFastaReader
+{
+public:
+	struct Record
+	{
+		idx_t header_offset;
+		idx_t header_size;
+		idx_t seq_offset;
+		idx_t seq_size;
+	};
+
+	struct Block
+	{
+		idx_t id;
+		idx_t file_offset;
+		std::vector<char> raw;
+		std::vector<char> text;
+		std::vector<Record> records;
+	};
+
+public:
+	BlockFastaReader(const char* file_name, const int num_threads, const bool encode_bases = false);
+	~BlockFastaReader();
+
+	// same contract as FastaReader::read_one_seq(): returns the sequence size, or -1 at the end of input
+	idx_t read_one_seq(Sequence& seq);
+
+	// zero-copy access to the next record, valid until the next call. returns false at the end of input.
+	bool next_record(const char*& header, idx_t& header_size, const char*& seq, idx_t& seq_size);
+
+private:
+	static void* reader_func(void* arg);
+	static void* worker_func(void* arg);
+	void x_read_blocks();
+	void x_parse_blocks();
+	void x_parse_block(Block* block);
+	bool x_next_block();
+
+private:
+	static const idx_t kBlockSize = 16 * 1024 * 1024;
+
+	const char*				file_name_;
+	gzFile					in_;
+	bool					encode_bases_;
+	int						num_threads_;
+	pthread_t				reader_tid_;
+	std::vector<pthread_t>	worker_tids_;
+
+	pthread_mutex_t			lock_;
+	pthread_cond_t			raw_cond_;			// a raw block is available, or reading is done
+	pthread_cond_t			space_cond_;		// the number of blocks in flight dropped
+	pthread_cond_t			parsed_cond_;		// a block is parsed
+	std::vector<Block*>		raw_blocks_;
+	size_t					raw_head_;
+	std::map<idx_t, Block*>	parsed_blocks_;
+	idx_t					num_blocks_read_;
+	idx_t					num_blocks_consumed_;
+	idx_t					max_blocks_in_flight_;
+	bool					reading_done_;
+	bool					stop_;
+
+	Block*					curr_block_;
+	size_t					curr_record_;
+};
+
+#endif // BLOCK_FASTA_READER_H
@@ -106,7 +106,7 @@ GetAlignString(const char* query, const int q_len,
 
 int Align(const char* query, const int q_len, const char* target, const int t_len,
 		  const int band_tolerance, const int get_aln_str, Alignment* align,
-		  int* V, int* U, DPathData2* d_path, PathPoint* aln_path, const int right_extend)
+		  int* V, int* U, Workspace<DPathData2>& d_path_ws, Workspace<PathPoint>& aln_path_ws, const int right_extend)
 {
 	int k_offset;
 	int  d;
@@ -122,6 +122,9 @@ int Align(const char* query, const int q_len, const char* target, const int t_le
 	max_d = (int)(.3 * (q_len + t_len));
 	k_offset = max_d;
 	band_size = band_tolerance * 2;
+	// a round d visits at most band_size / 2 + 1 diagonals before the band check stops the search
+	DPathData2* d_path = d_path_ws.reserve((idx)max_d * (band_size / 2 + 1) + 1);
+	PathPoint* aln_path = aln_path_ws.reserve(q_len + t_len + 2);
 	align->init();
 	best_m = -1;
 	min_k = 0;
@@ -219,7 +222,7 @@ int Align(const char* query, const int q_len, const char* target, const int t_le
 }
 
 void dw_in_one_direction(const char* query, const int query_size, const char* target, const int target_size,
-						 int* U, int* V, Alignment* align, DPathData2* d_path, PathPoint* aln_path,
+						 int* U, int* V, Alignment* align, Workspace<DPathData2>& d_path, Workspace<PathPoint>& aln_path,
 						 DiffAlignParameters* swp, OutputStore* result, const int right_extend)
 {
 	const int kTailMatchBP = 4;
@@ -296,6 +299,7 @@ DiffAligner::go(const char* query, const int qstart, const int qsize,
 				const char* target, const int tstart, const int tsize,
 				const int min_aln_size)
 {
+	result->reserve(qsize + tsize + 1);
 	result->init();
 	align->init();
 	dw_in_one_direction(query + qstart - 1, qstart, 
@@ -4,6 +4,7 @@
 #include "defs.h"
 #include "alignment.h"
 #include "gapalign.h"
+#include "workspace.h"
 
 #include <string>
 #include <vector>
@@ -16,10 +17,6 @@ struct DiffAlignParameters
     idx row_size;
     idx column_size;
     idx segment_aln_size;
-    idx max_seq_size;
-    idx max_aln_size;
-    idx d_path_size;
-    idx aln_path_size;
 	
 	void init(const int large_block = 0) {
 		if (large_block) {
@@ -27,19 +24,11 @@ struct DiffAlignParameters
             row_size = 4096;
             column_size = 4096;
             segment_aln_size = 4096;
-            max_seq_size = MAX_SEQ_SIZE;
-            max_aln_size = MAX_SEQ_SIZE;
-            d_path_size = 5000000;
-            aln_path_size = 5000000;
         } else {
             segment_size = 500;
             row_size = 4096;
             column_size = 4096;
             segment_aln_size = 4096;
-            max_seq_size = MAX_SEQ_SIZE;
-            max_aln_size = MAX_SEQ_SIZE;
-            d_path_size = 5000000;
-            aln_path_size = 5000000;
         }
 	}
 };
@@ -87,6 +76,10 @@ struct OutputStore
 	int query_start, query_end;
 	int target_start, target_end;
 	
+	// the six stores are carved out of one workspace, each of them holds max_aln_size chars
+	Workspace<char> stores;
+	idx max_aln_size;
+	
 	double calc_ident() const {
 		if (out_store_size == 0) return 0.0;
 		int n = 0;
@@ -96,22 +89,21 @@ struct OutputStore
 		return 100.0 * n / out_store_size;
 	}
 	
-	OutputStore(const idx max_aln_size) {
-		snew(left_store1, char, max_aln_size);
-		snew(left_store2, char, max_aln_size);
-		snew(right_store1, char, max_aln_size);
-		snew(right_store2, char, max_aln_size);
-		snew(out_store1, char, max_aln_size);
-		snew(out_store2, char, max_aln_size);
+	OutputStore() {
+		left_store1 = left_store2 = right_store1 = right_store2 = out_store1 = out_store2 = NULL;
+		max_aln_size = 0;
 	}
 	
-	~OutputStore() {
-		sfree(left_store1);
-		sfree(left_store2);
-		sfree(right_store1);
-		sfree(right_store2);
-		sfree(out_store1);
-		sfree(out_store2);
+	void reserve(const idx aln_size) {
+		if (aln_size <= max_aln_size) return;
+		char* p = stores.reserve(6 * aln_size);
+		max_aln_size = stores.size() / 6;
+		left_store1 = p;
+		left_store2 = p + max_aln_size;
+		right_store1 = p + 2 * max_aln_size;
+		right_store2 = p + 3 * max_aln_size;
+		out_store1 = p + 4 * max_aln_size;
+		out_store2 = p + 5 * max_aln_size;
 	}
 	
 	void init() {
@@ -140,11 +132,9 @@ public:
     DiffAligner(const int large_block) {
         param.init(large_block);
 		align = new Alignment(param.segment_aln_size);
-		result = new OutputStore(param.max_aln_size);
+		result = new OutputStore();
         snew(dynq, int, param.row_size);
         snew(dynt, int, param.column_size);
-        snew(d_path, DPathData2, param.d_path_size);
-        snew(aln_path, PathPoint, param.aln_path_size);
     }
     
     virtual ~DiffAligner() {
@@ -152,8 +142,6 @@ public:
 		delete result;
         sfree(dynq);
         sfree(dynt);
-        sfree(d_path);
-        sfree(aln_path);
     }
 
 	virtual bool go(const char* query, const int qstart, const int qsize, 
@@ -194,8 +182,8 @@ public:
     int*            		dynt;
     Alignment*       		align;
     OutputStore*     		result;
-    DPathData2*     		d_path;
-    PathPoint*      		aln_path;
+    Workspace<DPathData2>	d_path;
+    Workspace<PathPoint>	aln_path;
 };
 
 #endif // DIFF_GAPALIGN_H
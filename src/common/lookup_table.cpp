@@ -1,160 +1,574 @@
 #include "lookup_table.h"
 #include "packed_db.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 ref_index*
 destroy_ref_index(ref_index* ridx)
 {
-	safe_free(ridx->kmer_counts);
+	if (ridx->map_addr)
+	{
+		munmap(ridx->map_addr, ridx->map_size);
+		safe_free(ridx);
+		return NULL;
+	}
+	safe_free(ridx->bucket_starts);
+	safe_free(ridx->kmer_keys);
 	safe_free(ridx->kmer_starts);
 	safe_free(ridx->kmer_offsets);
 	safe_free(ridx);
 	return NULL;
 }
 
+int
+select_minimizers(const uint32_t* kmers, const int num_kmers, const int kmer_size, const int window, int* positions, int* work)
+{
+	// work[head, tail) holds k-mer indices of increasing hash, its front is the minimizer of the current window
+	int head = 0, tail = 0, n = 0;
+	for (int i = 0; i < num_kmers; ++i)
+	{
+		const uint32_t h = ref_index_kmer_hash(kmers[i], kmer_size);
+		while (tail > head && ref_index_kmer_hash(kmers[work[tail - 1]], kmer_size) > h) --tail;
+		work[tail++] = i;
+		if (work[head] <= i - window) ++head;
+		if (i < window - 1 && i < num_kmers - 1) continue;
+		if (n == 0 || positions[n - 1] != work[head]) positions[n++] = work[head];
+	}
+	return n;
+}
+
+// the minimizers of a read of the volume, kmers[positions[i]] is the i-th of them
+static int
+get_read_minimizers(volume_t* v, const int read_start, const int read_size, const int kmer_size, const int window,
+					std::vector<uint32_t>& kmers, std::vector<int>& positions, std::vector<int>& work)
+{
+	const int num_kmers = read_size - kmer_size + 1;
+	if (num_kmers <= 0) return 0;
+	kmers.resize(num_kmers);
+	positions.resize(num_kmers);
+	work.resize(num_kmers);
+	for (int j = 0; j < num_kmers; ++j) kmers[j] = get_packed_kmer(v->data, read_start + j, kmer_size);
+	return select_minimizers(kmers.data(), num_kmers, kmer_size, window, positions.data(), work.data());
+}
+
 typedef struct
 {
 	ref_index* ridx;
-	uint32_t min_key;
-	uint32_t max_key;
+	uint32_t min_bucket;
+	uint32_t max_bucket;
+	int min_read;
+	int max_read;
 	volume_t* v;
-	int kmer_size;
+	uint32_t* bucket_sizes;
+	uint32_t* bucket_num_kmers;
+	uint32_t* bucket_fill;
+	idx_t num_positions;
+	idx_t num_masked; 	// positions of masked k-mers dropped
+	const repeat_mask_t* mask;
+	int shared; 		// bucket_sizes/bucket_fill are updated by more than one thread
 } ref_index_thread_info;
 
+// count the k-mer positions of reads [min_read, max_read) per bucket
 void*
-fill_ref_index_offsets_func(void* arg)
+count_ref_index_kmers_func(void* arg)
 {
 	ref_index_thread_info* riti = (ref_index_thread_info*)(arg);
 	volume_t* v = riti->v;
-	int num_reads = v->num_reads;
-	ref_index* index = riti->ridx;
-	int kmer_size = riti->kmer_size;
-	uint32_t index_count = 1 << (kmer_size * 2);
-	uint32_t leftnum = 34 - 2 * kmer_size;
-	int i, j;
-	for (i = 0; i < num_reads; ++i)
+	const int kmer_size = riti->ridx->kmer_size;
+	const int bucket_shift = riti->ridx->bucket_shift;
+	const int window = riti->ridx->minimizer_window;
+	uint32_t* bucket_sizes = riti->bucket_sizes;
+	idx_t num_positions = 0;
+	std::vector<uint32_t> kmers;
+	std::vector<int> positions, work;
+	for (int i = riti->min_read; i < riti->max_read; ++i)
 	{
 		int read_start = v->offset_list->offset_list[i].offset;
 		int read_size = v->offset_list->offset_list[i].size;
-		uint32_t eit = 0;
-		for (j = 0; j < read_size; ++j)
+		if (window)
 		{
-			int k = read_start + j;
-			uint8_t c = PackedDB::get_char(v->data, k);
-			eit = (eit << 2) | c;
-			assert(eit < index_count);
-			if (j >= kmer_size - 1)
+			const int n = get_read_minimizers(v, read_start, read_size, kmer_size, window, kmers, positions, work);
+			for (int j = 0; j < n; ++j)
 			{
-				if (index->kmer_starts[eit] && eit >= riti->min_key && eit <= riti->max_key)
-				{
-					index->kmer_starts[eit][index->kmer_counts[eit]] = k + 1 - kmer_size;
-					++index->kmer_counts[eit];
-				}
-				eit <<= leftnum;
-				eit >>= leftnum;
+				uint32_t kmer = kmers[positions[j]];
+				if (riti->shared) __sync_fetch_and_add(bucket_sizes + (kmer >> bucket_shift), 1);
+				else ++bucket_sizes[kmer >> bucket_shift];
 			}
+			num_positions += n;
+			continue;
+		}
+		for (int j = 0; j + kmer_size <= read_size; ++j)
+		{
+			uint32_t kmer = get_packed_kmer(v->data, read_start + j, kmer_size);
+			if (riti->shared) __sync_fetch_and_add(bucket_sizes + (kmer >> bucket_shift), 1);
+			else ++bucket_sizes[kmer >> bucket_shift];
 		}
+		if (read_size >= kmer_size) num_positions += read_size - kmer_size + 1;
 	}
-	
+	riti->num_positions = num_positions;
 	return NULL;
 }
 
-ref_index*
-create_ref_index(volume_t* v, int kmer_size, int num_threads)
+// scatter the k-mer positions of reads [min_read, max_read) into their buckets.
+// the order inside a bucket depends on thread timing and is fixed by sort_ref_index_buckets_func().
+void*
+scatter_ref_index_kmers_func(void* arg)
 {
-	DynamicTimer dtimer(__func__);
-	uint32_t index_count = 1 << (kmer_size * 2);
-	uint32_t leftnum = 34 - 2 * kmer_size;
-	ref_index* index = (ref_index*)malloc(sizeof(ref_index));
-	safe_calloc(index->kmer_counts, int, index_count);
-	int num_reads = v->num_reads;
-	for (uint32_t i = 0; i != index_count; ++i) assert(index->kmer_counts[i] == 0);
-	for (int i = 0; i != num_reads; ++i)
+	ref_index_thread_info* riti = (ref_index_thread_info*)(arg);
+	volume_t* v = riti->v;
+	ref_index* index = riti->ridx;
+	const int kmer_size = index->kmer_size;
+	const int bucket_shift = index->bucket_shift;
+	const int window = index->minimizer_window;
+	uint32_t* bucket_fill = riti->bucket_fill;
+	std::vector<uint32_t> kmers;
+	std::vector<int> positions, work;
+	for (int i = riti->min_read; i < riti->max_read; ++i)
 	{
 		int read_start = v->offset_list->offset_list[i].offset;
 		int read_size = v->offset_list->offset_list[i].size;
-		uint32_t eit = 0;
-		for (int j = 0; j < read_size; ++j)
+		if (window)
 		{
-			int k = read_start + j;
-			uint8_t c = PackedDB::get_char(v->data, k);
-			assert(c>= 0 && c < 4);
-			eit = (eit << 2) | c;
-			if (j >= kmer_size - 1)
+			const int n = get_read_minimizers(v, read_start, read_size, kmer_size, window, kmers, positions, work);
+			for (int j = 0; j < n; ++j)
 			{
-				assert(eit < index_count);
-				++index->kmer_counts[eit];
-				eit = eit << leftnum;
-				eit = eit >> leftnum;
+				uint32_t kmer = kmers[positions[j]];
+				uint32_t slot = riti->shared ? __sync_fetch_and_add(bucket_fill + (kmer >> bucket_shift), 1) : bucket_fill[kmer >> bucket_shift]++;
+				index->kmer_offsets[slot] = read_start + positions[j];
 			}
+			continue;
+		}
+		for (int j = 0; j + kmer_size <= read_size; ++j)
+		{
+			uint32_t kmer = get_packed_kmer(v->data, read_start + j, kmer_size);
+			uint32_t slot = riti->shared ? __sync_fetch_and_add(bucket_fill + (kmer >> bucket_shift), 1) : bucket_fill[kmer >> bucket_shift]++;
+			index->kmer_offsets[slot] = read_start + j;
 		}
 	}
-	
-	int num_kmers = 0;
-	for (uint32_t i = 0; i != index_count; ++i) 
-	{
-		if (index->kmer_counts[i] > 128) index->kmer_counts[i] = 0;
-		num_kmers += index->kmer_counts[i];
-	}
-	printf("number of kmers: %d\n", num_kmers);
-	safe_malloc(index->kmer_offsets, int, num_kmers);
-	safe_malloc(index->kmer_starts, int*, index_count);
-	
-	if (v->curr < 10 * 1000000) num_threads = 1;
-	int kmers_per_thread = (num_kmers + num_threads - 1) / num_threads;
-	fprintf(stderr, "%d threads are used for filling offset lists.\n", num_threads);
-	uint32_t hash_boundaries[2 * num_threads];
-	uint32_t L = 0;
-	num_kmers = 0;
-	int kmer_cnt = 0;
-	int tid = 0;
-	for (uint32_t i = 0; i != index_count; ++i)
+	return NULL;
+}
+
+// sum of bucket_sizes over [min_bucket, max_bucket], stored in num_positions
+void*
+sum_ref_index_buckets_func(void* arg)
+{
+	ref_index_thread_info* riti = (ref_index_thread_info*)(arg);
+	idx_t sum = 0;
+	for (uint32_t b = riti->min_bucket; b <= riti->max_bucket; ++b) sum += riti->bucket_sizes[b];
+	riti->num_positions = sum;
+	return NULL;
+}
+
+// exclusive prefix sums of bucket_sizes over [min_bucket, max_bucket], starting from num_positions
+void*
+scan_ref_index_buckets_func(void* arg)
+{
+	ref_index_thread_info* riti = (ref_index_thread_info*)(arg);
+	ref_index* index = riti->ridx;
+	uint32_t sum = riti->num_positions;
+	for (uint32_t b = riti->min_bucket; b <= riti->max_bucket; ++b)
+	{
+		index->bucket_starts[b] = sum;
+		riti->bucket_fill[b] = sum;
+		sum += riti->bucket_sizes[b];
+	}
+	return NULL;
+}
+
+/* sort the positions of every bucket in [min_bucket, max_bucket] by (k-mer, position) and
+ * drop k-mers occurring more than REF_INDEX_MAX_KMER_OCC times or masked. the kept positions are moved
+ * to the front of the bucket's slot; bucket_sizes and bucket_num_kmers are updated accordingly. */
+void*
+sort_ref_index_buckets_func(void* arg)
+{
+	ref_index_thread_info* riti = (ref_index_thread_info*)(arg);
+	ref_index* index = riti->ridx;
+	const uint8_t* data = riti->v->data;
+	const int kmer_size = index->kmer_size;
+	const repeat_mask_t* mask = riti->mask;
+	idx_t num_masked = 0;
+	std::vector<uint64_t> pairs;
+	for (uint32_t b = riti->min_bucket; b <= riti->max_bucket; ++b)
 	{
-		if (index->kmer_counts[i])
+		int* offsets = index->kmer_offsets + index->bucket_starts[b];
+		const uint32_t n = riti->bucket_sizes[b];
+		pairs.resize(n);
+		for (uint32_t i = 0; i < n; ++i)
+			pairs[i] = ((uint64_t)get_packed_kmer(data, offsets[i], kmer_size) << 32) | (uint32_t)offsets[i];
+		std::sort(pairs.begin(), pairs.end());
+
+		uint32_t num_kept = 0, num_kmers = 0, i = 0;
+		while (i < n)
 		{
-			index->kmer_starts[i] = index->kmer_offsets + num_kmers;
-			num_kmers += index->kmer_counts[i];
-			kmer_cnt += index->kmer_counts[i];
-			index->kmer_counts[i] = 0;
-			
-			if (kmer_cnt >= kmers_per_thread)
+			uint32_t j = i + 1;
+			const uint32_t kmer = pairs[i] >> 32;
+			while (j < n && (uint32_t)(pairs[j] >> 32) == kmer) ++j;
+			if (mask && j - i <= REF_INDEX_MAX_KMER_OCC && repeat_mask_contains(mask, kmer))
 			{
-				printf("thread %d: %d\t%d\n", tid, L, i);
-				hash_boundaries[2 * tid] = L;
-				hash_boundaries[2 * tid + 1] = i;
-				++tid;
-				L = i + 1;
-				kmer_cnt = 0;
+				num_masked += j - i;
 			}
+			else if (j - i <= REF_INDEX_MAX_KMER_OCC)
+			{
+				for (uint32_t k = i; k < j; ++k) offsets[num_kept++] = (int)(uint32_t)pairs[k];
+				++num_kmers;
+			}
+			i = j;
 		}
-		else
-		{
-			index->kmer_starts[i] = NULL;
-		}
+		riti->bucket_sizes[b] = num_kept;
+		riti->bucket_num_kmers[b] = num_kmers;
 	}
-	if (kmer_cnt)
+	riti->num_masked = num_masked;
+	return NULL;
+}
+
+// fill kmer_keys and kmer_starts for the buckets in [min_bucket, max_bucket] from the compacted positions
+void*
+fill_ref_index_keys_func(void* arg)
+{
+	ref_index_thread_info* riti = (ref_index_thread_info*)(arg);
+	ref_index* index = riti->ridx;
+	const uint8_t* data = riti->v->data;
+	const int kmer_size = index->kmer_size;
+	for (uint32_t b = riti->min_bucket; b <= riti->max_bucket; ++b)
 	{
-		printf("thread %d: %d\t%d\n", tid, L, index_count - 1);
-		hash_boundaries[2 * tid] = L;
-		hash_boundaries[2 * tid + 1] = index_count - 1;
+		if (riti->bucket_sizes[b] == 0) continue;
+		uint32_t kid = index->bucket_starts[b];
+		const uint32_t from = index->kmer_starts[kid];
+		const uint32_t to = from + riti->bucket_sizes[b];
+		uint32_t last_kmer = 0;
+		for (uint32_t i = from; i < to; ++i)
+		{
+			uint32_t kmer = get_packed_kmer(data, index->kmer_offsets[i], kmer_size);
+			if (i == from || kmer != last_kmer)
+			{
+				index->kmer_keys[kid] = kmer;
+				index->kmer_starts[kid] = i;
+				++kid;
+				last_kmer = kmer;
+			}
+		}
+		r_assert(kid == index->bucket_starts[b + 1]);
 	}
-	
+	return NULL;
+}
+
+static void
+run_ref_index_threads(void* (*func)(void*), ref_index_thread_info* ritis, const int num_threads)
+{
+	pthread_t tids[num_threads];
+	for (int j = 0; j < num_threads; ++j)
+		pthread_create(tids + j, NULL, func, (void*)(ritis + j));
+	for (int j = 0; j < num_threads; ++j)
+		pthread_join(tids[j], NULL);
+}
+
+ref_index*
+create_ref_index(volume_t* v, int kmer_size, const int minimizer_window, const repeat_mask_t* mask, int num_threads)
+{
+	DynamicTimer dtimer(__func__);
+	r_assert(kmer_size > 0 && kmer_size <= 16);
+	r_assert(minimizer_window >= 0);
+	r_assert(!mask || mask->kmer_size == kmer_size);
+	if (num_threads < 1) num_threads = 1;
+	ref_index* index = (ref_index*)malloc(sizeof(ref_index));
+	index->kmer_size = kmer_size;
+	index->minimizer_window = minimizer_window;
+	index->map_addr = NULL;
+	index->map_size = 0;
+	// about one bucket per 16 bases, at most 2^24 buckets
+	int bucket_bits = 8;
+	while (bucket_bits < 2 * kmer_size && bucket_bits < 24 && ((idx_t)1 << (bucket_bits + 4)) < v->curr) ++bucket_bits;
+	if (bucket_bits > 2 * kmer_size) bucket_bits = 2 * kmer_size;
+	index->bucket_bits = bucket_bits;
+	index->bucket_shift = 2 * kmer_size - bucket_bits;
+	const uint32_t num_buckets = 1U << bucket_bits;
+	const int num_reads = v->num_reads;
+	fprintf(stderr, "%d threads are used for building the k-mer index.\n", num_threads);
+
+	uint32_t* bucket_sizes;
+	uint32_t* bucket_num_kmers;
+	uint32_t* bucket_fill;
+	safe_calloc(bucket_sizes, uint32_t, num_buckets);
+	safe_malloc(bucket_num_kmers, uint32_t, num_buckets);
+	safe_malloc(bucket_fill, uint32_t, num_buckets);
+	safe_malloc(index->bucket_starts, uint32_t, num_buckets + 1);
 	ref_index_thread_info ritis[num_threads];
 	for (int i = 0; i != num_threads; ++i)
 	{
 		ritis[i].ridx = index;
-		ritis[i].min_key = hash_boundaries[2 * i];
-		ritis[i].max_key = hash_boundaries[2 * i + 1];
 		ritis[i].v = v;
-		ritis[i].kmer_size = kmer_size;
+		ritis[i].bucket_sizes = bucket_sizes;
+		ritis[i].bucket_num_kmers = bucket_num_kmers;
+		ritis[i].bucket_fill = bucket_fill;
+		ritis[i].mask = mask;
+		ritis[i].num_masked = 0;
+		ritis[i].shared = num_threads > 1;
 	}
-	
-	pthread_t tids[num_threads];
-	for (int j = 0; j < num_threads; ++j)
-		pthread_create(tids + j, NULL, fill_ref_index_offsets_func, (void*)(ritis + j));
-	for (int j = 0; j < num_threads; ++j)
-		pthread_join(tids[j], NULL);
-	
+
+	// 1) count positions per bucket, reads are split into ranges of about the same number of bases
+	const idx_t bases_per_thread = ((idx_t)v->curr + num_threads - 1) / num_threads;
+	int rid = 0;
+	for (int i = 0; i != num_threads; ++i)
+	{
+		ritis[i].min_read = rid;
+		const idx_t last_base = (i == num_threads - 1) ? v->curr : bases_per_thread * (i + 1);
+		while (rid < num_reads && v->offset_list->offset_list[rid].offset < last_base) ++rid;
+		if (i == num_threads - 1) rid = num_reads;
+		ritis[i].max_read = rid;
+	}
+	run_ref_index_threads(count_ref_index_kmers_func, ritis, num_threads);
+	idx_t num_positions = 0;
+	for (int i = 0; i != num_threads; ++i) num_positions += ritis[i].num_positions;
+	r_assert(num_positions < UINT32_MAX);
+
+	// 2) parallel exclusive prefix sum of the bucket sizes
+	const uint32_t buckets_per_thread = (num_buckets + num_threads - 1) / num_threads;
+	int num_scan_threads = 0;
+	for (uint32_t b = 0; b < num_buckets; b += buckets_per_thread, ++num_scan_threads)
+	{
+		ritis[num_scan_threads].min_bucket = b;
+		ritis[num_scan_threads].max_bucket = std::min(b + buckets_per_thread, num_buckets) - 1;
+	}
+	run_ref_index_threads(sum_ref_index_buckets_func, ritis, num_scan_threads);
+	idx_t sum = 0;
+	for (int i = 0; i != num_scan_threads; ++i)
+	{
+		idx_t s = ritis[i].num_positions;
+		ritis[i].num_positions = sum;
+		sum += s;
+	}
+	run_ref_index_threads(scan_ref_index_buckets_func, ritis, num_scan_threads);
+	index->bucket_starts[num_buckets] = num_positions;
+
+	// 3) scatter positions into their buckets
+	safe_malloc(index->kmer_offsets, int, num_positions);
+	run_ref_index_threads(scatter_ref_index_kmers_func, ritis, num_threads);
+	safe_free(bucket_fill);
+
+	// 4) sort and filter buckets, split into k-mer ranges of about the same number of positions
+	const idx_t positions_per_thread = (num_positions + num_threads - 1) / num_threads;
+	uint32_t L = 0;
+	idx_t cnt = 0;
+	int tid = 0;
+	for (uint32_t b = 0; b < num_buckets && tid < num_threads - 1; ++b)
+	{
+		cnt += bucket_sizes[b];
+		if (cnt >= positions_per_thread)
+		{
+			ritis[tid].min_bucket = L;
+			ritis[tid].max_bucket = b;
+			++tid;
+			L = b + 1;
+			cnt = 0;
+		}
+	}
+	const int num_sort_threads = (L < num_buckets) ? tid + 1 : tid;
+	if (L < num_buckets)
+	{
+		ritis[tid].min_bucket = L;
+		ritis[tid].max_bucket = num_buckets - 1;
+	}
+	run_ref_index_threads(sort_ref_index_buckets_func, ritis, num_sort_threads);
+	idx_t num_masked = 0;
+	for (int i = 0; i != num_sort_threads; ++i) num_masked += ritis[i].num_masked;
+
+	// 5) compact the kept positions; bucket_starts now indexes kmer_keys, and kmer_starts
+	// temporarily holds the first position of every bucket
+	idx_t num_kmers = 0, num_kept = 0;
+	for (uint32_t b = 0; b < num_buckets; ++b) num_kmers += bucket_num_kmers[b];
+	index->num_kmers = num_kmers;
+	safe_malloc(index->kmer_keys, uint32_t, num_kmers);
+	safe_malloc(index->kmer_starts, uint32_t, num_kmers + 1);
+	num_kmers = 0;
+	for (uint32_t b = 0; b < num_buckets; ++b)
+	{
+		const uint32_t from = index->bucket_starts[b];
+		if (bucket_sizes[b] && from != num_kept)
+			memmove(index->kmer_offsets + num_kept, index->kmer_offsets + from, sizeof(int) * bucket_sizes[b]);
+		index->bucket_starts[b] = num_kmers;
+		if (bucket_num_kmers[b]) index->kmer_starts[num_kmers] = num_kept;
+		num_kmers += bucket_num_kmers[b];
+		num_kept += bucket_sizes[b];
+	}
+	index->bucket_starts[num_buckets] = num_kmers;
+	index->kmer_starts[num_kmers] = num_kept;
+	index->num_offsets = num_kept;
+	if (num_kept) safe_realloc(index->kmer_offsets, int, num_kept);
+
+	// 6) fill the distinct k-mers and their starts
+	run_ref_index_threads(fill_ref_index_keys_func, ritis, num_sort_threads);
+
+	safe_free(bucket_sizes);
+	safe_free(bucket_num_kmers);
+	if (minimizer_window) fprintf(stderr, "number of (%d,%d)-minimizers: %lld (%lld distinct)\n", minimizer_window, kmer_size, (long long)index->num_offsets, (long long)index->num_kmers);
+	else fprintf(stderr, "number of kmers: %lld (%lld distinct)\n", (long long)index->num_offsets, (long long)index->num_kmers);
+	if (mask) fprintf(stderr, "positions of masked repeat kmers: %lld\n", (long long)num_masked);
+	return index;
+}
+
+static inline int64_t
+align_kidx_offset(int64_t offset)
+{
+	return (offset + VOLUME_ALIGN - 1) / VOLUME_ALIGN * VOLUME_ALIGN;
+}
+
+static uint64_t
+ref_index_header_checksum(const ref_index_header_t* hdr)
+{
+	const uint8_t* p = (const uint8_t*)hdr;
+	const size_t n = offsetof(ref_index_header_t, header_checksum);
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 0x100000001B3ULL; }
+	return h;
+}
+
+static void
+write_kidx_section(FILE* out, int64_t* curr, const int64_t offset, const void* p, const int64_t bytes)
+{
+	static const char zeros[VOLUME_ALIGN] = { 0 };
+	r_assert(offset >= *curr && offset - *curr <= VOLUME_ALIGN);
+	if (offset > *curr) SAFE_WRITE(zeros, char, offset - *curr, out);
+	if (bytes) SAFE_WRITE(p, char, bytes, out);
+	*curr = offset + bytes;
+}
+
+void
+dump_ref_index(const char* kidx_name, ref_index* ridx, volume_t* v, const uint64_t vol_checksum, const repeat_mask_t* mask)
+{
+	ref_index_header_t hdr;
+	memset(&hdr, 0, sizeof(ref_index_header_t));
+	memcpy(hdr.magic, REF_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = REF_INDEX_VERSION;
+	hdr.kmer_size = ridx->kmer_size;
+	hdr.bucket_bits = ridx->bucket_bits;
+	hdr.max_kmer_occ = REF_INDEX_MAX_KMER_OCC;
+	hdr.minimizer_window = ridx->minimizer_window;
+	hdr.vol_num_reads = v->num_reads;
+	hdr.vol_num_bases = v->curr;
+	hdr.vol_checksum = vol_checksum;
+	hdr.mask_checksum = mask ? mask->checksum : 0;
+	hdr.num_kmers = ridx->num_kmers;
+	hdr.num_offsets = ridx->num_offsets;
+	const int64_t bucket_bytes = sizeof(uint32_t) * (((int64_t)1 << ridx->bucket_bits) + 1);
+	const int64_t keys_bytes = sizeof(uint32_t) * ridx->num_kmers;
+	const int64_t starts_bytes = sizeof(uint32_t) * (ridx->num_kmers + 1);
+	const int64_t offsets_bytes = sizeof(int) * ridx->num_offsets;
+	hdr.bucket_starts_offset = align_kidx_offset(sizeof(ref_index_header_t));
+	hdr.kmer_keys_offset = align_kidx_offset(hdr.bucket_starts_offset + bucket_bytes);
+	hdr.kmer_starts_offset = align_kidx_offset(hdr.kmer_keys_offset + keys_bytes);
+	hdr.kmer_offsets_offset = align_kidx_offset(hdr.kmer_starts_offset + starts_bytes);
+	hdr.file_size = align_kidx_offset(hdr.kmer_offsets_offset + offsets_bytes);
+	hdr.header_checksum = ref_index_header_checksum(&hdr);
+
+	// write to a private file first so that concurrent runs never see a partial index
+	char tmp_name[2048];
+	sprintf(tmp_name, "%s.tmp.%d", kidx_name, (int)getpid());
+	FILE* out = fopen(tmp_name, "wb");
+	if (!out)
+	{
+		LOG(stderr, "failed to open file \'%s\', k-mer index is not saved.", tmp_name);
+		return;
+	}
+	int64_t curr = 0;
+	write_kidx_section(out, &curr, 0, &hdr, sizeof(ref_index_header_t));
+	write_kidx_section(out, &curr, hdr.bucket_starts_offset, ridx->bucket_starts, bucket_bytes);
+	write_kidx_section(out, &curr, hdr.kmer_keys_offset, ridx->kmer_keys, keys_bytes);
+	write_kidx_section(out, &curr, hdr.kmer_starts_offset, ridx->kmer_starts, starts_bytes);
+	write_kidx_section(out, &curr, hdr.kmer_offsets_offset, ridx->kmer_offsets, offsets_bytes);
+	write_kidx_section(out, &curr, hdr.file_size, NULL, 0);
+	fclose(out);
+	if (rename(tmp_name, kidx_name)) 
+	{
+		LOG(stderr, "failed to rename \'%s\' to \'%s\'.", tmp_name, kidx_name);
+		unlink(tmp_name);
+	}
+}
+
+ref_index*
+load_ref_index(const char* kidx_name, volume_t* v, const int kmer_size, const int minimizer_window, const repeat_mask_t* mask, const uint64_t vol_checksum)
+{
+	int fd = open(kidx_name, O_RDONLY);
+	if (fd == -1) return NULL;
+	struct stat sbuf;
+	ref_index_header_t hdr;
+	bool valid = fstat(fd, &sbuf) == 0
+				 &&
+				 (size_t)sbuf.st_size >= sizeof(ref_index_header_t)
+				 &&
+				 pread(fd, &hdr, sizeof(ref_index_header_t), 0) == (ssize_t)sizeof(ref_index_header_t)
+				 &&
+				 memcmp(hdr.magic, REF_INDEX_MAGIC, sizeof(hdr.magic)) == 0
+				 &&
+				 hdr.version == REF_INDEX_VERSION
+				 &&
+				 hdr.header_checksum == ref_index_header_checksum(&hdr)
+				 &&
+				 hdr.file_size == (int64_t)sbuf.st_size
+				 &&
+				 hdr.kmer_size == kmer_size
+				 &&
+				 hdr.max_kmer_occ == REF_INDEX_MAX_KMER_OCC
+				 &&
+				 hdr.minimizer_window == minimizer_window
+				 &&
+				 hdr.vol_num_reads == v->num_reads
+				 &&
+				 hdr.vol_num_bases == v->curr
+				 &&
+				 hdr.vol_checksum == vol_checksum
+				 &&
+				 hdr.mask_checksum == (mask ? mask->checksum : 0)
+				 &&
+				 hdr.kmer_offsets_offset + (int64_t)sizeof(int) * hdr.num_offsets <= hdr.file_size;
+	if (!valid)
+	{
+		close(fd);
+		LOG(stderr, "k-mer index \'%s\' is stale or was built with other parameters, it will be rebuilt.", kidx_name);
+		return NULL;
+	}
+
+	void* addr = mmap(NULL, hdr.file_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) return NULL;
+	char* base = (char*)addr;
+	ref_index* index = (ref_index*)malloc(sizeof(ref_index));
+	index->kmer_size = hdr.kmer_size;
+	index->minimizer_window = hdr.minimizer_window;
+	index->bucket_bits = hdr.bucket_bits;
+	index->bucket_shift = 2 * hdr.kmer_size - hdr.bucket_bits;
+	index->num_kmers = hdr.num_kmers;
+	index->num_offsets = hdr.num_offsets;
+	index->bucket_starts = (uint32_t*)(base + hdr.bucket_starts_offset);
+	index->kmer_keys = (uint32_t*)(base + hdr.kmer_keys_offset);
+	index->kmer_starts = (uint32_t*)(base + hdr.kmer_starts_offset);
+	index->kmer_offsets = (int*)(base + hdr.kmer_offsets_offset);
+	index->map_addr = addr;
+	index->map_size = hdr.file_size;
+	return index;
+}
+
+ref_index*
+load_or_create_ref_index(const char* vol_name, volume_t* v, const int kmer_size, const int minimizer_window, const repeat_mask_t* mask, const int num_threads)
+{
+	char kidx_name[2048];
+	generate_kidx_file_name(vol_name, kidx_name);
+	const uint64_t vol_checksum = volume_checksum(v);
+	ref_index* index = load_ref_index(kidx_name, v, kmer_size, minimizer_window, mask, vol_checksum);
+	if (index)
+	{
+		LOG(stderr, "load k-mer index from \'%s\'", kidx_name);
+		return index;
+	}
+	index = create_ref_index(v, kmer_size, minimizer_window, mask, num_threads);
+	dump_ref_index(kidx_name, index, v, vol_checksum, mask);
 	return index;
 }
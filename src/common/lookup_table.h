@@ -2,18 +2,144 @@
 #define LOOKUP_TABLE_H
 
 #include "split_database.h"
+#include "repeat_mask.h"
+
+/* compact k-mer index of a volume.
+ *
+ * the index is a CSR over the sorted distinct k-mers of the volume:
+ * 		kmer_keys[i] 						the i-th distinct k-mer
+ * 		kmer_offsets[kmer_starts[i]...kmer_starts[i+1]) 	its positions in the volume
+ * a front table keyed by the top bucket_bits bits of a k-mer narrows the search
+ * for a k-mer down to the range [bucket_starts[b], bucket_starts[b+1]) of kmer_keys.
+ * memory grows with the number of (distinct) k-mers, not with 4^kmer_size.
+ *
+ * with minimizer_window w > 0 only the (w,k)-minimizers of every read are indexed: of every w
+ * consecutive k-mers the one of smallest ref_index_kmer_hash() (the leftmost on ties). queries
+ * must then be sampled with select_minimizers() and the same w for the seeds to meet.
+ *
+ * the k-mers of a repeat mask (see repeat_mask.h) are left out like the ones above the occurrence cutoff.
+ */
+
+#define REF_INDEX_MAX_KMER_OCC 128
 
 typedef struct
 {
-	int*  kmer_counts;
-	int** kmer_starts;
-	int*  kmer_offsets;
+	int 		kmer_size;
+	int 		minimizer_window; 	// 0 = every position is indexed
+	int 		bucket_bits;
+	int 		bucket_shift;
+	idx_t 		num_kmers; 			// number of distinct k-mers
+	idx_t 		num_offsets; 		// number of positions
+	uint32_t* 	bucket_starts; 		// (1 << bucket_bits) + 1 entries
+	uint32_t* 	kmer_keys; 			// num_kmers entries
+	uint32_t* 	kmer_starts; 		// num_kmers + 1 entries
+	int* 		kmer_offsets; 		// num_offsets entries
+	// non-NULL when the arrays above point into a read-only mapping of a .kidx file
+	void* 		map_addr;
+	size_t 		map_size;
 } ref_index;
 
+/* on-disk index layout (.kidx, version 3):
+ * [ref_index_header_t][bucket_starts][kmer_keys][kmer_starts][kmer_offsets]
+ * every array starts at a VOLUME_ALIGN boundary. the header records the k-mer size and a checksum
+ * of the volume the index was built from and of the repeat mask applied, so a stale or foreign index
+ * is never used.
+ */
+#define REF_INDEX_MAGIC 	"MECATKIX"
+#define REF_INDEX_VERSION 	3
+
+typedef struct
+{
+	char 		magic[8];
+	int 		version;
+	int 		kmer_size;
+	int 		bucket_bits;
+	int 		max_kmer_occ;
+	int 		minimizer_window;
+	int 		reserved;
+	int 		vol_num_reads;
+	int 		vol_num_bases;
+	uint64_t 	vol_checksum;
+	uint64_t 	mask_checksum; 		// 0 = no repeat mask
+	int64_t 	num_kmers;
+	int64_t 	num_offsets;
+	int64_t 	bucket_starts_offset;
+	int64_t 	kmer_keys_offset;
+	int64_t 	kmer_starts_offset;
+	int64_t 	kmer_offsets_offset;
+	int64_t 	file_size;
+	uint64_t 	header_checksum;
+} ref_index_header_t;
+
 ref_index*
 destroy_ref_index(ref_index* ridx);
 
+// mask may be NULL
+ref_index*
+create_ref_index(volume_t* v, int kmer_size, const int minimizer_window, const repeat_mask_t* mask, const int num_threads);
+
+void
+dump_ref_index(const char* kidx_name, ref_index* ridx, volume_t* v, const uint64_t vol_checksum, const repeat_mask_t* mask);
+
+// returns NULL if the index file is missing, corrupted or was not built from v with kmer_size, minimizer_window and mask
 ref_index*
-create_ref_index(volume_t* v, int kmer_size, const int num_threads);
+load_ref_index(const char* kidx_name, volume_t* v, const int kmer_size, const int minimizer_window, const repeat_mask_t* mask, const uint64_t vol_checksum);
+
+// mmap <vol_name>.kidx if it is valid for v, otherwise build the index and write it for later runs
+ref_index*
+load_or_create_ref_index(const char* vol_name, volume_t* v, const int kmer_size, const int minimizer_window, const repeat_mask_t* mask, const int num_threads);
+
+// k-mer (kmer_size <= 16) starting at base pos of a 2-bit packed sequence
+static inline uint32_t
+get_packed_kmer(const uint8_t* data, const idx_t pos, const int kmer_size)
+{
+	const uint8_t* p = data + (pos >> 2);
+	const int skip = pos & 3;
+	const int num_bytes = (skip + kmer_size + 3) >> 2;
+	uint64_t w = 0;
+	for (int i = 0; i < num_bytes; ++i) w = (w << 8) | p[i];
+	w >>= (num_bytes * 4 - skip - kmer_size) * 2;
+	return (uint32_t)(w & ((1ULL << (2 * kmer_size)) - 1));
+}
+
+// invertible hash of the 2 * kmer_size bits of a k-mer, it orders k-mers for minimizer selection
+static inline uint32_t
+ref_index_kmer_hash(const uint32_t kmer, const int kmer_size)
+{
+	const uint64_t mask = (1ULL << (2 * kmer_size)) - 1;
+	uint64_t key = kmer;
+	key = (~key + (key << 21)) & mask;
+	key = key ^ key >> 24;
+	key = ((key + (key << 3)) + (key << 8)) & mask;
+	key = key ^ key >> 14;
+	key = ((key + (key << 2)) + (key << 4)) & mask;
+	key = key ^ key >> 28;
+	key = (key + (key << 31)) & mask;
+	return (uint32_t)key;
+}
+
+/* the (window,kmer_size)-minimizers of the num_kmers consecutive k-mers of a sequence.
+ * their indices are written to positions in increasing order, and their number is returned.
+ * a sequence of fewer than window k-mers has one minimizer. work holds num_kmers ints. */
+int
+select_minimizers(const uint32_t* kmers, const int num_kmers, const int kmer_size, const int window, int* positions, int* work);
+
+// returns the number of occurrences of kmer and points *offsets to its (ascending) positions
+static inline int
+ref_index_lookup(const ref_index* ridx, const uint32_t kmer, const int** offsets)
+{
+	const uint32_t b = kmer >> ridx->bucket_shift;
+	uint32_t left = ridx->bucket_starts[b], right = ridx->bucket_starts[b + 1];
+	const uint32_t* keys = ridx->kmer_keys;
+	while (left < right)
+	{
+		uint32_t mid = left + (right - left) / 2;
+		if (keys[mid] < kmer) left = mid + 1;
+		else right = mid;
+	}
+	if (left == ridx->bucket_starts[b + 1] || keys[left] != kmer) { *offsets = NULL; return 0; }
+	*offsets = ridx->kmer_offsets + ridx->kmer_starts[left];
+	return ridx->kmer_starts[left + 1] - ridx->kmer_starts[left];
+}
 
 #endif // LOOKUP_TABLE_H
@@ -0,0 +1,69 @@
+#include "mem_budget.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+int64_t
+parse_mem_size(const char* s)
+{
+	if (!s || !*s) return -1;
+	char* end;
+	const double x = strtod(s, &end);
+	if (end == s || x < 0) return -1;
+	double unit = 1;
+	switch (*end)
+	{
+		case 'k': case 'K': unit = 1024.0; ++end; break;
+		case 'm': case 'M': unit = 1024.0 * 1024; ++end; break;
+		case 'g': case 'G': unit = 1024.0 * 1024 * 1024; ++end; break;
+		case 't': case 'T': unit = 1024.0 * 1024 * 1024 * 1024; ++end; break;
+		default: break;
+	}
+	if (unit > 1 && (*end == 'b' || *end == 'B')) ++end;
+	if (*end) return -1;
+	return (int64_t)(x * unit);
+}
+
+int64_t
+mem_plan_bytes(const mem_item_t* items, const int num_items, const int num_threads)
+{
+	int64_t sum = 0;
+	for (int i = 0; i < num_items; ++i) sum += items[i].per_thread ? items[i].bytes * num_threads : items[i].bytes;
+	return sum;
+}
+
+int
+mem_plan_max_threads(const mem_item_t* items, const int num_items, const int64_t budget, const int num_threads)
+{
+	const int64_t fixed = mem_plan_bytes(items, num_items, 0);
+	const int64_t per_thread = mem_plan_bytes(items, num_items, 1) - fixed;
+	if (fixed + per_thread > budget) return 0;
+	if (per_thread == 0) return num_threads;
+	const int64_t n = (budget - fixed) / per_thread;
+	return n < num_threads ? (int)n : num_threads;
+}
+
+static const char*
+mem_size_str(const int64_t bytes, char* buf)
+{
+	const double mb = bytes / (1024.0 * 1024.0);
+	if (mb >= 10240) sprintf(buf, "%.1fG", mb / 1024);
+	else sprintf(buf, "%.1fM", mb);
+	return buf;
+}
+
+void
+print_mem_plan(const char* title, const mem_item_t* items, const int num_items, const int64_t budget, const int num_threads)
+{
+	char b1[64], b2[64];
+	LOG(stderr, "memory plan of %s, %d thread(s):", title, num_threads);
+	for (int i = 0; i < num_items; ++i)
+	{
+		if (items[i].per_thread) {
+			LOG(stderr, "  %-24s %10s x %d", items[i].name, mem_size_str(items[i].bytes, b1), num_threads);
+		} else {
+			LOG(stderr, "  %-24s %10s", items[i].name, mem_size_str(items[i].bytes, b1));
+		}
+	}
+	LOG(stderr, "  %-24s %10s of %s", "total", mem_size_str(mem_plan_bytes(items, num_items, num_threads), b1), mem_size_str(budget, b2));
+}
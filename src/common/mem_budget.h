@@ -0,0 +1,38 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include "defs.h"
+
+/* memory budget of a run (--mem-budget).
+ *
+ * a plan is a list of estimated items: the fixed ones are held once, the per-thread ones by every
+ * worker. the programs size what they can (volumes) and cap the number of threads so that the sum
+ * stays under the budget, and print the plan before they start.
+ * buffers sized for the longest possible read (MAX_SEQ_SIZE) are counted in full where the reads are
+ * not known yet, and at the size the longest read needs where they are.
+ */
+
+typedef struct
+{
+	const char* 	name;
+	int64_t 		bytes;
+	int 			per_thread; 	// held by every thread
+} mem_item_t;
+
+// "512M", "64g", "1.5T" or a plain number of bytes; K, M, G and T are powers of 1024. -1 if malformed.
+int64_t
+parse_mem_size(const char* s);
+
+// bytes of the items with num_threads threads
+int64_t
+mem_plan_bytes(const mem_item_t* items, const int num_items, const int num_threads);
+
+// the largest number of threads <= num_threads with which the items fit into budget, 0 if not even one thread fits
+int
+mem_plan_max_threads(const mem_item_t* items, const int num_items, const int64_t budget, const int num_threads);
+
+// logs the items and their sum with num_threads threads against the budget
+void
+print_mem_plan(const char* title, const mem_item_t* items, const int num_items, const int64_t budget, const int num_threads);
+
+#endif // MEM_BUDGET_H
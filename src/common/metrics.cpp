@@ -0,0 +1,308 @@
+#include "metrics.h"
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct MetricsStageStat
+{
+	long long	calls;
+	double		wall_seconds;
+	double		cpu_seconds;
+
+	MetricsStageStat() : calls(0), wall_seconds(0), cpu_seconds(0) {}
+};
+
+// the metrics of one thread. the lock is only contended while the file is written.
+struct MetricsShard
+{
+	pthread_mutex_t						lock;
+	map<string, long long>				counters;
+	map<string, MetricsStageStat>		stages;
+
+	MetricsShard() { pthread_mutex_init(&lock, NULL); }
+};
+
+static string					metrics_path;
+static string					metrics_program;
+static vector<string>			metrics_argv;
+static struct timeval			metrics_start;
+static vector<MetricsShard*>	metrics_shards;
+static map<string, double>		metrics_gauges;
+static pthread_mutex_t			metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread MetricsShard*	metrics_tls_shard = NULL;
+
+static MetricsShard*
+get_shard()
+{
+	if (!metrics_tls_shard)
+	{
+		metrics_tls_shard = new MetricsShard;
+		pthread_mutex_lock(&metrics_lock);
+		metrics_shards.push_back(metrics_tls_shard);
+		pthread_mutex_unlock(&metrics_lock);
+	}
+	return metrics_tls_shard;
+}
+
+static void
+write_metrics_at_exit()
+{
+	metrics_write();
+}
+
+template <class Argv>
+static int
+x_metrics_init(int argc, Argv argv)
+{
+	const char* kFlag = "--metrics-json";
+	const size_t kFlagSize = strlen(kFlag);
+	const char* path = NULL;
+	int n = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--") == 0)
+		{
+			for (; i < argc; ++i) argv[n++] = argv[i];
+			break;
+		}
+		if (strncmp(argv[i], kFlag, kFlagSize) != 0)
+		{
+			argv[n++] = argv[i];
+		}
+		else if (argv[i][kFlagSize] == '=')
+		{
+			path = argv[i] + kFlagSize + 1;
+		}
+		else if (argv[i][kFlagSize] == '\0' && i + 1 < argc)
+		{
+			path = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "[%s, %u] argument to option \'%s\' is not provided!\n", __func__, __LINE__, kFlag);
+			exit(1);
+		}
+	}
+	if (argc > 0) argv[n] = NULL;
+	if (!path) return argc > 0 ? n : argc;
+	if (path[0] == '\0')
+	{
+		fprintf(stderr, "[%s, %u] argument to option \'%s\' is empty\n", __func__, __LINE__, kFlag);
+		exit(1);
+	}
+
+	const bool first = metrics_path.empty();
+	metrics_path = path;
+	const char* prog = argv[0];
+	const char* slash = strrchr(prog, '/');
+	metrics_program = slash ? slash + 1 : prog;
+	metrics_argv.clear();
+	for (int i = 0; i < n; ++i) metrics_argv.push_back(argv[i]);
+	if (first)
+	{
+		gettimeofday(&metrics_start, NULL);
+		atexit(write_metrics_at_exit);
+	}
+	return n;
+}
+
+int
+metrics_init(int argc, char* argv[])
+{
+	return x_metrics_init(argc, argv);
+}
+
+int
+metrics_init(int argc, const char* argv[])
+{
+	return x_metrics_init(argc, argv);
+}
+
+bool
+metrics_enabled()
+{
+	return !metrics_path.empty();
+}
+
+void
+metrics_count(const char* name, long long n)
+{
+	if (!metrics_enabled()) return;
+	MetricsShard* shard = get_shard();
+	pthread_mutex_lock(&shard->lock);
+	shard->counters[name] += n;
+	pthread_mutex_unlock(&shard->lock);
+}
+
+void
+metrics_gauge(const char* name, double value)
+{
+	if (!metrics_enabled()) return;
+	pthread_mutex_lock(&metrics_lock);
+	metrics_gauges[name] = value;
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+void
+metrics_gauge_max(const char* name, double value)
+{
+	if (!metrics_enabled()) return;
+	pthread_mutex_lock(&metrics_lock);
+	map<string, double>::iterator it = metrics_gauges.find(name);
+	if (it == metrics_gauges.end()) metrics_gauges[name] = value;
+	else if (it->second < value) it->second = value;
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+void
+metrics_stage(const char* name, double wall_seconds, double cpu_seconds)
+{
+	if (!metrics_enabled()) return;
+	MetricsShard* shard = get_shard();
+	pthread_mutex_lock(&shard->lock);
+	MetricsStageStat& s = shard->stages[name];
+	++s.calls;
+	s.wall_seconds += wall_seconds;
+	s.cpu_seconds += cpu_seconds;
+	pthread_mutex_unlock(&shard->lock);
+}
+
+static void
+print_json_string(FILE* out, const string& s)
+{
+	fputc('\"', out);
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		const unsigned char c = s[i];
+		if (c == '\"' || c == '\\') fprintf(out, "\\%c", c);
+		else if (c == '\n') fputs("\\n", out);
+		else if (c == '\t') fputs("\\t", out);
+		else if (c < 0x20) fprintf(out, "\\u%04x", c);
+		else fputc(c, out);
+	}
+	fputc('\"', out);
+}
+
+static double
+seconds(const struct timeval& t)
+{
+	return t.tv_sec + 1.0 * t.tv_usec / 1000000;
+}
+
+// the rchar and wchar fields of /proc/self/io, or -1
+static void
+get_io_bytes(long long& bytes_read, long long& bytes_written)
+{
+	bytes_read = bytes_written = -1;
+	FILE* in = fopen("/proc/self/io", "r");
+	if (!in) return;
+	char name[64];
+	long long value;
+	while (fscanf(in, "%63s %lld", name, &value) == 2)
+	{
+		if (strcmp(name, "rchar:") == 0) bytes_read = value;
+		else if (strcmp(name, "wchar:") == 0) bytes_written = value;
+	}
+	fclose(in);
+}
+
+void
+metrics_write()
+{
+	if (!metrics_enabled()) return;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	struct rusage self_usage, children_usage;
+	getrusage(RUSAGE_SELF, &self_usage);
+	getrusage(RUSAGE_CHILDREN, &children_usage);
+	long long bytes_read, bytes_written;
+	get_io_bytes(bytes_read, bytes_written);
+
+	map<string, long long> counters;
+	map<string, MetricsStageStat> stages;
+	map<string, double> gauges;
+	pthread_mutex_lock(&metrics_lock);
+	for (size_t i = 0; i < metrics_shards.size(); ++i)
+	{
+		MetricsShard* shard = metrics_shards[i];
+		pthread_mutex_lock(&shard->lock);
+		for (map<string, long long>::iterator it = shard->counters.begin(); it != shard->counters.end(); ++it)
+			counters[it->first] += it->second;
+		for (map<string, MetricsStageStat>::iterator it = shard->stages.begin(); it != shard->stages.end(); ++it)
+		{
+			MetricsStageStat& s = stages[it->first];
+			s.calls += it->second.calls;
+			s.wall_seconds += it->second.wall_seconds;
+			s.cpu_seconds += it->second.cpu_seconds;
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+	gauges = metrics_gauges;
+	pthread_mutex_unlock(&metrics_lock);
+
+	FILE* out = fopen(metrics_path.c_str(), "w");
+	if (!out)
+	{
+		fprintf(stderr, "[%s, %u] cannot open file \'%s\' for writing metrics\n", __func__, __LINE__, metrics_path.c_str());
+		return;
+	}
+	fprintf(out, "{\n");
+	fprintf(out, "  \"program\": ");
+	print_json_string(out, metrics_program);
+	fprintf(out, ",\n  \"argv\": [");
+	for (size_t i = 0; i < metrics_argv.size(); ++i)
+	{
+		if (i) fprintf(out, ", ");
+		print_json_string(out, metrics_argv[i]);
+	}
+	fprintf(out, "],\n");
+	fprintf(out, "  \"wall_seconds\": %.6f,\n", seconds(now) - seconds(metrics_start));
+	fprintf(out, "  \"user_cpu_seconds\": %.6f,\n", seconds(self_usage.ru_utime));
+	fprintf(out, "  \"sys_cpu_seconds\": %.6f,\n", seconds(self_usage.ru_stime));
+	fprintf(out, "  \"children_user_cpu_seconds\": %.6f,\n", seconds(children_usage.ru_utime));
+	fprintf(out, "  \"children_sys_cpu_seconds\": %.6f,\n", seconds(children_usage.ru_stime));
+	fprintf(out, "  \"peak_rss_mb\": %.2f,\n", self_usage.ru_maxrss / 1024.0);
+	fprintf(out, "  \"children_peak_rss_mb\": %.2f,\n", children_usage.ru_maxrss / 1024.0);
+	fprintf(out, "  \"bytes_read\": %lld,\n", bytes_read);
+	fprintf(out, "  \"bytes_written\": %lld,\n", bytes_written);
+
+	fprintf(out, "  \"counters\": {");
+	for (map<string, long long>::iterator it = counters.begin(); it != counters.end(); ++it)
+	{
+		fprintf(out, "%s\n    ", it == counters.begin() ? "" : ",");
+		print_json_string(out, it->first);
+		fprintf(out, ": %lld", it->second);
+	}
+	fprintf(out, "%s},\n", counters.empty() ? "" : "\n  ");
+
+	fprintf(out, "  \"gauges\": {");
+	for (map<string, double>::iterator it = gauges.begin(); it != gauges.end(); ++it)
+	{
+		fprintf(out, "%s\n    ", it == gauges.begin() ? "" : ",");
+		print_json_string(out, it->first);
+		fprintf(out, ": %.6f", it->second);
+	}
+	fprintf(out, "%s},\n", gauges.empty() ? "" : "\n  ");
+
+	fprintf(out, "  \"stages\": {");
+	for (map<string, MetricsStageStat>::iterator it = stages.begin(); it != stages.end(); ++it)
+	{
+		fprintf(out, "%s\n    ", it == stages.begin() ? "" : ",");
+		print_json_string(out, it->first);
+		fprintf(out, ": {\"calls\": %lld, \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}",
+				it->second.calls, it->second.wall_seconds, it->second.cpu_seconds);
+	}
+	fprintf(out, "%s}\n", stages.empty() ? "" : "\n  ");
+	fprintf(out, "}\n");
+	fclose(out);
+}
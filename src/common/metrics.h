@@ -0,0 +1,68 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/* process metrics: named counters, gauges and stage timers, dumped as a JSON file at exit.
+ *
+ * metrics_init() takes '--metrics-json <path>' (or '--metrics-json=<path>') out of argv before
+ * the program parses its own options. without it every call below returns at once.
+ *
+ * counters and stage timers are accumulated per thread and summed when the file is written, so
+ * worker threads may update them without locking. a stage records the number of calls, the wall
+ * time and the cpu time of the calling thread; stages entered by several threads report the sum.
+ * the lookups are by name, so hot loops should count locally and add once per chunk.
+ *
+ * besides the user metrics, the file holds the wall and cpu time of the process (and of the
+ * programs it ran through system()), the bytes read and written and the peak resident set size.
+ */
+
+#include <sys/time.h>
+#include <time.h>
+
+// returns the new argc; argv is compacted in place
+int metrics_init(int argc, char* argv[]);
+int metrics_init(int argc, const char* argv[]);
+
+bool metrics_enabled();
+
+// adds n to a counter
+void metrics_count(const char* name, long long n);
+
+// sets a gauge, or raises it to value if it is lower
+void metrics_gauge(const char* name, double value);
+void metrics_gauge_max(const char* name, double value);
+
+// adds one call of a stage
+void metrics_stage(const char* name, double wall_seconds, double cpu_seconds);
+
+// writes the metrics file now; it is also written at exit
+void metrics_write();
+
+class MetricsStage
+{
+public:
+	MetricsStage(const char* name) : name_(name), enabled_(metrics_enabled())
+	{
+		if (!enabled_) return;
+		gettimeofday(&wall_start_, NULL);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start_);
+	}
+	~MetricsStage()
+	{
+		if (!enabled_) return;
+		struct timeval wall_end;
+		struct timespec cpu_end;
+		gettimeofday(&wall_end, NULL);
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+		double wall = wall_end.tv_sec - wall_start_.tv_sec + 1.0 * (wall_end.tv_usec - wall_start_.tv_usec) / 1000000;
+		double cpu = cpu_end.tv_sec - cpu_start_.tv_sec + 1.0 * (cpu_end.tv_nsec - cpu_start_.tv_nsec) / 1000000000;
+		metrics_stage(name_, wall, cpu);
+	}
+
+private:
+	const char*		name_;
+	bool			enabled_;
+	struct timeval	wall_start_;
+	struct timespec	cpu_start_;
+};
+
+#endif // METRICS_H
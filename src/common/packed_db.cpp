@@ -5,6 +5,7 @@
 
 #include "defs.h"
 #include "fasta_reader.h"
+#include "block_fasta_reader.h"
 
 using namespace std;
 
@@ -191,17 +192,45 @@ void PackedDB::add_one_seq(const char* seq, const idx_t size)
 	}
 }
 
-void PackedDB::load_fasta_db(const char* dbname, const int max_seq_size)
+void PackedDB::add_one_encoded_seq(const char* codes, const idx_t size)
+{
+	SeqIndex si;
+	si.size = size;
+	si.offset = db_size;
+	seq_idx.push_back(si);
+	
+	if (db_size + si.size > max_db_size)
+	{
+		idx_t new_size = (max_db_size) ? max_db_size : 1024;
+		while (db_size + si.size > new_size) new_size *= 2;
+		u1_t* new_pac = NULL;
+		safe_calloc(new_pac, u1_t, (new_size + 3)/4);
+		memcpy(new_pac, pac, (db_size + 3)/4);
+		safe_free(pac);
+		pac = new_pac;
+		max_db_size = new_size;
+	}
+	
+	for (idx_t i = 0; i < si.size; ++i)
+	{
+		u1_t c = codes[i];
+		if (c > 3) c = rand() & 3;
+		set_char(db_size, c);
+		++db_size;
+	}
+}
+
+void PackedDB::load_fasta_db(const char* dbname, const int max_seq_size, const int num_threads)
 {
 	DynamicTimer dtimer(__func__);
-	FastaReader freader(dbname);
-	Sequence seq;
-	while (1)
+	BlockFastaReader freader(dbname, num_threads, true);
+	const char* header;
+	const char* codes;
+	idx_t header_size, size;
+	while (freader.next_record(header, header_size, codes, size))
 	{
-		idx_t size = freader.read_one_seq(seq);
 		if (size > max_seq_size) continue;
-		if (size == -1) break;
-		add_one_seq(seq);
+		add_one_encoded_seq(codes, size);
 	}
 }
 
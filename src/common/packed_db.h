@@ -3,6 +3,7 @@
 
 #include "defs.h"
 #include "sequence.h"
+#include "packed_seq.h"
 
 class PackedDB
 {
@@ -31,42 +32,14 @@ public:
 		const index_t offset = seq_idx[id].offset;
 		const index_t size = seq_idx[id].size;
 		r_assert(size == size_in_ovlp);
-		index_t idx = 0;
-		if (fwd)
-		{
-			for (index_t i = 0; i < size; ++i)
-			{
-				uint1 c = get_char(offset + i);
-				seq[idx++] = c;
-			}
-		}
-		else
-		{
-			for (index_t i = size - 1; i >= 0; --i)
-			{
-				uint1 c = get_char(offset + i);
-				c = 3 - c;
-				seq[idx++] = c;
-			}
-		}
+		if (fwd) unpack_bases(pac, offset, size, seq);
+		else unpack_bases_rc(pac, offset, size, seq);
 	}
 
     void get_sequence(const idx_t from, const idx_t to, const bool forward, char* seq) const
     {
-        idx_t idx = 0;
-        if (forward)
-            for(idx_t i = from; i < to; ++i)
-            {
-                u1_t c = get_char(pac, i);
-                seq[idx++] = c;
-            }
-        else
-            for(idx_t i = to - 1; i >= from; --i)
-            {
-                u1_t c = get_char(pac, i);
-                c = 3 - c;
-                seq[idx++] = c;
-            }
+        if (forward) unpack_bases(pac, from, to - from, seq);
+        else unpack_bases_rc(pac, from, to - from, seq);
     }
 
     void get_sequence(const idx_t rid, const bool forward, char* seq) const
@@ -122,6 +95,8 @@ public:
     idx_t offset_to_rid(const idx_t offset) const;
     void add_one_seq(const Sequence& seq);
 	void add_one_seq(const char* seq, const idx_t size);
+	// codes are get_dna_encode_table() values, ambiguous bases are replaced by random ones
+	void add_one_encoded_seq(const char* codes, const idx_t size);
     void destroy() { if (pac) safe_free(pac); db_size = max_db_size = 0; }
 	void clear() { seq_idx.clear(); db_size = 0; memset(pac, 0, (max_db_size + 3)/4); }
 
@@ -144,7 +119,7 @@ public:
     void load_packed_db(const char* path);
 	
 	static void pack_fasta_db(const char* fasta, const char* output_prefix, const idx_t min_size);
-	void load_fasta_db(const char* fasta, const int max_seq_size);
+	void load_fasta_db(const char* fasta, const int max_seq_size, const int num_threads = 1);
 
 private:
     u1_t*   pac;
@@ -0,0 +1,302 @@
+#include "packed_seq.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKED_SEQ_X86 1
+#endif
+
+static inline u1_t
+packed_base(const u1_t* pac, const idx_t idx)
+{
+	return (pac[idx >> 2] >> (((~idx) & 3) << 1)) & 3;
+}
+
+void
+unpack_bases_scalar(const u1_t* pac, const idx_t from, const idx_t size, char* dst)
+{
+	for (idx_t i = 0; i < size; ++i) dst[i] = packed_base(pac, from + i);
+}
+
+void
+unpack_bases_rc_scalar(const u1_t* pac, const idx_t from, const idx_t size, char* dst)
+{
+	for (idx_t i = 0; i < size; ++i) dst[i] = 3 - packed_base(pac, from + size - 1 - i);
+}
+
+void
+extract_packed_bases_scalar(const u1_t* pac, const idx_t from, const idx_t size, u1_t* dst)
+{
+	memset(dst, 0, (size + 3) / 4);
+	for (idx_t i = 0; i < size; ++i) dst[i >> 2] |= packed_base(pac, from + i) << (((~i) & 3) << 1);
+}
+
+#ifdef PACKED_SEQ_X86
+
+/* both kernels replicate every packed byte into 4 lanes with pshufb, then pick the 2 bits of
+ * lane j with a 16-bit shift and a per-lane mask. a 16-bit shift by at most 6 bits never moves
+ * bits of the high byte into bits 0-1 of the low byte, so the masks make it behave as a byte shift. */
+
+static const int8_t kFwdShuffle[4][16] = {
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 },
+	{ 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7 },
+	{ 8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11 },
+	{ 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15 }
+};
+
+static const int8_t kRevShuffle[4][16] = {
+	{ 15, 15, 15, 15, 14, 14, 14, 14, 13, 13, 13, 13, 12, 12, 12, 12 },
+	{ 11, 11, 11, 11, 10, 10, 10, 10, 9, 9, 9, 9, 8, 8, 8, 8 },
+	{ 7, 7, 7, 7, 6, 6, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4 },
+	{ 3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0 }
+};
+
+#define PACKED_SEQ_LANE_MASK(j) _mm_set1_epi32(3 << ((j) * 8))
+
+__attribute__((target("ssse3")))
+static inline __m128i
+fwd_bases_ssse3(__m128i x)
+{
+	return _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 6), PACKED_SEQ_LANE_MASK(0)),
+									 _mm_and_si128(_mm_srli_epi16(x, 4), PACKED_SEQ_LANE_MASK(1))),
+						_mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), PACKED_SEQ_LANE_MASK(2)),
+									 _mm_and_si128(x, PACKED_SEQ_LANE_MASK(3))));
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i
+rc_bases_ssse3(__m128i x)
+{
+	__m128i r = _mm_or_si128(_mm_or_si128(_mm_and_si128(x, PACKED_SEQ_LANE_MASK(0)),
+										  _mm_and_si128(_mm_srli_epi16(x, 2), PACKED_SEQ_LANE_MASK(1))),
+							 _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), PACKED_SEQ_LANE_MASK(2)),
+										  _mm_and_si128(_mm_srli_epi16(x, 6), PACKED_SEQ_LANE_MASK(3))));
+	return _mm_xor_si128(r, _mm_set1_epi8(3));
+}
+
+// dst[0, 4 * nbytes) = bases of the packed bytes [0, nbytes), returns the number of bytes consumed
+__attribute__((target("ssse3")))
+static idx_t
+unpack_bytes_ssse3(const u1_t* bytes, const idx_t nbytes, char* dst)
+{
+	idx_t i = 0;
+	for (; i + 16 <= nbytes; i += 16, dst += 64)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(bytes + i));
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128i x = _mm_shuffle_epi8(p, _mm_loadu_si128((const __m128i*)kFwdShuffle[k]));
+			_mm_storeu_si128((__m128i*)(dst + 16 * k), fwd_bases_ssse3(x));
+		}
+	}
+	return i;
+}
+
+// dst[0, 4 * nbytes) = reverse complement of the packed bytes (end - nbytes, end], returns the number of bytes consumed
+__attribute__((target("ssse3")))
+static idx_t
+unpack_bytes_rc_ssse3(const u1_t* end, const idx_t nbytes, char* dst)
+{
+	idx_t i = 0;
+	for (; i + 16 <= nbytes; i += 16, dst += 64)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(end - i - 16));
+		for (int k = 0; k < 4; ++k)
+		{
+			__m128i x = _mm_shuffle_epi8(p, _mm_loadu_si128((const __m128i*)kRevShuffle[k]));
+			_mm_storeu_si128((__m128i*)(dst + 16 * k), rc_bases_ssse3(x));
+		}
+	}
+	return i;
+}
+
+#define PACKED_SEQ_LANE_MASK256(j) _mm256_set1_epi32(3 << ((j) * 8))
+
+__attribute__((target("avx2")))
+static idx_t
+unpack_bytes_avx2(const u1_t* bytes, const idx_t nbytes, char* dst)
+{
+	const __m256i s0 = _mm256_loadu2_m128i((const __m128i*)kFwdShuffle[1], (const __m128i*)kFwdShuffle[0]);
+	const __m256i s1 = _mm256_loadu2_m128i((const __m128i*)kFwdShuffle[3], (const __m128i*)kFwdShuffle[2]);
+	idx_t i = 0;
+	for (; i + 16 <= nbytes; i += 16, dst += 64)
+	{
+		__m256i p = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(bytes + i)));
+		__m256i x = _mm256_shuffle_epi8(p, s0);
+		__m256i y = _mm256_shuffle_epi8(p, s1);
+		x = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 6), PACKED_SEQ_LANE_MASK256(0)),
+											_mm256_and_si256(_mm256_srli_epi16(x, 4), PACKED_SEQ_LANE_MASK256(1))),
+							_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 2), PACKED_SEQ_LANE_MASK256(2)),
+											_mm256_and_si256(x, PACKED_SEQ_LANE_MASK256(3))));
+		y = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(y, 6), PACKED_SEQ_LANE_MASK256(0)),
+											_mm256_and_si256(_mm256_srli_epi16(y, 4), PACKED_SEQ_LANE_MASK256(1))),
+							_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(y, 2), PACKED_SEQ_LANE_MASK256(2)),
+											_mm256_and_si256(y, PACKED_SEQ_LANE_MASK256(3))));
+		_mm256_storeu_si256((__m256i*)dst, x);
+		_mm256_storeu_si256((__m256i*)(dst + 32), y);
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static idx_t
+unpack_bytes_rc_avx2(const u1_t* end, const idx_t nbytes, char* dst)
+{
+	const __m256i s0 = _mm256_loadu2_m128i((const __m128i*)kRevShuffle[1], (const __m128i*)kRevShuffle[0]);
+	const __m256i s1 = _mm256_loadu2_m128i((const __m128i*)kRevShuffle[3], (const __m128i*)kRevShuffle[2]);
+	const __m256i three = _mm256_set1_epi8(3);
+	idx_t i = 0;
+	for (; i + 16 <= nbytes; i += 16, dst += 64)
+	{
+		__m256i p = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(end - i - 16)));
+		__m256i x = _mm256_shuffle_epi8(p, s0);
+		__m256i y = _mm256_shuffle_epi8(p, s1);
+		x = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(x, PACKED_SEQ_LANE_MASK256(0)),
+											_mm256_and_si256(_mm256_srli_epi16(x, 2), PACKED_SEQ_LANE_MASK256(1))),
+							_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(x, 4), PACKED_SEQ_LANE_MASK256(2)),
+											_mm256_and_si256(_mm256_srli_epi16(x, 6), PACKED_SEQ_LANE_MASK256(3))));
+		y = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(y, PACKED_SEQ_LANE_MASK256(0)),
+											_mm256_and_si256(_mm256_srli_epi16(y, 2), PACKED_SEQ_LANE_MASK256(1))),
+							_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(y, 4), PACKED_SEQ_LANE_MASK256(2)),
+											_mm256_and_si256(_mm256_srli_epi16(y, 6), PACKED_SEQ_LANE_MASK256(3))));
+		_mm256_storeu_si256((__m256i*)dst, _mm256_xor_si256(x, three));
+		_mm256_storeu_si256((__m256i*)(dst + 32), _mm256_xor_si256(y, three));
+	}
+	return i;
+}
+
+#endif // PACKED_SEQ_X86
+
+enum { kKernelScalar = 0, kKernelSSSE3, kKernelAVX2, kNumKernels };
+
+static const char* kKernelNames[kNumKernels] = { "scalar", "ssse3", "avx2" };
+
+static bool
+cpu_supports_kernel(const int kernel)
+{
+#ifdef PACKED_SEQ_X86
+	__builtin_cpu_init();
+	if (kernel == kKernelAVX2) return __builtin_cpu_supports("avx2");
+	if (kernel == kKernelSSSE3) return __builtin_cpu_supports("ssse3");
+#endif
+	return kernel == kKernelScalar;
+}
+
+static int
+detect_packed_seq_kernel()
+{
+	for (int kernel = kNumKernels - 1; kernel > kKernelScalar; --kernel)
+		if (cpu_supports_kernel(kernel)) return kernel;
+	return kKernelScalar;
+}
+
+static inline int&
+packed_seq_kernel()
+{
+	static int kernel = detect_packed_seq_kernel();
+	return kernel;
+}
+
+const char*
+packed_seq_kernel_name()
+{
+	return kKernelNames[packed_seq_kernel()];
+}
+
+bool
+select_packed_seq_kernel(const char* name)
+{
+	for (int kernel = 0; kernel < kNumKernels; ++kernel)
+		if (strcmp(name, kKernelNames[kernel]) == 0 && cpu_supports_kernel(kernel))
+		{
+			packed_seq_kernel() = kernel;
+			return true;
+		}
+	return false;
+}
+
+void
+unpack_bases(const u1_t* pac, const idx_t from, const idx_t size, char* dst)
+{
+	const int kernel = packed_seq_kernel();
+	idx_t i = from, to = from + size;
+	// leading bases up to a byte boundary
+	for (; (i & 3) && i < to; ++i) *dst++ = packed_base(pac, i);
+	if (kernel != kKernelScalar && to - i >= 64)
+	{
+#ifdef PACKED_SEQ_X86
+		const idx_t nbytes = (to - i) >> 2;
+		idx_t done = (kernel == kKernelAVX2) ? unpack_bytes_avx2(pac + (i >> 2), nbytes, dst)
+											 : unpack_bytes_ssse3(pac + (i >> 2), nbytes, dst);
+		i += done * 4;
+		dst += done * 4;
+#endif
+	}
+	for (; i < to; ++i) *dst++ = packed_base(pac, i);
+}
+
+void
+unpack_bases_rc(const u1_t* pac, const idx_t from, const idx_t size, char* dst)
+{
+	const int kernel = packed_seq_kernel();
+	idx_t i = from + size;
+	// trailing bases down to a byte boundary
+	for (; (i & 3) && i > from; --i) *dst++ = 3 - packed_base(pac, i - 1);
+	if (kernel != kKernelScalar && i - from >= 64)
+	{
+#ifdef PACKED_SEQ_X86
+		const idx_t nbytes = (i - from) >> 2;
+		idx_t done = (kernel == kKernelAVX2) ? unpack_bytes_rc_avx2(pac + (i >> 2), nbytes, dst)
+											 : unpack_bytes_rc_ssse3(pac + (i >> 2), nbytes, dst);
+		i -= done * 4;
+		dst += done * 4;
+#endif
+	}
+	for (; i > from; --i) *dst++ = 3 - packed_base(pac, i - 1);
+}
+
+static inline uint64_t
+load_be64(const u1_t* p)
+{
+	uint64_t w;
+	memcpy(&w, p, 8);
+	return __builtin_bswap64(w);
+}
+
+static inline void
+store_be64(u1_t* p, uint64_t w)
+{
+	w = __builtin_bswap64(w);
+	memcpy(p, &w, 8);
+}
+
+void
+extract_packed_bases(const u1_t* pac, const idx_t from, const idx_t size, u1_t* dst)
+{
+	const idx_t nbytes = (size + 3) / 4;
+	const u1_t* src = pac + (from >> 2);
+	const int shift = (from & 3) * 2;
+	// the source bytes that hold bases [from, from + size)
+	const idx_t src_bytes = ((from + size + 3) >> 2) - (from >> 2);
+	idx_t i = 0;
+	if (shift == 0)
+	{
+		memcpy(dst, src, nbytes);
+		i = nbytes;
+	}
+	else
+	{
+		// 8 output bytes per step from 9 source bytes, as long as all 9 are inside the sequence
+		for (; i + 9 <= src_bytes; i += 8)
+			store_be64(dst + i, (load_be64(src + i) << shift) | (src[i + 8] >> (8 - shift)));
+		for (; i < nbytes; ++i)
+		{
+			u1_t c = src[i] << shift;
+			if (i + 1 < src_bytes) c |= src[i + 1] >> (8 - shift);
+			dst[i] = c;
+		}
+	}
+	// clear the bits past the last base
+	if (size & 3) dst[nbytes - 1] &= (u1_t)(0xFF << ((4 - (size & 3)) * 2));
+}
@@ -0,0 +1,44 @@
+#ifndef PACKED_SEQ_H
+#define PACKED_SEQ_H
+
+#include "defs.h"
+
+/* kernels over 2-bit packed sequences (4 bases per byte, first base in the two most significant bits,
+ * the layout of PackedDB::set_char()/get_char()). bases are unpacked to codes 0..3, not to letters.
+ *
+ * the public entry points pick an AVX2 or SSSE3 implementation at run time and fall back to the
+ * *_scalar versions on other CPUs. the scalar versions are the reference the vectorized ones are checked against.
+ */
+
+// dst[i] = base (from + i), 0 <= i < size
+void
+unpack_bases(const u1_t* pac, const idx_t from, const idx_t size, char* dst);
+
+// dst[i] = complement of base (from + size - 1 - i), 0 <= i < size
+void
+unpack_bases_rc(const u1_t* pac, const idx_t from, const idx_t size, char* dst);
+
+// copy bases [from, from + size) into dst as a packed sequence starting at base 0.
+// dst must hold (size + 3) / 4 bytes; unused bits of the last byte are cleared.
+void
+extract_packed_bases(const u1_t* pac, const idx_t from, const idx_t size, u1_t* dst);
+
+void
+unpack_bases_scalar(const u1_t* pac, const idx_t from, const idx_t size, char* dst);
+
+void
+unpack_bases_rc_scalar(const u1_t* pac, const idx_t from, const idx_t size, char* dst);
+
+void
+extract_packed_bases_scalar(const u1_t* pac, const idx_t from, const idx_t size, u1_t* dst);
+
+// name of the implementation selected for this CPU: "avx2", "ssse3" or "scalar"
+const char*
+packed_seq_kernel_name();
+
+// selects the implementation named "avx2", "ssse3" or "scalar", false if this CPU does not support it.
+// meant for checking every implementation against the scalar one; the kernels must not be running.
+bool
+select_packed_seq_kernel(const char* name);
+
+#endif // PACKED_SEQ_H
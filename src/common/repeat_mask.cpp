@@ -0,0 +1,307 @@
+#include "repeat_mask.h"
+#include "lookup_table.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+static const int kSketchDepth = 4;
+static const uint64_t kSketchSeeds[kSketchDepth] = {
+	0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+};
+static const uint16_t kMaxCount = 65535;
+
+// saturating 16-bit counters: one row indexed by the k-mer itself, or a count-min sketch
+typedef struct
+{
+	bool 		exact;
+	int 		depth;
+	int 		width_bits;
+	uint16_t* 	cells; 		// depth rows of 1 << width_bits counters
+} kmer_counter_t;
+
+static inline uint16_t*
+get_counter(const kmer_counter_t* c, const int row, const uint32_t kmer)
+{
+	if (c->exact) return c->cells + kmer;
+	const uint64_t h = ((uint64_t)kmer + 1) * kSketchSeeds[row];
+	return c->cells + ((uint64_t)row << c->width_bits) + (h >> (64 - c->width_bits));
+}
+
+static inline void
+add_kmer(kmer_counter_t* c, const uint32_t kmer)
+{
+	for (int r = 0; r < c->depth; ++r)
+	{
+		uint16_t* p = get_counter(c, r, kmer);
+		uint16_t v = *p;
+		while (v != kMaxCount)
+		{
+			const uint16_t old = __sync_val_compare_and_swap(p, v, (uint16_t)(v + 1));
+			if (old == v) break;
+			v = old;
+		}
+	}
+}
+
+static inline int
+estimate_count(const kmer_counter_t* c, const uint32_t kmer)
+{
+	int n = kMaxCount;
+	for (int r = 0; r < c->depth; ++r) n = std::min(n, (int)*get_counter(c, r, kmer));
+	return n;
+}
+
+typedef struct
+{
+	kmer_counter_t* 		counter;
+	volume_t* 				v;
+	int 					kmer_size;
+	int 					cutoff;
+	int 					min_read;
+	int 					max_read;
+	idx_t 					num_bases;
+	std::vector<uint32_t> 	masked;
+} repeat_mask_thread_info;
+
+void*
+count_repeat_mask_kmers_func(void* arg)
+{
+	repeat_mask_thread_info* rmti = (repeat_mask_thread_info*)arg;
+	volume_t* v = rmti->v;
+	const int kmer_size = rmti->kmer_size;
+	for (int i = rmti->min_read; i < rmti->max_read; ++i)
+	{
+		const int read_start = v->offset_list->offset_list[i].offset;
+		const int read_size = v->offset_list->offset_list[i].size;
+		for (int j = 0; j + kmer_size <= read_size; ++j)
+			add_kmer(rmti->counter, repeat_mask_canonical_kmer(get_packed_kmer(v->data, read_start + j, kmer_size), kmer_size));
+		rmti->num_bases += read_size;
+	}
+	return NULL;
+}
+
+static void
+sort_unique_kmers(std::vector<uint32_t>& kmers)
+{
+	std::sort(kmers.begin(), kmers.end());
+	kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+}
+
+// the k-mers of the reads whose estimates pass the cutoff, a repeat occurs many times so the list is
+// compacted whenever it doubles
+void*
+collect_repeat_mask_kmers_func(void* arg)
+{
+	repeat_mask_thread_info* rmti = (repeat_mask_thread_info*)arg;
+	volume_t* v = rmti->v;
+	const int kmer_size = rmti->kmer_size;
+	size_t compact_size = 1 << 20;
+	for (int i = rmti->min_read; i < rmti->max_read; ++i)
+	{
+		const int read_start = v->offset_list->offset_list[i].offset;
+		const int read_size = v->offset_list->offset_list[i].size;
+		for (int j = 0; j + kmer_size <= read_size; ++j)
+		{
+			const uint32_t kmer = repeat_mask_canonical_kmer(get_packed_kmer(v->data, read_start + j, kmer_size), kmer_size);
+			if (estimate_count(rmti->counter, kmer) > rmti->cutoff) rmti->masked.push_back(kmer);
+		}
+		if (rmti->masked.size() >= compact_size)
+		{
+			sort_unique_kmers(rmti->masked);
+			compact_size = std::max(compact_size, 2 * rmti->masked.size());
+		}
+	}
+	return NULL;
+}
+
+// runs func over every volume, the reads of a volume are split into ranges of about the same number of bases
+static void
+run_repeat_mask_threads(void* (*func)(void*), volume_names_t* vn, repeat_mask_thread_info* rmtis, const int num_threads)
+{
+	for (int vid = 0; vid < vn->num_vols; ++vid)
+	{
+		volume_t* v = load_volume(get_vol_name(vn, vid));
+		const idx_t bases_per_thread = ((idx_t)v->curr + num_threads - 1) / num_threads;
+		int rid = 0;
+		for (int i = 0; i != num_threads; ++i)
+		{
+			rmtis[i].v = v;
+			rmtis[i].min_read = rid;
+			const idx_t last_base = (i == num_threads - 1) ? v->curr : bases_per_thread * (i + 1);
+			while (rid < v->num_reads && v->offset_list->offset_list[rid].offset < last_base) ++rid;
+			if (i == num_threads - 1) rid = v->num_reads;
+			rmtis[i].max_read = rid;
+		}
+		pthread_t tids[num_threads];
+		for (int i = 0; i != num_threads; ++i)
+		{
+			int err_code = pthread_create(tids + i, NULL, func, (void*)(rmtis + i));
+			if (err_code) ERROR("cannot create k-mer counting thread %d, return code is %d", i, err_code);
+		}
+		for (int i = 0; i != num_threads; ++i) pthread_join(tids[i], NULL);
+		delete_volume_t(v);
+	}
+}
+
+static uint64_t
+repeat_mask_checksum(const repeat_mask_t* mask)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	h = (h ^ (uint64_t)mask->kmer_size) * 0x100000001B3ULL;
+	for (idx_t i = 0; i < mask->num_kmers; ++i) h = (h ^ mask->kmers[i]) * 0x100000001B3ULL;
+	return h;
+}
+
+repeat_mask_t*
+build_repeat_mask(volume_names_t* vn, const int kmer_size, const double genome_size, const double coverage_factor,
+				  const int cutoff, const size_t sketch_bytes, int num_threads)
+{
+	DynamicTimer dtimer(__func__);
+	r_assert(kmer_size > 0 && kmer_size <= 16);
+	r_assert(cutoff > 0 || genome_size > 0);
+	if (num_threads < 1) num_threads = 1;
+
+	kmer_counter_t counter;
+	const uint64_t num_cells = sketch_bytes / sizeof(uint16_t);
+	if (((uint64_t)1 << (2 * kmer_size)) <= num_cells)
+	{
+		counter.exact = true;
+		counter.depth = 1;
+		counter.width_bits = 2 * kmer_size;
+	}
+	else
+	{
+		counter.exact = false;
+		counter.depth = kSketchDepth;
+		counter.width_bits = 0;
+		while (((uint64_t)kSketchDepth << (counter.width_bits + 1)) <= num_cells) ++counter.width_bits;
+		if (counter.width_bits < 16) ERROR("%llu bytes are too few for counting %d-mers", (unsigned long long)sketch_bytes, kmer_size);
+	}
+	const uint64_t counter_size = (uint64_t)counter.depth << counter.width_bits;
+	safe_calloc(counter.cells, uint16_t, counter_size);
+	if (counter.exact)
+	{
+		LOG(stderr, "counting %d-mers exactly in %.0f MB", kmer_size, counter_size * 2.0 / 1048576);
+	}
+	else
+	{
+		LOG(stderr, "counting %d-mers in a %d x %llu count-min sketch of %.0f MB", kmer_size, counter.depth,
+			(unsigned long long)1 << counter.width_bits, counter_size * 2.0 / 1048576);
+	}
+
+	std::vector<repeat_mask_thread_info> rmtis(num_threads);
+	for (int i = 0; i != num_threads; ++i)
+	{
+		rmtis[i].counter = &counter;
+		rmtis[i].kmer_size = kmer_size;
+		rmtis[i].num_bases = 0;
+	}
+	run_repeat_mask_threads(count_repeat_mask_kmers_func, vn, rmtis.data(), num_threads);
+	idx_t num_bases = 0;
+	for (int i = 0; i != num_threads; ++i) num_bases += rmtis[i].num_bases;
+
+	int min_count = cutoff;
+	if (min_count <= 0)
+	{
+		const double coverage = num_bases / genome_size;
+		min_count = std::max(1, (int)(coverage_factor * coverage + 0.5));
+		LOG(stderr, "%lld bases, coverage %.2f, k-mers seen more than %d times are masked", (long long)num_bases, coverage, min_count);
+	}
+	if (min_count >= kMaxCount)
+	{
+		LOG(stderr, "warning: counts saturate at %d, the cutoff %d is lowered to %d", (int)kMaxCount, min_count, (int)kMaxCount - 1);
+		min_count = kMaxCount - 1;
+	}
+
+	std::vector<uint32_t> masked;
+	if (counter.exact)
+	{
+		// only canonical k-mers have counts
+		for (uint64_t kmer = 0; kmer < counter_size; ++kmer)
+			if (counter.cells[kmer] > min_count) masked.push_back((uint32_t)kmer);
+	}
+	else
+	{
+		// the sketch cannot be enumerated, the reads are read again
+		for (int i = 0; i != num_threads; ++i) rmtis[i].cutoff = min_count;
+		run_repeat_mask_threads(collect_repeat_mask_kmers_func, vn, rmtis.data(), num_threads);
+		for (int i = 0; i != num_threads; ++i)
+		{
+			masked.insert(masked.end(), rmtis[i].masked.begin(), rmtis[i].masked.end());
+			std::vector<uint32_t>().swap(rmtis[i].masked);
+		}
+		sort_unique_kmers(masked);
+	}
+	safe_free(counter.cells);
+
+	repeat_mask_t* mask = (repeat_mask_t*)malloc(sizeof(repeat_mask_t));
+	mask->kmer_size = kmer_size;
+	mask->cutoff = min_count;
+	mask->num_bases = num_bases;
+	mask->num_kmers = masked.size();
+	safe_malloc(mask->kmers, uint32_t, std::max((size_t)1, masked.size()));
+	if (!masked.empty()) memcpy(mask->kmers, masked.data(), sizeof(uint32_t) * masked.size());
+	mask->checksum = repeat_mask_checksum(mask);
+	LOG(stderr, "%lld %d-mers are masked", (long long)mask->num_kmers, kmer_size);
+	return mask;
+}
+
+void
+dump_repeat_mask(const char* mask_name, repeat_mask_t* mask)
+{
+	repeat_mask_header_t hdr;
+	memset(&hdr, 0, sizeof(repeat_mask_header_t));
+	memcpy(hdr.magic, REPEAT_MASK_MAGIC, sizeof(hdr.magic));
+	hdr.version = REPEAT_MASK_VERSION;
+	hdr.kmer_size = mask->kmer_size;
+	hdr.cutoff = mask->cutoff;
+	hdr.num_bases = mask->num_bases;
+	hdr.num_kmers = mask->num_kmers;
+	hdr.checksum = mask->checksum;
+
+	char tmp_name[2048];
+	sprintf(tmp_name, "%s.tmp.%d", mask_name, (int)getpid());
+	FILE* out = fopen(tmp_name, "wb");
+	if (!out) ERROR("cannot open file \'%s\' for writing", tmp_name);
+	SAFE_WRITE(&hdr, repeat_mask_header_t, 1, out);
+	if (mask->num_kmers) SAFE_WRITE(mask->kmers, uint32_t, mask->num_kmers, out);
+	fclose(out);
+	if (rename(tmp_name, mask_name)) ERROR("cannot rename \'%s\' to \'%s\'", tmp_name, mask_name);
+}
+
+repeat_mask_t*
+load_repeat_mask(const char* mask_name)
+{
+	FILE* in = fopen(mask_name, "rb");
+	if (!in) ERROR("cannot open repeat mask \'%s\'", mask_name);
+	repeat_mask_header_t hdr;
+	if (fread(&hdr, sizeof(repeat_mask_header_t), 1, in) != 1
+		|| memcmp(hdr.magic, REPEAT_MASK_MAGIC, sizeof(hdr.magic)) != 0
+		|| hdr.kmer_size <= 0 || hdr.kmer_size > 16 || hdr.num_kmers < 0)
+		ERROR("\'%s\' is not a repeat mask", mask_name);
+	if (hdr.version != REPEAT_MASK_VERSION)
+		ERROR("repeat mask \'%s\' has version %d, but only version %d is supported; build it again", mask_name, hdr.version, REPEAT_MASK_VERSION);
+	repeat_mask_t* mask = (repeat_mask_t*)malloc(sizeof(repeat_mask_t));
+	mask->kmer_size = hdr.kmer_size;
+	mask->cutoff = hdr.cutoff;
+	mask->num_bases = hdr.num_bases;
+	mask->num_kmers = hdr.num_kmers;
+	safe_malloc(mask->kmers, uint32_t, std::max((int64_t)1, hdr.num_kmers));
+	if (hdr.num_kmers) SAFE_READ(mask->kmers, uint32_t, hdr.num_kmers, in);
+	fclose(in);
+	mask->checksum = repeat_mask_checksum(mask);
+	if (mask->checksum != hdr.checksum) ERROR("repeat mask \'%s\' is corrupted", mask_name);
+	return mask;
+}
+
+repeat_mask_t*
+destroy_repeat_mask(repeat_mask_t* mask)
+{
+	safe_free(mask->kmers);
+	safe_free(mask);
+	return NULL;
+}
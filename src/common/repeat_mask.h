@@ -0,0 +1,96 @@
+#ifndef REPEAT_MASK_H
+#define REPEAT_MASK_H
+
+#include "split_database.h"
+
+/* global repeat k-mer mask.
+ *
+ * the k-mer index of a volume drops the k-mers occurring more than REF_INDEX_MAX_KMER_OCC times in
+ * that volume only, so a repeat family is kept or dropped depending on how the reads fall into
+ * volumes. a repeat mask is built once from the k-mer counts of all volumes and lists the k-mers seen
+ * more than cutoff times, with cutoff set from the coverage (bases / genome size). the indices of
+ * mecat2pw and mecat2ref leave the masked k-mers out, so they seed nothing anywhere.
+ *
+ * k-mers are 2-bit packed with the codes of get_dna_encode_table(), the first base in the highest bits.
+ * reads come from both strands and the mappers seed both, so a k-mer and its reverse complement are
+ * counted together: the mask lists canonical k-mers (the smaller of the two) and masks both.
+ *
+ * counting is exact when the 4^kmer_size counters fit into the memory given for counting. otherwise a
+ * count-min sketch of 4 rows is used: its estimates are never below the true counts, so no repeat is
+ * missed, but k-mers sharing all their counters with repeats can be masked too.
+ */
+
+#define REPEAT_MASK_MAGIC 		"MECATMSK"
+#define REPEAT_MASK_VERSION 	2 		// 1 counted forward k-mers only
+
+typedef struct
+{
+	char 		magic[8];
+	int 		version;
+	int 		kmer_size;
+	int 		cutoff;
+	int 		reserved;
+	int64_t 	num_bases; 			// bases counted
+	int64_t 	num_kmers; 			// masked k-mers, they follow the header as sorted uint32_t
+	uint64_t 	checksum; 			// of kmer_size and the masked k-mers
+} repeat_mask_header_t;
+
+typedef struct
+{
+	int 		kmer_size;
+	int 		cutoff;
+	idx_t 		num_bases;
+	idx_t 		num_kmers;
+	uint32_t* 	kmers; 				// ascending
+	uint64_t 	checksum;
+} repeat_mask_t;
+
+/* counts the k-mers of all volumes in vn with num_threads threads and at most sketch_bytes of counters.
+ * k-mers seen more than cutoff times are masked; with cutoff <= 0 it is set to
+ * coverage_factor * (bases counted / genome_size). */
+repeat_mask_t*
+build_repeat_mask(volume_names_t* vn, const int kmer_size, const double genome_size, const double coverage_factor,
+				  const int cutoff, const size_t sketch_bytes, const int num_threads);
+
+void
+dump_repeat_mask(const char* mask_name, repeat_mask_t* mask);
+
+// exits with an error if the file is missing or corrupted
+repeat_mask_t*
+load_repeat_mask(const char* mask_name);
+
+repeat_mask_t*
+destroy_repeat_mask(repeat_mask_t* mask);
+
+// the complement of a code is 3 - code
+static inline uint32_t
+repeat_mask_reverse_complement(uint32_t kmer, const int kmer_size)
+{
+	uint32_t rc = 0;
+	for (int i = 0; i < kmer_size; ++i, kmer >>= 2) rc = (rc << 2) | (3 - (kmer & 3));
+	return rc;
+}
+
+static inline uint32_t
+repeat_mask_canonical_kmer(const uint32_t kmer, const int kmer_size)
+{
+	const uint32_t rc = repeat_mask_reverse_complement(kmer, kmer_size);
+	return kmer < rc ? kmer : rc;
+}
+
+// true if kmer or its reverse complement is masked
+static inline bool
+repeat_mask_contains(const repeat_mask_t* mask, uint32_t kmer)
+{
+	kmer = repeat_mask_canonical_kmer(kmer, mask->kmer_size);
+	idx_t left = 0, right = mask->num_kmers;
+	while (left < right)
+	{
+		idx_t mid = left + (right - left) / 2;
+		if (mask->kmers[mid] < kmer) left = mid + 1;
+		else right = mid;
+	}
+	return left < mask->num_kmers && mask->kmers[left] == kmer;
+}
+
+#endif // REPEAT_MASK_H
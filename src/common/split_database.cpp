@@ -1,12 +1,17 @@
 #include "split_database.h"
 
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <fstream>
 #include <string>
 
 #include "packed_db.h"
 #include "fasta_reader.h"
+#include "block_fasta_reader.h"
 
 #define MSS MAX_SEQ_SIZE
 
@@ -78,6 +83,10 @@ new_volume_t(int num_reads, int num_bases)
     idx_t vol_bytes = (num_bases + 3) / 4;
     safe_calloc(volume->data, uint8_t, vol_bytes);
     volume->offset_list = new_offset_list_t(num_reads);
+	volume->map_addr = NULL;
+	volume->map_size = 0;
+	volume->checksum = 0;
+	volume->has_checksum = 0;
     return volume;
 }
 
@@ -85,34 +94,43 @@ void
 clear_volume_t(volume_t* v)
 {
     assert(v);
+	assert(v->map_addr == NULL);
+	// only the bytes touched by add_one_seq() need to be reset; set_char() ORs the bases into them
+	idx_t used_bytes = ((idx_t)v->curr + 3) / 4;
     v->num_reads = 0;
     v->curr = 0;
     v->offset_list->curr = 0;
-	memset(v->data, 0, v->max_size / 4);
+	memset(v->data, 0, used_bytes);
 }
 
 volume_t*
 delete_volume_t(volume_t* v)
 {
+	if (v->map_addr)
+	{
+		munmap(v->map_addr, v->map_size);
+		free(v->offset_list);
+		free(v);
+		return NULL;
+	}
     v->offset_list = delete_offset_list_t(v->offset_list);
     free(v->data);
     free(v);
     return NULL;
 }
 
+// codes are get_dna_encode_table() values
 void
-add_one_seq(volume_t* volume, const char* s, const int size)
+add_one_encoded_seq(volume_t* volume, const char* codes, const int size)
 {
 	++volume->num_reads;
 	insert_one_offset(volume->offset_list, volume->curr, size);
-	const uint8_t* encode_table = get_dna_encode_table();
 	int i;
 	for (i = 0; i < size; ++i) 
 	{
 		uint8_t* d = volume->data;
 		int idx = volume->curr;
-		uint8_t c = s[i];
-		c = encode_table[c];
+		uint8_t c = codes[i];
 		PackedDB::set_char(d, idx, c);
 		++volume->curr;
 	}
@@ -124,36 +142,70 @@ extract_one_seq(volume_t* v, const int id, char* s)
 	assert(id < v->num_reads);
 	int offset = v->offset_list->offset_list[id].offset;
 	int size = v->offset_list->offset_list[id].size;
-	int i = 0;
-	for (i = 0; i < size; ++i)
-	{
-		int k = offset + i;
-		s[i] = PackedDB::get_char(v->data, k);
-	}
+	unpack_bases(v->data, offset, size, s);
+}
+
+void
+extract_one_seq_rc(volume_t* v, const int id, char* s)
+{
+	assert(id < v->num_reads);
+	int offset = v->offset_list->offset_list[id].offset;
+	int size = v->offset_list->offset_list[id].size;
+	unpack_bases_rc(v->data, offset, size, s);
+}
+
+static inline int64_t
+align_volume_offset(int64_t offset)
+{
+	return (offset + VOLUME_ALIGN - 1) / VOLUME_ALIGN * VOLUME_ALIGN;
 }
 
-void 
+static void
+write_volume_padding(FILE* out, int64_t from, int64_t to)
+{
+	static const char zeros[VOLUME_ALIGN] = { 0 };
+	r_assert(to - from >= 0 && to - from <= VOLUME_ALIGN);
+	if (to > from) SAFE_WRITE(zeros, char, to - from, out);
+}
+
+static uint64_t
+compute_volume_checksum(volume_t* v);
+
+uint64_t
 dump_volume(const char* vol_name, volume_t* v)
 {
+	volume_header_t hdr;
+	memset(&hdr, 0, sizeof(volume_header_t));
+	memcpy(hdr.magic, VOLUME_MAGIC, sizeof(hdr.magic));
+	hdr.version = VOLUME_VERSION;
+	hdr.num_reads = v->num_reads;
+	hdr.num_bases = v->curr;
+	hdr.start_read_id = v->start_read_id;
+	hdr.offset_list_offset = sizeof(volume_header_t);
+	int64_t offset_list_end = hdr.offset_list_offset + (int64_t)sizeof(offset_t) * v->num_reads;
+	hdr.data_offset = align_volume_offset(offset_list_end);
+	hdr.data_bytes = ((int64_t)v->curr + 3) / 4;
+	hdr.file_size = align_volume_offset(hdr.data_offset + hdr.data_bytes);
+	hdr.checksum = compute_volume_checksum(v);
+	
 	FILE* out = fopen(vol_name, "wb");
-	assert(out);
-	// 1) number of reads
-	SAFE_WRITE(&v->num_reads, int, 1, out);
-	// 2) number of bases
-	SAFE_WRITE(&v->curr, int, 1, out);
-	// 3) start read id
-	SAFE_WRITE(&v->start_read_id, int, 1, out);
-	// 4) offset list
+	if (!out) ERROR("failed to open file \'%s\' for writing.", vol_name);
+	// 1) header
+	SAFE_WRITE(&hdr, volume_header_t, 1, out);
+	// 2) offset list
 	assert(v->offset_list->curr == v->num_reads);
 	SAFE_WRITE(v->offset_list->offset_list, offset_t, v->num_reads, out);
-	// 5) pac
-	int vol_bytes = (v->curr + 3) / 4;
-	SAFE_WRITE(v->data, uint8_t, vol_bytes, out);
+	write_volume_padding(out, offset_list_end, hdr.data_offset);
+	// 3) pac
+	SAFE_WRITE(v->data, uint8_t, hdr.data_bytes, out);
+	write_volume_padding(out, hdr.data_offset + hdr.data_bytes, hdr.file_size);
 	fclose(out);
+	return hdr.checksum;
 }
 
-volume_t*
-load_volume(const char* vol_name)
+// volumes written before the versioned layout: num_reads, num_bases, start_read_id, offset list, pac
+static volume_t*
+load_legacy_volume(const char* vol_name)
 {
 	int num_reads, num_bases;
 	FILE* in = fopen(vol_name, "rb");
@@ -180,6 +232,54 @@ load_volume(const char* vol_name)
 	return v;
 }
 
+volume_t*
+load_volume(const char* vol_name)
+{
+	int fd = open(vol_name, O_RDONLY);
+	if (fd == -1) { LOG(stderr, "failed to open file \'%s\'.", vol_name); exit(1); }
+	struct stat sbuf;
+	if (fstat(fd, &sbuf) == -1) ERROR("failed to stat file \'%s\'.", vol_name);
+	
+	volume_header_t hdr;
+	if ((size_t)sbuf.st_size < sizeof(volume_header_t)
+		||
+		pread(fd, &hdr, sizeof(volume_header_t), 0) != (ssize_t)sizeof(volume_header_t)
+		||
+		memcmp(hdr.magic, VOLUME_MAGIC, sizeof(hdr.magic)) != 0)
+	{
+		close(fd);
+		return load_legacy_volume(vol_name);
+	}
+	if (hdr.version != VOLUME_VERSION && hdr.version != 1) 
+		ERROR("volume \'%s\' has version %d, but only versions 1 and %d are supported.", vol_name, hdr.version, VOLUME_VERSION);
+	if (hdr.file_size != (int64_t)sbuf.st_size
+		||
+		hdr.data_offset + hdr.data_bytes > hdr.file_size
+		||
+		hdr.offset_list_offset + (int64_t)sizeof(offset_t) * hdr.num_reads > hdr.data_offset)
+		ERROR("volume \'%s\' is truncated or corrupted.", vol_name);
+	
+	void* addr = mmap(NULL, hdr.file_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) ERROR("failed to mmap volume \'%s\'.", vol_name);
+	close(fd);
+	
+	volume_t* v = (volume_t*)malloc(sizeof(volume_t));
+	v->num_reads = hdr.num_reads;
+	v->curr = hdr.num_bases;
+	v->max_size = hdr.num_bases;
+	v->start_read_id = hdr.start_read_id;
+	v->data = (uint8_t*)addr + hdr.data_offset;
+	v->offset_list = (offset_list_t*)malloc(sizeof(offset_list_t));
+	v->offset_list->curr = hdr.num_reads;
+	v->offset_list->max_size = hdr.num_reads;
+	v->offset_list->offset_list = (offset_t*)((char*)addr + hdr.offset_list_offset);
+	v->map_addr = addr;
+	v->map_size = hdr.file_size;
+	v->checksum = hdr.checksum;
+	v->has_checksum = hdr.version >= 2;
+	return v;
+}
+
 void
 generate_vol_file_name(const char* wrk_dir, int vol, char* vol_file_name)
 {
@@ -199,6 +299,54 @@ generate_idx_file_name(const char* wrk_dir, char* idx_file_name)
 	strcat(idx_file_name, "fileindex.txt");
 }
 
+void
+generate_kidx_file_name(const char* vol_name, char* kidx_file_name)
+{
+	strcpy(kidx_file_name, vol_name);
+	strcat(kidx_file_name, ".kidx");
+}
+
+static inline uint64_t
+mix_checksum(uint64_t h, uint64_t w)
+{
+	h ^= w;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+static uint64_t
+compute_volume_checksum(volume_t* v)
+{
+	uint64_t h = 0xCBF29CE484222325ULL;
+	h = mix_checksum(h, ((uint64_t)(uint32_t)v->num_reads << 32) | (uint32_t)v->curr);
+	h = mix_checksum(h, (uint64_t)(uint32_t)v->start_read_id);
+	const offset_t* list = v->offset_list->offset_list;
+	for (int i = 0; i < v->num_reads; ++i)
+		h = mix_checksum(h, ((uint64_t)(uint32_t)list[i].offset << 32) | (uint32_t)list[i].size);
+	const idx_t vol_bytes = ((idx_t)v->curr + 3) / 4;
+	idx_t i = 0;
+	for (; i + 8 <= vol_bytes; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, v->data + i, 8);
+		h = mix_checksum(h, w);
+	}
+	for (; i < vol_bytes; ++i) h = mix_checksum(h, v->data[i]);
+	return h;
+}
+
+uint64_t
+volume_checksum(volume_t* v)
+{
+	if (!v->has_checksum)
+	{
+		v->checksum = compute_volume_checksum(v);
+		// a volume being filled may still change
+		v->has_checksum = (v->map_addr != NULL);
+	}
+	return v->checksum;
+}
+
 void
 extract_one_seq(ifstream& pac_file, PackedDB::SeqIndex& si, u1_t* buffer, char* seq)
 {
@@ -219,35 +367,38 @@ extract_one_seq(ifstream& pac_file, PackedDB::SeqIndex& si, u1_t* buffer, char*
 }
 
 int
-split_raw_dataset(const char* reads, const char* wrk_dir)
+split_raw_dataset(const char* reads, const char* wrk_dir, const int num_threads, const idx_t max_volume_bases,
+				  std::vector<uint64_t>* checksums)
 {
 	DynamicTimer dtimer(__func__);
-	volume_t* v = new_volume_t(0, 0);
+	r_assert(max_volume_bases > 0 && max_volume_bases <= MCS);
+	volume_t* v = new_volume_t(0, max_volume_bases + MSS);
 	int vol = 0;
 	int rid = 0;
 	char idx_file_name[1024], vol_file_name[1024];
 	generate_idx_file_name(wrk_dir, idx_file_name);
 	FILE* idx_file = fopen(idx_file_name, "w");
-	FastaReader fr(reads);
-	Sequence read;
+	BlockFastaReader fr(reads, num_threads, true);
+	const char* header;
+	const char* codes;
+	idx_t header_size, rsize;
 	idx_t num_reads = 0, num_nucls = 0;
-	while (1)
+	while (fr.next_record(header, header_size, codes, rsize))
 	{
-		idx_t rsize = fr.read_one_seq(read);
-		if (rsize == -1) break;
 		if (rsize > MAX_SEQ_SIZE) continue;
 		++num_reads;
 		num_nucls += rsize;
-		if (v->curr + rsize + 1 > MCS)
+		if (v->curr > 0 && v->curr + rsize + 1 > max_volume_bases)
 		{
 			v->start_read_id = rid;
 			rid += v->num_reads;
 			generate_vol_file_name(wrk_dir, vol++, vol_file_name);
 			fprintf(idx_file, "%s\n", vol_file_name);
-			dump_volume(vol_file_name, v);
+			const uint64_t checksum = dump_volume(vol_file_name, v);
+			if (checksums) checksums->push_back(checksum);
 			clear_volume_t(v);
 		}
-		add_one_seq(v, read.sequence().data(), rsize);
+		add_one_encoded_seq(v, codes, rsize);
 		++v->curr;
 	}
 	
@@ -257,7 +408,8 @@ split_raw_dataset(const char* reads, const char* wrk_dir)
 		rid += v->num_reads;
 		generate_vol_file_name(wrk_dir, vol++, vol_file_name);
 		fprintf(idx_file, "%s\n", vol_file_name);
-		dump_volume(vol_file_name, v);
+		const uint64_t checksum = dump_volume(vol_file_name, v);
+		if (checksums) checksums->push_back(checksum);
 		clear_volume_t(v);
 	}
 	fclose(idx_file);
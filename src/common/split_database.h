@@ -3,6 +3,8 @@
 
 #include "../common/defs.h"
 
+#include <vector>
+
 #define MCS (2140000000L) // max chunk size
 //#define MCS 50000000L
 
@@ -21,8 +23,38 @@ typedef struct {
 	int start_read_id;
     uint8_t* data;
     offset_list_t* offset_list;
+	// non-NULL when data and offset_list->offset_list point into a read-only mapping of the volume file
+	void* map_addr;
+	size_t map_size;
+	// volume_checksum() of a loaded volume as recorded in its header, valid if has_checksum is set
+	uint64_t checksum;
+	int has_checksum;
 } volume_t;
 
+/* on-disk volume layout (version 2):
+ * [volume_header_t][offset_t x num_reads][pad to VOLUME_ALIGN][2-bit packed bases][pad to VOLUME_ALIGN]
+ * all sections start at offsets recorded in the header so that the file can be mmapped as is
+ * and shared between processes through the page cache. the header carries the volume_checksum() of
+ * the volume so that checking a volume against its .kidx does not read it in full; version 1 headers
+ * have no checksum, it is computed when needed.
+ */
+#define VOLUME_MAGIC 		"MECATVOL"
+#define VOLUME_VERSION 		2
+#define VOLUME_ALIGN 		4096
+
+typedef struct {
+	char magic[8];
+	int version;
+	int num_reads;
+	int num_bases;
+	int start_read_id;
+	int64_t offset_list_offset;
+	int64_t data_offset;
+	int64_t data_bytes;
+	int64_t file_size;
+	uint64_t checksum; 		// version 2
+} volume_header_t;
+
 volume_t*
 new_volume_t(int num_reads, int num_bases);
 
@@ -57,7 +89,8 @@ load_volume_names(const char* idx_file_name, int num_vols);
 void
 print_volume_names(volume_names_t* vn);
 
-void 
+// returns the volume_checksum() recorded in the header
+uint64_t
 dump_volume(const char* vol_name, volume_t* v);
 
 int
@@ -72,13 +105,29 @@ generate_vol_file_name(const char* wrk_dir, int vol, char* vol_file_name);
 void
 generate_idx_file_name(const char* wrk_dir, char* idx_file_name);
 
+// name of the persistent k-mer index of a volume: "<vol_name>.kidx"
+void
+generate_kidx_file_name(const char* vol_name, char* kidx_file_name);
+
+// 64-bit checksum of the reads and packed bases of a volume; read from the header of a loaded volume
+uint64_t
+volume_checksum(volume_t* v);
+
 void
 split_dataset(const char* reads, const char* wrk_dir, int* num_vols);
 
 void
 extract_one_seq(volume_t* v, const int id, char* s);
 
+// reverse complement of read id
+void
+extract_one_seq_rc(volume_t* v, const int id, char* s);
+
+// reads may be gzip compressed; num_threads threads parse the input.
+// a volume holds at most max_volume_bases (<= MCS) bases. the volume_checksum() of every volume is
+// appended to checksums if given.
 int
-split_raw_dataset(const char* reads, const char* wrk_dir);
+split_raw_dataset(const char* reads, const char* wrk_dir, const int num_threads, const idx_t max_volume_bases = MCS,
+				  std::vector<uint64_t>* checksums = NULL);
 
 #endif // SPLIT_DATABASE_H
@@ -0,0 +1,38 @@
+#include "workspace.h"
+#include "metrics.h"
+
+static volatile i8_t workspace_total_bytes = 0;
+static volatile i8_t workspace_peak_bytes = 0;
+
+void
+workspace_account(const i8_t delta_bytes)
+{
+	const i8_t total = __sync_add_and_fetch(&workspace_total_bytes, delta_bytes);
+	i8_t peak = workspace_peak_bytes;
+	while (total > peak)
+	{
+		const i8_t prev = __sync_val_compare_and_swap(&workspace_peak_bytes, peak, total);
+		if (prev == peak) break;
+		peak = prev;
+	}
+}
+
+size_t
+workspace_bytes()
+{
+	return workspace_total_bytes;
+}
+
+size_t
+workspace_high_water()
+{
+	return workspace_peak_bytes;
+}
+
+void
+report_workspace_usage()
+{
+	LOG(stderr, "alignment workspace high-water mark: %.2f MB (%.2f MB in use)",
+		workspace_high_water() / 1048576.0, workspace_bytes() / 1048576.0);
+	metrics_gauge_max("workspace_high_water_bytes", workspace_high_water());
+}
@@ -0,0 +1,75 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "defs.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+/* growable scratch buffers for the gapped aligners.
+ *
+ * a workspace starts empty. when a call needs more room than it holds, it is grown geometrically
+ * (at least doubled) and then reused by later calls, so every thread only pays for the largest
+ * problem it has seen instead of a worst case reservation.
+ * the bytes held by all workspaces of the process are accounted; workspace_high_water() is their peak.
+ */
+
+void
+workspace_account(const i8_t delta_bytes);
+
+size_t
+workspace_bytes();
+
+size_t
+workspace_high_water();
+
+void
+report_workspace_usage();
+
+template <class T>
+class Workspace
+{
+public:
+	Workspace() : data_(NULL), size_(0) {}
+	~Workspace() { release(); }
+
+	// room for at least n elements; the first size() elements are kept
+	T* reserve(const idx_t n)
+	{
+		if (n > size_) x_grow(n);
+		return data_;
+	}
+
+	T* data() const { return data_; }
+	idx_t size() const { return size_; }
+	size_t bytes() const { return sizeof(T) * size_; }
+
+	void release()
+	{
+		if (!data_) return;
+		workspace_account(-(i8_t)bytes());
+		safe_free(data_);
+		data_ = NULL;
+		size_ = 0;
+	}
+
+private:
+	void x_grow(const idx_t n)
+	{
+		const idx_t new_size = std::max(std::max(n, 2 * size_), (idx_t)kMinSize);
+		safe_realloc(data_, T, new_size);
+		workspace_account(sizeof(T) * (new_size - size_));
+		size_ = new_size;
+	}
+
+	Workspace(const Workspace&);
+	Workspace& operator=(const Workspace&);
+
+private:
+	static const int kMinSize = 1024;
+
+	T*		data_;
+	idx_t	size_;
+};
+
+#endif // WORKSPACE_H
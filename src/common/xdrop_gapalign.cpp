@@ -16,7 +16,7 @@ xdrop_align(const char* A,
             int gap_open,
             int gap_extend,
             int x_dropoff,
-            u8* state_array,
+            Workspace<u8>& state_ws,
             BlastGapDP* score_array,
             u8** edit_script,
             int* edit_start_offset,
@@ -46,6 +46,9 @@ xdrop_align(const char* A,
     int states_used = 0;
 
     if (x_dropoff < gap_open_extend) x_dropoff = gap_open_extend;
+    // the traceback adds at most one operation per step
+    edit_block->reserve(M + N + 1);
+    u8* state_array = state_ws.reserve(4 * (N + 2));
     edit_script[0] = state_array;
     edit_start_offset[0] = 0;
     edit_script_row = state_array;
@@ -68,6 +71,12 @@ xdrop_align(const char* A,
 
     for (a_index = 1; a_index <= M; ++a_index) {
         const u8 AC = extract_char<u8>(A, a_index - 1, forward);
+        // a row writes at most N + 1 cells; rows already filled move with the buffer
+        if (states_used + N + 3 > state_ws.size()) {
+            const uintptr_t old_states = (uintptr_t)state_array;
+            state_array = state_ws.reserve(states_used + N + 3);
+            for (i = 0; i < a_index; ++i) edit_script[i] = state_array + ((uintptr_t)edit_script[i] - old_states);
+        }
         edit_script[a_index] = state_array + states_used + 1;
         edit_start_offset[a_index] = first_b_index;
         
@@ -269,7 +278,7 @@ align_ex(const char* query,
 		 char* tbf,
 		 XdropAlignParameters* xap,
 		 int matrix[][4], 
-		 u8* state_array, 
+		 Workspace<u8>& state_array, 
 		 BlastGapDP* score_array,
 		 u8** edit_script, 
 		 int* edit_start_offset, 
@@ -395,6 +404,9 @@ XdropAligner::go(const char* query, const int query_start, const int query_size,
 			 right_taln,
 			 true);
 	
+	const idx_t max_aln_size = left_qaln.size() + right_qaln.size() + 1;
+	qaln = qaln_store.reserve(max_aln_size);
+	taln = taln_store.reserve(max_aln_size);
 	int aln_idx = 0;
 	int i, j, k, n;
 	const char* dt = "ACGT-";
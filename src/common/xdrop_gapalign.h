@@ -3,6 +3,7 @@
 
 #include "defs.h"
 #include "gapalign.h"
+#include "workspace.h"
 //#include "smart_assert.h"
 
 #include <string>
@@ -48,19 +49,19 @@ struct GapPrelimEditScript
 struct GapPrelimEditBlock
 {
     GapPrelimEditScript* edit_ops;
-    int num_ops_allocated;
+    Workspace<GapPrelimEditScript> ops;
     int num_ops;
     EGapAlignOpType last_op;
 
     GapPrelimEditBlock() {
-        num_ops_allocated = MAX_SEQ_SIZE;
-        snew(edit_ops, GapPrelimEditScript, num_ops_allocated);
+        edit_ops = NULL;
         num_ops = 0;
         last_op = eGapAlignInvalid;
     }
 
-    ~GapPrelimEditBlock() {
-        sfree(edit_ops);
+    // room for n more edit operations, add() does not check
+    void reserve(const int n) {
+        edit_ops = ops.reserve(num_ops + n);
     }
 
     void clear() {
@@ -91,7 +92,6 @@ struct XdropAlignParameters
 	int x_dropoff;
 	
 	int block_size;
-	int state_array_size;
 	int score_array_size;
 	int edit_script_row_size;
 	
@@ -108,7 +108,6 @@ struct XdropAlignParameters
 			block_size = 500;
 		}
 		
-		state_array_size = 5000000;
 		score_array_size = 4096;
 		edit_script_row_size = 4096;
 	}
@@ -119,26 +118,22 @@ class XdropAligner : public GapAligner
 public:
 	XdropAligner(const int large_block = 0) {
 			param.init(large_block);
-			snew(state_array, u8, param.state_array_size);
 			snew(score_array, BlastGapDP, param.score_array_size);
 			snew(edit_script, u8*, param.edit_script_row_size);
 			snew(edit_start_offset, int, param.edit_script_row_size);
 			build_score_matrix();
 			snew(qbuf, char, param.block_size * 2);
 			snew(tbuf, char, param.block_size * 2);
-			snew(qaln, char, MAX_SEQ_SIZE);
-			snew(taln, char, MAX_SEQ_SIZE);
+			qaln = taln = NULL;
+			aln_size = 0;
 		}
 		
 	virtual ~XdropAligner() {
-		sfree(state_array);
 		sfree(score_array);
 		sfree(edit_script);
 		sfree(edit_start_offset);
 		sfree(qbuf);
 		sfree(tbuf);
-		sfree(qaln);
-		sfree(taln);
 	}
 	
 	void build_score_matrix() {
@@ -190,7 +185,7 @@ public:
 		
 public:
 	XdropAlignParameters	param;
-	u8*						state_array;
+	Workspace<u8>			state_array;
 	BlastGapDP*				score_array;
 	u8**					edit_script;
 	int*					edit_start_offset;
@@ -200,6 +195,8 @@ public:
 	std::string				left_taln;
 	std::string				right_qaln;
 	std::string				right_taln;
+	Workspace<char>			qaln_store;
+	Workspace<char>			taln_store;
 	char*					qaln;
 	char*					taln;
 	int						aln_size;
@@ -1,4 +1,4 @@
-#include "../common/fasta_reader.h"
+#include "../common/block_fasta_reader.h"
 
 #include <fstream>
 #include <iostream>
@@ -8,6 +8,8 @@ using namespace std;
 
 typedef index_t idx;
 
+static const int kNumParseThreads = 4;
+
 void print_usage(const char* prog)
 {
 	const char sep = ' ';
@@ -59,7 +61,7 @@ int main(int argc, char* argv[])
 	const idx min_size = parse_int(argv[3]);
 	const idx max_size = parse_int(argv[4]);
 	
-	FastaReader reader(input);
+	BlockFastaReader reader(input, kNumParseThreads);
 	Sequence read;
 	ofstream out;
 	open_fstream(out, output, ios::out);
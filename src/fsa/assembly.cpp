@@ -8,6 +8,7 @@
 #include "graph.hpp"
 #include "logger.hpp"
 #include "simple_align.hpp"
+#include "../common/metrics.h"
 
 Assembly::Assembly() : ol_store_(read_store_){
 }
@@ -25,26 +26,44 @@ void Assembly::Run() {
 
     LOG(INFO)("Start");
     LOG(INFO)("Load Overlaps");
-    LoadOverlaps(options_.overlap_file);
+    {
+        MetricsStage stage("load_overlaps");
+        LoadOverlaps(options_.overlap_file);
+    }
 
     LOG(INFO)("Create StringGraph");
-    CreateStringGraph();
+    {
+        MetricsStage stage("string_graph");
+        CreateStringGraph();
+    }
 
     LOG(INFO)("Create PathGraph");
-    CreatePathGraph();
+    {
+        MetricsStage stage("path_graph");
+        CreatePathGraph();
+    }
 
     LOG(INFO)("Save Graph");
-    SaveGraph();
+    {
+        MetricsStage stage("save_graph");
+        SaveGraph();
+    }
 
     LOG(INFO)("Start output fasta");
     read_store_.SaveIdToName(OutputPath("id2name.txt"));
     if (!options_.read_file.empty()) {
 
         LOG(INFO)("Load fasta");
-        LoadReads(options_.read_file);
+        {
+            MetricsStage stage("load_reads");
+            LoadReads(options_.read_file);
+        }
 
         LOG(INFO)("Save Contigs");
-        SaveContigs();
+        {
+            MetricsStage stage("save_contigs");
+            SaveContigs();
+        }
     }
 
     LOG(INFO)("End");
@@ -80,6 +99,7 @@ void Assembly::LoadOverlaps(const std::string &fname) {
 
     ol_store_.Load(fname, options_.overlap_file_type);
     LOG(INFO)("End Load Overlaps: size = %d", ol_store_.Size());
+    metrics_count("overlaps_loaded", ol_store_.Size());
     if (ol_store_.Size() == 0) LOG(FATAL)("No overlaps were loaded");
 }
 
@@ -8,7 +8,8 @@ endif
 TARGET   := libfsa.a
 SOURCES  := argument_parser.cpp getopt.c logger.cpp overlap.cpp read_store.cpp sequence.cpp\
              utility.cpp fasta_reader.cpp fastq_reader.cpp overlap_store.cpp \
-   			 ./simple_align.cpp overlap_filter.cpp overlap_stat.cpp
+   			 ./simple_align.cpp overlap_filter.cpp overlap_stat.cpp \
+             ../common/metrics.cpp
 
 TGT_CXXFLAGS := -U_GLIBCXX_PARALLEL -std=c++11 -Wall -O3 -D_FILE_OFFSET_BITS=64 
 SRC_INCDIRS  := . 
@@ -1,7 +1,9 @@
 #include "assembly.hpp"
+#include "../common/metrics.h"
 
 int main(int argc, char *argv[])
 {
+    argc = metrics_init(argc, argv);
     Assembly ass;
     if (ass.ParseArgument(argc, argv)) {
         ass.Run();
@@ -1,7 +1,9 @@
 #include "contig_bridge.hpp"
+#include "../common/metrics.h"
 
 
 int main(int argc, const char* argv[]) {
+    argc = metrics_init(argc, argv);
     ContigBridge cb;
 
     if (cb.ParseArgument(argc, argv)) {
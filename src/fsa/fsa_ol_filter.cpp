@@ -1,7 +1,9 @@
 #include "overlap_filter.hpp"
+#include "../common/metrics.h"
 
 
 int main(int argc, char *argv[]) {
+    argc = metrics_init(argc, argv);
     OverlapFilter of;
 
     if (of.ParseArgument(argc, argv)) {
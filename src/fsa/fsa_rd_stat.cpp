@@ -1,6 +1,8 @@
 #include "read_stat.hpp"
+#include "../common/metrics.h"
 
 int main(int argc, char *argv[]) {
+    argc = metrics_init(argc, argv);
     ReadStat rs;
 
     if (rs.ParseArgument(argc, argv)) {
@@ -11,6 +11,7 @@
 #include <regex>
 
 #include "utility.hpp"
+#include "../common/metrics.h"
 
 OverlapFilter::OverlapFilter() {
    
@@ -72,38 +73,48 @@ void OverlapFilter::Run() {
     }
 
     LOG(INFO)("Load overlap file");
-    LoadOverlaps(ifname_);
+    {
+        MetricsStage stage("load_overlaps");
+        LoadOverlaps(ifname_);
+    }
+    metrics_count("overlaps_loaded", ol_store_.Size());
     
     //LOG(INFO)("Check simple constraints");
     //FilterSimpleMt();
 
-    if (genome_size_ > 0 && coverage_ > 0) {
-        LOG(INFO)("Keep longest %dX", coverage_);
-        FilterLongest();
-    }
+    {
+        MetricsStage stage("filter");
+        if (genome_size_ > 0 && coverage_ > 0) {
+            LOG(INFO)("Keep longest %dX", coverage_);
+            FilterLongest();
+        }
 
 
-    LOG(INFO)("Group overlaps and remove duplicated");
-    GroupAndFilterDuplicateMt();
+        LOG(INFO)("Group overlaps and remove duplicated");
+        GroupAndFilterDuplicateMt();
 
-    LOG(INFO)("Check Local");
-    FilterLocalMt();
+        LOG(INFO)("Check Local");
+        FilterLocalMt();
 
-    LOG(INFO)("Check Coverage");
-    FilterCoverageMt();
+        LOG(INFO)("Check Coverage");
+        FilterCoverageMt();
 
-    LOG(INFO)("Check Support");
-    FilterLackOfSupportMt();
+        LOG(INFO)("Check Support");
+        FilterLackOfSupportMt();
 
-    LOG(INFO)("Remove contained reads");
-    FilterContainedMt();
+        LOG(INFO)("Remove contained reads");
+        FilterContainedMt();
 
-    LOG(INFO)("Select BestN overlaps");
-    FilterBestNMt();
+        LOG(INFO)("Select BestN overlaps");
+        FilterBestNMt();
+    }
     
 
     LOG(INFO)("Save Overlaps: %s", ofname_.c_str());
-    SaveOverlaps(ofname_);
+    {
+        MetricsStage stage("save_overlaps");
+        SaveOverlaps(ofname_);
+    }
 
     LOG(INFO)("Dump");
     Dump();
@@ -1,4 +1,5 @@
 #include "read_stat.hpp"
+#include "../common/metrics.h"
 
 #include <numeric> 
 #include <algorithm>
@@ -31,7 +32,10 @@ void ReadStat::Run() {
 
     LOG(INFO)("Load read file %s", ifname_.c_str());
     ReadStore rs;
-    rs.Load(ifname_, "", 4);
+    {
+        MetricsStage stage("load_reads");
+        rs.Load(ifname_, "", 4);
+    }
 
     if (action_ == "N50") {
         StatN50(rs);
@@ -1,6 +1,7 @@
 #ifndef FSA_READ_STORE_HPP
 #define FSA_READ_STORE_HPP
 
+#include <array>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -1,6 +1,8 @@
 #ifndef FSA_ALIGN_SIMPLE_ALIGN_HPP
 #define FSA_ALIGN_SIMPLE_ALIGN_HPP
 
+#include <array>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
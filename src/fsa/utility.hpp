@@ -2,6 +2,7 @@
 #define FSA_UTILITY_HPP
 
 #include <array>
+#include <string>
 #include <vector>
 #include <thread>
 #include <unordered_set>
@@ -8,15 +8,21 @@ endif
 TARGET       := libmecat.a
 
 SOURCES      := common/alignment.cpp \
+		common/block_fasta_reader.cpp \
 		common/buffer_line_iterator.cpp \
 		common/defs.cpp \
 		common/diff_gapalign.cpp \
 		common/fasta_reader.cpp \
 		common/gapalign.cpp \
 		common/lookup_table.cpp \
+		common/mem_budget.cpp \
+		common/metrics.cpp \
 		common/packed_db.cpp \
+		common/packed_seq.cpp \
+		common/repeat_mask.cpp \
 		common/sequence.cpp \
 		common/split_database.cpp \
+		common/workspace.cpp \
 		common/xdrop_gapalign.cpp
 
 SRC_INCDIRS  := common \
@@ -25,6 +31,11 @@ SUBMAKEFILES := mecat2pw/pw.mk \
 		mecat2ref/mecat2ref.mk \
 		mecat2cns/mecat2cns.mk \
 		filter_reads/filter_reads.mk \
+		mecat2conv/mecat2conv.mk \
+		bench/unpack_bench.mk \
+		bench/align_bench.mk \
+		bench/seed_recall.mk \
+		bench/volume_check.mk \
 		./mecat2asm/v2pm/v2_make_volumes.mk \
 		./mecat2asm/v2pm/v2_asmpm.mk \
 		./mecat2asm/v2trim/pm4.mk \
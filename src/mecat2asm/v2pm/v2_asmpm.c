@@ -5,6 +5,7 @@
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "../v2trim/m4_record.h"
 
@@ -47,6 +48,7 @@ typedef struct {
 typedef struct {
     int d,k,pre_k,x1,y1,x2,y2;
 } d_path_data2;
+#define DPATH_SIZE (600*700*2)
 typedef struct {
     int x,y;
 } path_point;
@@ -75,6 +77,7 @@ int runnumber=0,runthreadnum=0, readcount,terminalnum;
 int *countin,**databaseindex,*allloc,sumcount;
 int seed_len,*llocation,seqcount,curreadcount;
 int bin_out = 0;
+int64_t mem_budget = 0;
 char *STRMEM;
 readmemory *indexread;
 ReadFasta *readinfo;
@@ -571,7 +574,7 @@ void pairwise_mapping(int threadint){
    index_score=(short int *)malloc(j*sizeof(short int));
    database=(struct Back_List *)malloc(j*sizeof(struct Back_List));
    for(i=0,temp_spr=database;i<j;temp_spr++,i++){temp_spr->score=0;temp_spr->index=-1;}
-   d_path=(d_path_data2*)malloc(600*700*2*sizeof(d_path_data2));
+   d_path=(d_path_data2*)malloc(DPATH_SIZE*sizeof(d_path_data2));
    resultstore=(output_store *)malloc(1*sizeof(output_store));
    resultstore1=(output_store *)malloc(1*sizeof(output_store));
    //t1=(float)clock();
@@ -1000,6 +1003,73 @@ int load_fastq(FILE *fq,int startno){
         else return(0);
 }
 
+/* "512M", "64G" or a number of bytes, K, M, G and T are powers of 1024; -1 if malformed */
+int64_t parse_mem_size(const char *s)
+{
+    char *end;
+    double x, unit = 1;
+    if (!s || !*s) return -1;
+    x = strtod(s, &end);
+    if (end == s || x < 0) return -1;
+    switch (*end) {
+        case 'k': case 'K': unit = 1024.0; ++end; break;
+        case 'm': case 'M': unit = 1024.0 * 1024; ++end; break;
+        case 'g': case 'G': unit = 1024.0 * 1024 * 1024; ++end; break;
+        case 't': case 'T': unit = 1024.0 * 1024 * 1024 * 1024; ++end; break;
+    }
+    if (unit > 1 && (*end == 'b' || *end == 'B')) ++end;
+    if (*end) return -1;
+    return (int64_t)(x * unit);
+}
+
+/* the memory held once for a volume of splitsize bytes (its bases are fewer) with readnum reads:
+ * countin and databaseindex, allloc (at most one k-mer per base), STRMEM, savework, readinfo,
+ * indexread and llocation */
+int64_t volume_memory(int64_t splitsize, int readnum)
+{
+    int64_t indexcount = (int64_t)1 << (2 * seed_len);
+    return indexcount * (int64_t)(sizeof(int) + sizeof(int *))
+        + splitsize * (int64_t)(sizeof(int) + sizeof(char))
+        + (int64_t)(MAXSTR + RM) + (int64_t)(SVM + 2) * sizeof(ReadFasta)
+        + (int64_t)(readnum + 1) * (sizeof(readmemory) + sizeof(int));
+}
+
+/* the memory every thread of pairwise_mapping() allocates for a volume of splitsize bytes:
+ * database, index_list and index_score (one entry per ZV bases), d_path and the two output stores */
+int64_t thread_memory(int64_t splitsize)
+{
+    return (splitsize / ZV + 5) * (int64_t)(sizeof(struct Back_List) + sizeof(int) + sizeof(short int))
+        + (int64_t)DPATH_SIZE * sizeof(d_path_data2) + 2 * (int64_t)sizeof(output_store);
+}
+
+/* --mem-budget: the memory of the index of a volume and of the reads it is mapped against is fixed,
+ * every thread adds its own. returns the number of threads <= threadnum that fit into the budget,
+ * the plan is printed. */
+int plan_memory(int64_t splitsize, int readnum, int threadnum)
+{
+    int64_t fixed = volume_memory(splitsize, readnum), per_thread = thread_memory(splitsize), lo, hi, mid;
+    int n;
+    double mb = 1024.0 * 1024.0;
+    n = fixed + per_thread > mem_budget ? 0 : (int)((mem_budget - fixed) / per_thread < threadnum ? (mem_budget - fixed) / per_thread : threadnum);
+    printf("memory plan of v2asmpm, a volume of %lld bytes, %d thread(s):\n", (long long)splitsize, n ? n : 1);
+    printf("  k-mer index and reads     %10.1fM\n", fixed / mb);
+    printf("  per thread                %10.1fM x %d\n", per_thread / mb, n ? n : 1);
+    printf("  total                     %10.1fM of %.1fM\n", (fixed + per_thread * (n ? n : 1)) / mb, mem_budget / mb);
+    if (n == 0) {
+        /* the largest volume one thread fits with, its reads in proportion to its size */
+        lo = 0; hi = splitsize;
+        while (lo < hi) {
+            mid = lo + (hi - lo + 1) / 2;
+            if (volume_memory(mid, (int)(readnum * (double)mid / splitsize)) + thread_memory(mid) <= mem_budget) lo = mid;
+            else hi = mid - 1;
+        }
+        if (lo > 0) printf("the memory budget does not hold one thread, volumes of at most %lld bases would fit (see v2mkvol)\n", (long long)lo);
+        else printf("the memory budget does not hold the k-mer index of %d-mers\n", seed_len);
+    }
+    else if (n < threadnum) printf("the memory budget holds %d of the %d threads\n", n, threadnum);
+    return n;
+}
+
 int param_read(int argc1, char *argv1[], char *pathway, int *threadnum, int *starts, int *ende,int *isP, int *isT, int *isS,  int *isE)
 {
     int i, j, k;
@@ -1044,6 +1114,11 @@ int param_read(int argc1, char *argv1[], char *pathway, int *threadnum, int *sta
 		bin_out = 1;
 		break;
 	    }	
+	    case '-':
+	    {
+		if (strncmp(argv1[i], "--mem-budget=", 13) != 0 || (mem_budget = parse_mem_size(argv1[i] + 13)) <= 0) return (-1);
+		break;
+	    }
             }
         }
         else return (-1);
@@ -1080,6 +1155,10 @@ int main(int argc,char *argv[]){
         FILE *fastq,*fp;
 
 	flag = param_read(argc, argv, workpath,&threadnum, &startid,&endid, &isP, &isT, &isS, &isE);
+	if (flag < 0) {
+		fprintf(stderr, "usage: %s -P<working dir> -T<threads> -S<first volume> -E<volumes> [-B] [--mem-budget=<size>]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
 	printf("finished reading params\n");
 	filecount=endid;
 
@@ -1104,6 +1183,10 @@ int main(int argc,char *argv[]){
        fileidconvert(tempstr1,startid); 
        sprintf(tempstr,"%s/%s.fasta",workpath,tempstr1);
 	   splitsize=filesize(tempstr);
+	   if (mem_budget > 0) {
+	       threadnum = plan_memory(splitsize, curreadcount, threadnum);
+	       if (threadnum == 0) return EXIT_FAILURE;
+	   }
 	   indexread=(readmemory *)malloc(sizeof(readmemory)*(curreadcount+1));
 	   llocation=(int *)malloc(sizeof(int)*(curreadcount+1));
 	   STRMEM=(char *)malloc(sizeof(char)*splitsize);   
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "../klib/kstring.h"
 
@@ -9,7 +10,8 @@ print_usage(const char* prog)
 {
 	FILE* out = stderr;
 	fprintf(out, "USAGE:\n");
-	fprintf(out, "%s wrk_dir fasta_input\n", prog);
+	fprintf(out, "%s wrk_dir fasta_input [max_volume_bases]\n", prog);
+	fprintf(out, "max_volume_bases defaults to 2000000000, v2asmpm --mem-budget prints the size a budget holds\n");
 }
 
 static FILE* open_file(const char* path, const char* mode)
@@ -34,7 +36,7 @@ static void output_kstring(FILE* out, kstring_t* s)
 
 int main(int argc, char* argv[])
 {
-	if (argc != 3) {
+	if (argc != 3 && argc != 4) {
 		print_usage(argv[0]);
 		return 1;
 	}
@@ -48,7 +50,11 @@ int main(int argc, char* argv[])
 	new_kstring(hdr);
 	new_kstring(seq);
 	char path[2048];
-	const int vs = 2000000000;
+	const int vs = argc == 4 ? atoi(argv[3]) : 2000000000;
+	if (vs <= 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
 
 	FILE* in = open_file(input, "r");
 	sprintf(path, "%s/%06d.fasta", wrk_dir, volume);
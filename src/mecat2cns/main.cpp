@@ -1,8 +1,10 @@
 #include "reads_correction_can.h"
 #include "reads_correction_m4.h"
+#include "../common/metrics.h"
 
 int main(int argc, char** argv)
 {
+	argc = metrics_init(argc, argv);
     ReadsCorrectionOptions rco;
 	int r = parse_arguments(argc, argv, rco);
 	///print_options(rco);
@@ -1,6 +1,8 @@
 #include "options.h"
+#include "../common/mem_budget.h"
 
 #include <cstring>
+#include <getopt.h>
 #include <unistd.h>
 
 #include <iostream>
@@ -113,6 +115,11 @@ print_usage(const char* prog)
 	
 	cerr << "-" << usage_n << "\t\t" << "print usage info." << "\n";
 	
+	cerr << "--mem-budget <Size>\t" << "memory of the run, e.g. 32G: the number of threads is reduced so that the reads," << "\n"
+		 << "\t\t" << "the largest partition and the buffers of every thread fit, the plan is printed at startup" << "\n";
+	
+	cerr << "--metrics-json <String>\t" << "write timings, counters and resource usage of the run to this file" << "\n";
+	
 	cerr << "\nDefault Options:\n";
 	print_pacbio_default_options();
 }
@@ -134,6 +141,7 @@ init_consensus_options(int tech)
 		t.min_size              = min_size_pacbio;
 		t.print_usage_info      = print_usage_pacbio;
 		t.num_partition_files 	= num_partition_files;
+		t.mem_budget            = 0;
 		t.tech                  = tech_pacbio;
 	} else {
 		t.input_type            = input_type_nanopore;
@@ -148,6 +156,7 @@ init_consensus_options(int tech)
 		t.min_size              = min_size_nanopore;
 		t.print_usage_info      = print_usage_nanopore;
 		t.num_partition_files	= num_partition_files;
+		t.mem_budget            = 0;
 		t.tech                  = tech_nanopore;
 	}
     return t;
@@ -193,7 +202,12 @@ parse_arguments(int argc, char* argv[], ConsensusOptions& t)
 	int opt_char;
     char err_char;
     opterr = 0;
-	while((opt_char = getopt(argc, argv, "i:t:p:r:a:c:l:k:h")) != -1) {
+	enum { kOptMemBudget = 256 };
+	static struct option long_options[] = {
+		{ "mem-budget", required_argument, NULL, kOptMemBudget },
+		{ NULL, 0, NULL, 0 }
+	};
+	while((opt_char = getopt_long(argc, argv, "i:t:p:r:a:c:l:k:h", long_options, NULL)) != -1) {
 		switch (opt_char) {
 			case input_type_n:
 				if (optarg[0] == '0')
@@ -231,6 +245,13 @@ parse_arguments(int argc, char* argv[], ConsensusOptions& t)
 			case num_partition_files_n:
 				t.num_partition_files = atoi(optarg);
 				break;
+			case kOptMemBudget:
+				t.mem_budget = parse_mem_size(optarg);
+				if (t.mem_budget <= 0) {
+					fprintf(stderr, "invalid argument to option '--mem-budget': %s\n", optarg);
+					return 1;
+				}
+				break;
 			case '?':
                 err_char = (char)optopt;
 				fprintf(stderr, "unrecognised option '%c'\n", err_char);
@@ -294,5 +315,6 @@ print_options(ConsensusOptions& t)
 	cout << "cov:\t" << t.min_cov << "\n";
 	cout << "min size:\t" << t.min_size << "\n";
 	cout << "partition files:\t" << t.num_partition_files << "\n";
+	if (t.mem_budget) cout << "memory budget:\t" << t.mem_budget << "\n";
 	///cout << "tech:\t" << t.tech << "\n";
 }
@@ -21,6 +21,7 @@ struct ConsensusOptions
     bool        print_usage_info;
     int         tech;
 	int			num_partition_files;
+	int64_t		mem_budget;		// bytes, 0 = no budget
 };
 
 void
@@ -43,14 +43,13 @@ subject_is_contained(const M4Record& m4, const double min_cov_ratio)
 void
 get_qualified_m4record_counts(const char* m4_file_name, const double min_cov_ratio, index_t& num_qualified_records, index_t& num_reads)
 {
-    std::ifstream in;
-    open_fstream(in, m4_file_name, std::ios::in);
+    RecordStreamReader in(m4_file_name, kRecordTypeM4Record);
     num_qualified_records = 0;
     num_reads = -1;
     index_t num_records = 0;
     M4Record m4;
 	m4qext(m4) = m4sext(m4) = INVALID_IDX;
-    while (in >> m4)
+    while (in.read(m4))
     {
 		if (m4qext(m4) == INVALID_IDX || m4sext(m4) == INVALID_IDX)
 		{
@@ -61,7 +60,6 @@ get_qualified_m4record_counts(const char* m4_file_name, const double min_cov_rat
         num_reads = std::max(num_reads, m4qid(m4));
         num_reads = std::max(num_reads, m4sid(m4));
     }
-    close_fstream(in);
 
 	LOG(stderr, "there are %d overlaps, %d are qualified.", (int)num_records, (int)num_qualified_records);
     ++num_reads;
@@ -75,11 +73,10 @@ get_repeat_reads(const char* m4_file_name, const double min_cov_ratio, const ind
 	for (int i = 0; i < MaxContained; ++i) cnt_table[i] = i + 1;
 	cnt_table[MaxContained] = MaxContained;
 	vector<char> cnts(num_reads, 0);
-	std::ifstream in;
-    open_fstream(in, m4_file_name, std::ios::in);
+	RecordStreamReader in(m4_file_name, kRecordTypeM4Record);
 	M4Record m4;
 	m4qext(m4) = m4sext(m4) = INVALID_IDX;
-    while (in >> m4)
+    while (in.read(m4))
     {
 		if (query_is_contained(m4, min_cov_ratio))
 		{
@@ -92,7 +89,6 @@ get_repeat_reads(const char* m4_file_name, const double min_cov_ratio, const ind
 			cnts[sid] = cnt_table[cnts[sid]];
 		}
     }
-    close_fstream(in);
 	
 	for(index_t i = 0; i < num_reads; ++i)
 		if (cnts[i] >= MaxContained) 
@@ -124,16 +120,14 @@ generate_partition_file_name(const char* m4_file_name, const index_t part, std::
 idx_t
 get_num_reads(const char* candidates_file)
 {
-	ifstream in;
-	open_fstream(in, candidates_file, ios::in);
+	RecordStreamReader in(candidates_file, kRecordTypeExtensionCandidate);
 	ExtensionCandidate ec;
 	int max_id = -1;
-	while (in >> ec)
+	while (in.read(ec))
 	{
 		max_id = std::max(ec.qid, max_id);
 		max_id = std::max(ec.sid, max_id);
 	}
-	close_fstream(in);
 	return max_id + 1;
 }
 
@@ -196,11 +190,10 @@ partition_candidates(const char* input, const idx_t batch_size, const int min_re
 		cout << "Lid = " << Lid
 			 << ", Rid = " << Rid
 			 << "\n";
-		ifstream in;
-		open_fstream(in, input, ios::in);
+		RecordStreamReader in(input, kRecordTypeExtensionCandidate);
 		prw.OpenFiles(sfid, efid, input, generate_partition_file_name);
 		
-		while (in >> ec) {
+		while (in.read(ec)) {
 			if (ec.qsize < min_read_size || ec.ssize < min_read_size) continue;
 			if (ec.qid >= Lid && ec.qid < Rid) {
 				normalise_candidate(ec, nec, false);
@@ -370,11 +363,10 @@ partition_m4records(const char* m4_file_name,
         const int nf = efid - sfid;
         const index_t L = batch_size * sfid;
         const index_t R = batch_size * efid;
-        std::ifstream in;
-        open_fstream(in, m4_file_name, std::ios::in);
+        RecordStreamReader in(m4_file_name, kRecordTypeM4Record);
 		prw.OpenFiles(sfid, efid, m4_file_name, generate_partition_file_name);
 
-        while (in >> m4)
+        while (in.read(m4))
         {
 			if (m4qsize(m4) < min_read_size || m4ssize(m4) < min_read_size) continue;
             if (!check_m4record_mapping_range(m4, min_cov_ratio)) continue;
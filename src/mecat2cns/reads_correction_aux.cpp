@@ -1,4 +1,7 @@
 #include "reads_correction_aux.h"
+#include "../common/mem_budget.h"
+
+#include <sys/stat.h>
 
 void normalize_gaps(const char* qstr, const char* tstr, const index_t aln_size, std::string& qnorm, std::string& tnorm, const bool push)
 {
@@ -113,3 +116,51 @@ build_cns_thrd_data_can(ExtensionCandidate* ec_list,
 		i = j;
 	}
 }
+
+static void
+add_mem_item(std::vector<mem_item_t>& items, const char* name, const idx_t bytes, const int per_thread)
+{
+	mem_item_t item;
+	item.name = name;
+	item.bytes = bytes;
+	item.per_thread = per_thread;
+	items.push_back(item);
+}
+
+void
+plan_consensus_memory(ReadsCorrectionOptions& rco, const PackedDB& reads, const std::vector<PartitionFileInfo>& partitions)
+{
+	idx_t max_read_size = 0;
+	for (idx_t i = 0; i < reads.num_seqs(); ++i) max_read_size = std::max(max_read_size, reads.seq_size(i));
+	const idx_t mean_read_size = reads.num_seqs() ? reads.size() / reads.num_seqs() : 0;
+	idx_t max_partition_bytes = 0;
+	for (size_t i = 0; i < partitions.size(); ++i)
+	{
+		struct stat st;
+		if (stat(partitions[i].file_name.c_str(), &st) == 0) max_partition_bytes = std::max(max_partition_bytes, (idx_t)st.st_size);
+	}
+	
+	// the per-thread buffers are sized for MAX_SEQ_SIZE, but only the part the longest read needs is written.
+	// an alignment is taken to be at most twice as long as the read.
+	const idx_t max_aln_size = std::min(2 * max_read_size, (idx_t)MAX_SEQ_SIZE);
+	std::vector<mem_item_t> items;
+	add_mem_item(items, "reads", reads.size() / 4 + reads.num_seqs() * (idx_t)sizeof(PackedDB::SeqIndex), 0);
+	add_mem_item(items, "largest partition", max_partition_bytes, 0);
+	add_mem_item(items, "alignment rows", 2 * MAX_CNS_OVLPS * max_aln_size, 1);
+	add_mem_item(items, "consensus table", (sizeof(CnsTableItem) + sizeof(uint1)) * max_read_size, 1);
+	// the reads and alignments of the banded aligners, the m5 record and the normalized alignment strings
+	add_mem_item(items, "alignment buffers", 16 * max_aln_size, 1);
+	add_mem_item(items, "corrected reads", MAX_CNS_RESULTS * (mean_read_size + 64), 1);
+	
+	const int num_threads = mem_plan_max_threads(items.data(), items.size(), rco.mem_budget, rco.num_threads);
+	char title[256];
+	sprintf(title, "mecat2cns, reads of at most %lld bases", (long long)max_read_size);
+	print_mem_plan(title, items.data(), items.size(), rco.mem_budget, num_threads ? num_threads : 1);
+	if (num_threads == 0 && mem_plan_bytes(items.data(), items.size(), 0) > rco.mem_budget)
+		ERROR("the memory budget of %lld bytes does not hold the reads and the largest partition, try smaller partitions (-p)", (long long)rco.mem_budget);
+	if (num_threads == 0)
+		ERROR("the memory budget of %lld bytes does not hold one thread", (long long)rco.mem_budget);
+	if (num_threads < rco.num_threads)
+		LOG(stderr, "the memory budget holds %d of the %d threads", num_threads, rco.num_threads);
+	rco.num_threads = num_threads;
+}
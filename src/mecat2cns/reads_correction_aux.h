@@ -7,6 +7,7 @@
 #include "dw.h"
 #include "../common/packed_db.h"
 #include "options.h"
+#include "overlaps_partition.h"
 
 struct CnsTableItem
 {
@@ -174,4 +175,8 @@ build_cns_thrd_data_can(ExtensionCandidate* ec_list,
 						std::ostream* out,
 					    ConsensusThreadData** ppctd);
 
+// reduces rco.num_threads so that correcting the partitions fits into rco.mem_budget and prints the plan
+void
+plan_consensus_memory(ReadsCorrectionOptions& rco, const PackedDB& reads, const std::vector<PartitionFileInfo>& partitions);
+
 #endif // _READS_CORRECTION_AUX_H
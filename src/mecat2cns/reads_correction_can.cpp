@@ -4,6 +4,7 @@
 
 #include "MECAT_AlnGraphBoost.H"
 #include "mecat_correction.h"
+#include "../common/metrics.h"
 #include "overlaps_partition.h"
 #include "overlaps_store.h"
 
@@ -23,6 +24,8 @@ reads_correction_func_can(void* arg)
     ConsensusThreadData& cns_data = *static_cast<ConsensusThreadData*>(arg);
 	ExtensionCandidate* candidates = cns_data.candidates;
 	const index_t num_candidates = cns_data.num_candidates;
+    MetricsStage stage("consensus");
+    long long num_attempted = 0, num_corrected = 0, num_corrected_bases = 0;
     index_t i = 0, j;
     while (i < num_candidates)
     {
@@ -36,6 +39,7 @@ reads_correction_func_can(void* arg)
 		} else {
 			ns_meap_cns::consensus_one_read_can_nanopore(&cns_data, sid, i, j);
 		}
+		++num_attempted;
 		if (cns_data.cns_results.size() >= MAX_CNS_RESULTS)
 		{
 			pthread_mutex_lock(&cns_data.out_lock);
@@ -44,12 +48,17 @@ reads_correction_func_can(void* arg)
 				(*cns_data.out) << ">" << iter->id << "_" << iter->range[0] << "_" << iter->range[1] << "_" << iter->seq.size() << "\n";
 				std::string& seq = iter->seq;
 				(*cns_data.out) << seq << "\n";
+				++num_corrected;
+				num_corrected_bases += seq.size();
 			}
 			cns_data.cns_results.clear();
 			pthread_mutex_unlock(&cns_data.out_lock);
 		}
         i = j;
     }
+    metrics_count("reads_attempted", num_attempted);
+    metrics_count("corrected_reads", num_corrected);
+    metrics_count("corrected_bases", num_corrected_bases);
     return NULL;
 }
 
@@ -62,7 +71,12 @@ consensus_one_partition_can(const char* m4_file_name,
 						std::ostream& out)
 {
 	idx_t num_ec;
-	ExtensionCandidate* ec_list = load_partition_data<ExtensionCandidate>(m4_file_name, num_ec);
+	ExtensionCandidate* ec_list;
+	{
+		MetricsStage stage("load_partition");
+		ec_list = load_partition_data<ExtensionCandidate>(m4_file_name, num_ec);
+	}
+	metrics_count("candidates_loaded", num_ec);
     ConsensusThreadData* pctds[rco.num_threads];
 	build_cns_thrd_data_can(ec_list, num_ec, min_read_id, max_read_id, &rco, &reads, &out, pctds);
     pthread_t thread_ids[rco.num_threads];
@@ -78,6 +92,8 @@ consensus_one_partition_can(const char* m4_file_name,
 			out << ">" << iter->id << "_" << iter->range[0] << "_" << iter->range[1] << "_" << iter->seq.size() << "\n";
 			std::string& seq = iter->seq;
 			out << seq << "\n";
+			metrics_count("corrected_reads", 1);
+			metrics_count("corrected_bases", seq.size());
 		}
 	}
 
@@ -101,13 +117,21 @@ partition_can(const char* m4_path, const int batch_size, const int min_size, con
 
 int reads_correction_can(ReadsCorrectionOptions& rco)
 {
-	partition_can(rco.m4, rco.batch_size, rco.min_size, rco.num_partition_files);
+	{
+		MetricsStage stage("partition");
+		partition_can(rco.m4, rco.batch_size, rco.min_size, rco.num_partition_files);
+	}
 	std::string idx_file_name;
 	generate_partition_index_file_name(rco.m4, idx_file_name);
 	std::vector<PartitionFileInfo> partition_file_vec;
 	load_partition_files_info(idx_file_name.c_str(), partition_file_vec);
 	PackedDB reads;
-	reads.load_fasta_db(rco.reads, MAX_SEQ_SIZE);
+	{
+		MetricsStage stage("load_reads");
+		reads.load_fasta_db(rco.reads, MAX_SEQ_SIZE, rco.num_threads);
+	}
+	metrics_gauge("reads", reads.num_seqs());
+	if (rco.mem_budget) plan_consensus_memory(rco, reads, partition_file_vec);
 	std::ofstream out;
 	open_fstream(out, rco.corrected_reads, std::ios::out);
 	char process_info[2048];
@@ -118,6 +142,7 @@ int reads_correction_can(ReadsCorrectionOptions& rco)
 		sprintf(process_info, "processing %s", iter->file_name.c_str());
 		DynamicTimer dtimer(process_info);
 		consensus_one_partition_can(iter->file_name.c_str(), iter->min_seq_id, iter->max_seq_id, rco, reads, out);
+		metrics_count("partitions_processed", 1);
 		FILE* job_finished_out = fopen(job_finished, "w");
 		fclose(job_finished_out);
 	}
@@ -0,0 +1,176 @@
+#include "../common/alignment.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h>
+
+/* converts ExtensionCandidate and M4Record files between the text format and the binary record stream.
+ *
+ * the direction is taken from the input: a binary record stream is written as text, anything else
+ * is parsed as text of the record type given by -t and written as a binary record stream.
+ */
+
+using namespace std;
+
+static const int kBlockSize = 100000;
+
+void print_usage(const char* prog)
+{
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "%s [-t can/m4] input output", prog);
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "-t <string>\trecord type of a text input, can = candidates (mecat2pw -j 0), m4 = overlaps (mecat2pw -j 1)\n\t\tdefault: can\n");
+}
+
+// the text layout of mecat2pw, where qext and sext are only printed when they are valid
+static void
+output_m4record(ostream& out, const M4Record& m4, const bool with_ext)
+{
+	if (with_ext)
+	{
+		out << m4;
+		return;
+	}
+	const char sep = '\t';
+	out << m4qid(m4)	<< sep
+		<< m4sid(m4)	<< sep
+		<< m4ident(m4)	<< sep
+		<< m4vscore(m4)	<< sep
+		<< m4qdir(m4)	<< sep
+		<< m4qoff(m4)	<< sep
+		<< m4qend(m4)	<< sep
+		<< m4qsize(m4)	<< sep
+		<< m4sdir(m4)	<< sep
+		<< m4soff(m4)	<< sep
+		<< m4send(m4)	<< sep
+		<< m4ssize(m4)	<< "\n";
+}
+
+static idx_t
+binary_to_text(const char* input, const int record_type, ofstream& out)
+{
+	RecordStreamReader in(input, record_type);
+	idx_t n = 0;
+	if (record_type == kRecordTypeExtensionCandidate)
+	{
+		ExtensionCandidate ec;
+		for (; in.read(ec); ++n) out << ec;
+	}
+	else
+	{
+		M4Record m4;
+		for (; in.read(m4); ++n) output_m4record(out, m4, in.flags() & RECORD_STREAM_FLAG_M4_EXT);
+	}
+	return n;
+}
+
+static int
+stream_flags(const ExtensionCandidate&)
+{
+	return 0;
+}
+
+// an m4 file either has qext/sext on every line or on none of them
+static int
+stream_flags(const M4Record& m4)
+{
+	return (m4qext(m4) != INVALID_IDX && m4sext(m4) != INVALID_IDX) ? RECORD_STREAM_FLAG_M4_EXT : 0;
+}
+
+template <class T>
+static idx_t
+text_to_binary(const char* input, const int record_type, T& r, ofstream& out)
+{
+	RecordStreamReader in(input, record_type);
+	vector<T> list;
+	vector<char> buf;
+	idx_t n = 0;
+	bool header_written = false;
+	while (1)
+	{
+		const bool more = (bool)in.read(r);
+		if (more) list.push_back(r);
+		if (!header_written && (!more || list.size() == 1))
+		{
+			write_record_stream_header(out, record_type, list.empty() ? 0 : stream_flags(list[0]));
+			header_written = true;
+		}
+		if (list.size() == (size_t)kBlockSize || (!more && !list.empty()))
+		{
+			buf.clear();
+			encode_record_block(list.data(), list.size(), buf);
+			out.write(buf.data(), buf.size());
+			n += list.size();
+			list.clear();
+		}
+		if (!more) break;
+	}
+	return n;
+}
+
+int main(int argc, char* argv[])
+{
+	int record_type = kRecordTypeExtensionCandidate;
+	int opt_char;
+	opterr = 0;
+	while ((opt_char = getopt(argc, argv, "t:")) != -1)
+	{
+		switch (opt_char)
+		{
+			case 't':
+				if (strcmp(optarg, "can") == 0) record_type = kRecordTypeExtensionCandidate;
+				else if (strcmp(optarg, "m4") == 0) record_type = kRecordTypeM4Record;
+				else
+				{
+					LOG(stderr, "argument to option \'-t\' must be either \'can\' or \'m4\'");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				LOG(stderr, "unrecognised option \'%c\'", (char)optopt);
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 2)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+	const char* input = argv[optind];
+	const char* output = argv[optind + 1];
+
+	DynamicTimer dtimer(__func__);
+	ofstream out;
+	open_fstream(out, output, ios::out | ios::binary);
+	idx_t n;
+	const int binary_type = get_record_stream_type(input);
+	if (binary_type)
+	{
+		LOG(stderr, "converting binary %s records to text", binary_type == kRecordTypeM4Record ? "m4" : "candidate");
+		n = binary_to_text(input, binary_type, out);
+	}
+	else if (record_type == kRecordTypeExtensionCandidate)
+	{
+		LOG(stderr, "converting text candidate records to binary");
+		ExtensionCandidate ec;
+		n = text_to_binary(input, record_type, ec, out);
+	}
+	else
+	{
+		LOG(stderr, "converting text m4 records to binary");
+		M4Record m4;
+		m4qext(m4) = m4sext(m4) = INVALID_IDX;
+		n = text_to_binary(input, record_type, m4, out);
+	}
+	close_fstream(out);
+	LOG(stderr, "%lld records converted", (long long)n);
+	return 0;
+}
@@ -1,13 +1,22 @@
 #include "pw_options.h"
 #include "pw_impl.h"
+#include "pw_shard.h"
 #include "../common/split_database.h"
+#include "../common/repeat_mask.h"
+#include "../common/mem_budget.h"
+#include "../common/metrics.h"
+#include "../common/workspace.h"
 
 #include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <getopt.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -34,19 +43,410 @@ create_volume_results_name_finished(int vid, const char* wrk_dir, string& name)
 void
 merge_results(const char* output, const char* wrk_dir, const int num_volumes)
 {
-	string vrn;
-	for (int i = 0; i < num_volumes; ++i)
+	vector<string> names(num_volumes);
+	for (int i = 0; i < num_volumes; ++i) create_volume_results_name_finished(i, wrk_dir, names[i]);
+	concatenate_files(names, output);
+}
+
+static void
+open_results_file(options_t* options, const string& name, ofstream& out)
+{
+	open_fstream(out, name.c_str(), ios::out | ios::binary);
+	if (options->output_binary)
+	{
+		if (options->task == TASK_SEED)
+			write_record_stream_header(out, kRecordTypeExtensionCandidate, 0);
+		else
+			write_record_stream_header(out, kRecordTypeM4Record, options->output_gapped_start_point ? RECORD_STREAM_FLAG_M4_EXT : 0);
+	}
+}
+
+// maps the read volumes [first_read_vid, evid) against the reference volumes ref_vids, the results of
+// ref_vids[r] go to working_names[r] which is renamed to finished_names[r] when they are complete
+static void
+map_volumes(options_t* options, volume_names_t* vn, const vector<int>& ref_vids, const int first_read_vid, const int evid,
+			const vector<string>& working_names, const vector<string>& finished_names)
+{
+	const int num_refs = ref_vids.size();
+	vector<ofstream*> outs(num_refs);
+	for (int r = 0; r < num_refs; ++r)
+	{
+		outs[r] = new ofstream;
+		open_results_file(options, working_names[r], *outs[r]);
+	}
+	vector<ostream*> out_ptrs(outs.begin(), outs.end());
+	process_one_volume(options, ref_vids.data(), num_refs, first_read_vid, evid, vn, out_ptrs.data());
+	for (int r = 0; r < num_refs; ++r)
+	{
+		metrics_count("volumes_processed", 1);
+		metrics_count("bytes_written_results", outs[r]->tellp());
+		close_fstream(*outs[r]);
+		delete outs[r];
+		if (rename(working_names[r].c_str(), finished_names[r].c_str()))
+			ERROR("cannot rename \'%s\' to \'%s\': %s", working_names[r].c_str(), finished_names[r].c_str(), strerror(errno));
+	}
+}
+
+// --shard i/N: maps the pieces of the shard that are not finished and writes its manifest
+static void
+run_shard(options_t* options, volume_names_t* vn)
+{
+	vector<ShardPiece> pieces;
+	plan_shard(vn->num_vols, options->shard_index, options->num_shards, pieces);
+	LOG(stderr, "shard %d/%d maps %d pieces", options->shard_index, options->num_shards, (int)pieces.size());
+	string wrk_dir = options->wrk_dir;
+	if (wrk_dir[wrk_dir.size() - 1] != '/') wrk_dir += '/';
+	size_t i = 0;
+	while (i < pieces.size())
+	{
+		// pieces that start at their reference volume and end at the same read volume are mapped
+		// together, up to options->ref_batch of them
+		vector<int> ref_vids;
+		vector<string> working_names, finished_names;
+		int first_read_vid = -1, evid = -1;
+		for (; i < pieces.size() && (int)ref_vids.size() < options->ref_batch; ++i)
+		{
+			const ShardPiece& p = pieces[i];
+			const string finished = wrk_dir + p.file;
+			if (access(finished.c_str(), F_OK) == 0)
+			{
+				LOG(stderr, "piece %s has been finished\n", p.file.c_str());
+				continue;
+			}
+			if (!ref_vids.empty() && (p.first_read_vid != p.ref_vid || first_read_vid != ref_vids[0] || p.end_read_vid != evid)) break;
+			if (ref_vids.empty())
+			{
+				first_read_vid = p.first_read_vid;
+				evid = p.end_read_vid;
+			}
+			ref_vids.push_back(p.ref_vid);
+			finished_names.push_back(finished);
+			working_names.push_back(finished + ".working");
+		}
+		if (ref_vids.empty()) continue;
+		map_volumes(options, vn, ref_vids, first_read_vid, evid, working_names, finished_names);
+	}
+	write_shard_manifest(options, vn->num_vols, pieces);
+}
+
+// volumes are not made smaller than this to fit a memory budget, fewer threads are used instead
+static const idx_t kMinBudgetVolumeBases = 100000000;
+
+static bool
+fits_mem_budget(options_t* options, const idx_t volume_bases)
+{
+	vector<mem_item_t> items;
+	pw_memory_items(options, volume_bases, items);
+	return mem_plan_max_threads(items.data(), items.size(), options->mem_budget, options->num_threads) == options->num_threads;
+}
+
+// the largest volume size with which options->num_threads threads fit into options->mem_budget
+static idx_t
+plan_volume_bases(options_t* options)
+{
+	idx_t lo = kMinBudgetVolumeBases, hi = MCS;
+	if (fits_mem_budget(options, hi)) return hi;
+	if (!fits_mem_budget(options, lo)) return lo;
+	while (hi - lo > 1000000)
+	{
+		const idx_t mid = lo + (hi - lo) / 2;
+		if (fits_mem_budget(options, mid)) lo = mid;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// the finished volume results of an earlier run are only valid for the volumes and the repeat mask they
+// were computed on. the working folder keeps them in "volume_bases": the size, the number of volumes,
+// one checksum per volume, then the checksum of the repeat mask (0 for none). runs before the checksums
+// wrote the size only, runs before the mask checksum the volume checksums only.
+static string
+volume_set_file_name(options_t* options)
+{
+	string name = options->wrk_dir;
+	if (name[name.size() - 1] != '/') name += '/';
+	name += "volume_bases";
+	return name;
+}
+
+static uint64_t
+mask_checksum(options_t* options)
+{
+	if (!options->repeat_mask) return 0;
+	repeat_mask_t* mask = load_repeat_mask(options->repeat_mask);
+	const uint64_t checksum = mask->checksum;
+	mask = destroy_repeat_mask(mask);
+	return checksum;
+}
+
+// the volume size to split with: the one of the finished results if there are any. their volume
+// checksums, if recorded, are returned in finished_checksums. finished results of another repeat
+// mask are an error.
+static idx_t
+resume_volume_bases(options_t* options, idx_t volume_bases, vector<uint64_t>& finished_checksums)
+{
+	finished_checksums.clear();
+	string first_results;
+	create_volume_results_name_finished(0, options->wrk_dir, first_results);
+	if (access(first_results.c_str(), F_OK)) return volume_bases;
+	
+	const string size_name = volume_set_file_name(options);
+	idx_t used_bases = MCS;
+	int num_vols = 0;
+	ifstream in(size_name.c_str());
+	if (in && in >> used_bases && in >> num_vols)
+	{
+		uint64_t checksum;
+		for (int i = 0; i < num_vols && in >> checksum; ++i) finished_checksums.push_back(checksum);
+		if ((int)finished_checksums.size() != num_vols) ERROR("'%s' is truncated", size_name.c_str());
+		uint64_t finished_mask;
+		if (!(in >> finished_mask))
+		{
+			LOG(stderr, "'%s' does not record the repeat mask of the finished results, they are kept unchecked", size_name.c_str());
+		}
+		else if (finished_mask != mask_checksum(options))
+		{
+			ERROR("the finished results in '%s' were computed with another repeat mask; "
+				  "use the same --repeat-mask or remove the results to start again", options->wrk_dir);
+		}
+	}
+	if (used_bases != volume_bases)
+	{
+		LOG(stderr, "results of volumes of %lld bases are finished, the volumes keep that size", (long long)used_bases);
+		if (options->mem_budget)
+		{
+			vector<mem_item_t> items;
+			pw_memory_items(options, used_bases, items);
+			if (mem_plan_max_threads(items.data(), items.size(), options->mem_budget, 1) == 0)
+				ERROR("the finished results in '%s' are of volumes of %lld bases, which the memory budget does not hold; "
+					  "raise --mem-budget or remove the results to start again", options->wrk_dir, (long long)used_bases);
+		}
+		volume_bases = used_bases;
+	}
+	return volume_bases;
+}
+
+// checks the checksums of the volumes just split against the ones the finished results were computed
+// on, then records them
+static void
+record_volume_set(options_t* options, const idx_t volume_bases, const vector<uint64_t>& checksums, const vector<uint64_t>& finished_checksums)
+{
+	if (!finished_checksums.empty() && finished_checksums != checksums)
+		ERROR("the volumes of '%s' are not the ones its finished results were computed on, the reads changed; "
+			  "remove the results to start again", options->wrk_dir);
+	
+	const string size_name = volume_set_file_name(options);
+	ofstream out;
+	open_fstream(out, size_name.c_str(), ios::out);
+	out << volume_bases << "\n" << checksums.size() << "\n";
+	for (size_t i = 0; i < checksums.size(); ++i) out << checksums[i] << "\n";
+	out << mask_checksum(options) << "\n";
+	close_fstream(out);
+}
+
+static idx_t
+max_volume_bases(volume_names_t* vn)
+{
+	idx_t max_bases = 0;
+	for (int i = 0; i < vn->num_vols; ++i)
+	{
+		volume_t* v = load_volume(get_vol_name(vn, i));
+		max_bases = max(max_bases, (idx_t)v->curr);
+		v = delete_volume_t(v);
+	}
+	return max_bases;
+}
+
+// reduces options->num_threads until mapping the volumes of vn fits into the budget and prints the plan
+static void
+cap_threads_to_mem_budget(options_t* options, volume_names_t* vn)
+{
+	const idx_t volume_bases = max_volume_bases(vn);
+	vector<mem_item_t> items;
+	pw_memory_items(options, volume_bases, items);
+	const int num_threads = mem_plan_max_threads(items.data(), items.size(), options->mem_budget, options->num_threads);
+	char title[256];
+	sprintf(title, "mecat2pw, %d volume(s) of at most %lld bases", vn->num_vols, (long long)volume_bases);
+	print_mem_plan(title, items.data(), items.size(), options->mem_budget, num_threads ? num_threads : 1);
+	if (num_threads == 0)
+		ERROR("the memory budget of %lld bytes does not hold one thread, try smaller volumes or -s 1", (long long)options->mem_budget);
+	if (num_threads < options->num_threads)
+		LOG(stderr, "the memory budget holds %d of the %d threads", num_threads, options->num_threads);
+	options->num_threads = num_threads;
+}
+
+static void
+print_split_usage(const char* prog)
+{
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "%s split -d dataset -w working dir [-t threads] [-M size]", prog);
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "splits the reads into the volumes of the working folder once, before the shards (--shard i/N) are run\n");
+	fprintf(stderr, "with -M, the volumes are made as large as a run of the shards with -t threads and default options\n");
+	fprintf(stderr, "allows in that memory (see --mem-budget)\n");
+}
+
+// 'mecat2pw split': argv[0] is "split"
+static int
+split_main(int argc, char* argv[])
+{
+	const char* prog = "mecat2pw";
+	const char* reads = NULL;
+	const char* wrk_dir = NULL;
+	int num_threads = 1;
+	int64_t mem_budget = 0;
+	int opt_char;
+	opterr = 0;
+	while ((opt_char = getopt(argc, argv, "d:w:t:M:")) != -1)
+	{
+		switch (opt_char)
+		{
+			case 'd':
+				reads = optarg;
+				break;
+			case 'w':
+				wrk_dir = optarg;
+				break;
+			case 't':
+				num_threads = atoi(optarg);
+				break;
+			case 'M':
+				mem_budget = parse_mem_size(optarg);
+				break;
+			default:
+				LOG(stderr, "unrecognised option \'%c\'", (char)optopt);
+				print_split_usage(prog);
+				return 1;
+		}
+	}
+	if (!reads || !wrk_dir || num_threads < 1 || mem_budget < 0 || optind != argc)
 	{
-		create_volume_results_name_finished(i, wrk_dir, vrn);
-		ostringstream cmd;
-		if (i == 0) cmd << "cat " << vrn << " >" << output;
-		else cmd << "cat " << vrn << " >> " << output;
-		assert(system(cmd.str().c_str()) == 0);
+		print_split_usage(prog);
+		return 1;
 	}
+	if (mkdir(wrk_dir, S_IRWXU) && errno != EEXIST) ERROR("fail to create folder \'%s\': %s", wrk_dir, strerror(errno));
+	idx_t volume_bases = MCS;
+	if (mem_budget)
+	{
+		options_t options;
+		init_options(&options, TECH_PACBIO);
+		options.num_threads = num_threads;
+		options.mem_budget = mem_budget;
+		volume_bases = plan_volume_bases(&options);
+		LOG(stderr, "volumes of at most %lld bases", (long long)volume_bases);
+	}
+	MetricsStage stage("split_database");
+	const int num_vols = split_raw_dataset(reads, wrk_dir, num_threads, volume_bases);
+	metrics_gauge("volumes", num_vols);
+	return 0;
+}
+
+static const int kDefaultMaskKmerSize = 15;
+static const double kDefaultMaskCoverageFactor = 10.0;
+static const int kDefaultMaskSketchMB = 512;
+
+static void
+print_mask_usage(const char* prog)
+{
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "%s mask -w working dir -o mask file -G genome size [-f factor] [-n count] [-k kmer size] [-s MB] [-t threads]", prog);
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "counts the k-mers of all volumes of the working folder (see 'split') and writes the ones seen more\n");
+	fprintf(stderr, "than factor x coverage times to the mask file, for --repeat-mask of mecat2pw and -M of mecat2ref\n\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "-G <number>\tgenome size in bases, the coverage is the number of bases counted / genome size\n");
+	fprintf(stderr, "-f <number>\tk-mers seen more than f x coverage times are masked\n\t\tdefault: %g\n", kDefaultMaskCoverageFactor);
+	fprintf(stderr, "-n <integer>\tmask the k-mers seen more than n times instead, -G is then not needed\n");
+	fprintf(stderr, "-k <integer>\tk-mer size, it must be the one of the program using the mask\n\t\tdefault: %d\n", kDefaultMaskKmerSize);
+	fprintf(stderr, "-s <integer>\tmemory for the k-mer counts in MB, counting is exact if 4^k 16-bit counters fit,\n\t\totherwise a count-min sketch is used and the reads are read twice\n\t\tdefault: %d\n", kDefaultMaskSketchMB);
+	fprintf(stderr, "-t <integer>\tnumber of cpu threads\n\t\tdefault: 1\n");
+}
+
+// 'mecat2pw mask': argv[0] is "mask"
+static int
+mask_main(int argc, char* argv[])
+{
+	const char* prog = "mecat2pw";
+	const char* wrk_dir = NULL;
+	const char* output = NULL;
+	double genome_size = 0;
+	double factor = kDefaultMaskCoverageFactor;
+	int cutoff = 0;
+	int kmer_size = kDefaultMaskKmerSize;
+	int sketch_mb = kDefaultMaskSketchMB;
+	int num_threads = 1;
+	int opt_char;
+	opterr = 0;
+	while ((opt_char = getopt(argc, argv, "w:o:G:f:n:k:s:t:")) != -1)
+	{
+		switch (opt_char)
+		{
+			case 'w':
+				wrk_dir = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'G':
+				genome_size = atof(optarg);
+				break;
+			case 'f':
+				factor = atof(optarg);
+				break;
+			case 'n':
+				cutoff = atoi(optarg);
+				break;
+			case 'k':
+				kmer_size = atoi(optarg);
+				break;
+			case 's':
+				sketch_mb = atoi(optarg);
+				break;
+			case 't':
+				num_threads = atoi(optarg);
+				break;
+			default:
+				LOG(stderr, "unrecognised option \'%c\'", (char)optopt);
+				print_mask_usage(prog);
+				return 1;
+		}
+	}
+	if (!wrk_dir || !output || optind != argc || (cutoff <= 0 && genome_size <= 0) || factor <= 0
+		|| kmer_size < 1 || kmer_size > 16 || sketch_mb < 1 || num_threads < 1)
+	{
+		print_mask_usage(prog);
+		return 1;
+	}
+	char vol_idx_file_name[1024];
+	generate_idx_file_name(wrk_dir, vol_idx_file_name);
+	if (access(vol_idx_file_name, F_OK))
+		ERROR("\'%s\' does not exist, the reads must be split with \'%s split\' first", vol_idx_file_name, prog);
+	volume_names_t* vn = load_volume_names(vol_idx_file_name, 0);
+	repeat_mask_t* mask;
+	{
+		MetricsStage stage("build_repeat_mask");
+		mask = build_repeat_mask(vn, kmer_size, genome_size, factor, cutoff, (size_t)sketch_mb << 20, num_threads);
+	}
+	metrics_gauge("repeat_mask_cutoff", mask->cutoff);
+	metrics_count("repeat_kmers_masked", mask->num_kmers);
+	dump_repeat_mask(output, mask);
+	mask = destroy_repeat_mask(mask);
+	vn = delete_volume_names_t(vn);
+	return 0;
 }
 
 int main(int argc, char* argv[])
 {
+    argc = metrics_init(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "split") == 0) return split_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "mask") == 0) return mask_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "merge") == 0)
+	{
+		MetricsStage stage("merge_shards");
+		return merge_shards_main(argc - 1, argv + 1);
+	}
     options_t options;
     int r = parse_arguments(argc, argv, &options);
 	if (r)
@@ -55,31 +455,74 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 	
-	int num_vols = split_raw_dataset(options.reads, options.wrk_dir);
-	
 	char vol_idx_file_name[1024];
 	generate_idx_file_name(options.wrk_dir, vol_idx_file_name);
+	int num_vols = -1;
+	idx_t volume_bases = MCS;
+	vector<uint64_t> finished_checksums;
+	if (options.num_shards)
+	{
+		// the shards of a run may start together on different nodes, none of them may split the reads
+		if (access(vol_idx_file_name, F_OK))
+			ERROR("'%s' does not exist, the reads must be split with '%s split' before the shards are run", vol_idx_file_name, argv[0]);
+	}
+	else
+	{
+		volume_bases = options.mem_budget ? plan_volume_bases(&options) : MCS;
+		volume_bases = resume_volume_bases(&options, volume_bases, finished_checksums);
+		MetricsStage stage("split_database");
+		vector<uint64_t> checksums;
+		num_vols = split_raw_dataset(options.reads, options.wrk_dir, options.num_threads, volume_bases, &checksums);
+		record_volume_set(&options, volume_bases, checksums, finished_checksums);
+	}
+	
 	cout << vol_idx_file_name << "\n";
 	volume_names_t* vn = load_volume_names(vol_idx_file_name, 0);
-	r_assert(num_vols == vn->num_vols);
-	for (int i = 0; i < vn->num_vols; ++i)
+	r_assert(num_vols == -1 || num_vols == vn->num_vols);
+	num_vols = vn->num_vols;
+	metrics_gauge("volumes", num_vols);
+	if (options.mem_budget)
 	{
-		string volume_results_name_finished;
-		create_volume_results_name_finished(i, options.wrk_dir, volume_results_name_finished);
-		if (access(volume_results_name_finished.c_str(), F_OK) == 0) 
+		cap_threads_to_mem_budget(&options, vn);
+		metrics_gauge("threads", options.num_threads);
+	}
+	if (options.num_shards)
+	{
+		run_shard(&options, vn);
+		vn = delete_volume_names_t(vn);
+		report_workspace_usage();
+		return 0;
+	}
+	
+	int i = 0;
+	while (i < vn->num_vols)
+	{
+		// the next options.ref_batch volumes that are not finished are indexed together
+		vector<int> ref_vids;
+		vector<string> working_names, finished_names;
+		for (; i < vn->num_vols && (int)ref_vids.size() < options.ref_batch; ++i)
 		{
-			LOG(stderr, "volume %d has been finished\n", i);
-			continue;
+			string volume_results_name_finished;
+			create_volume_results_name_finished(i, options.wrk_dir, volume_results_name_finished);
+			if (access(volume_results_name_finished.c_str(), F_OK) == 0) 
+			{
+				LOG(stderr, "volume %d has been finished\n", i);
+				continue;
+			}
+			string volume_results_name_working;
+			create_volume_results_name_working(i, options.wrk_dir, volume_results_name_working);
+			ref_vids.push_back(i);
+			working_names.push_back(volume_results_name_working);
+			finished_names.push_back(volume_results_name_finished);
 		}
-		string volume_results_name_working;
-		create_volume_results_name_working(i, options.wrk_dir, volume_results_name_working);
-		ofstream out;
-		open_fstream(out, volume_results_name_working.c_str(), ios::out);
-		process_one_volume(&options, i, vn->num_vols, vn, &out);
-		close_fstream(out);
-		assert(rename(volume_results_name_working.c_str(), volume_results_name_finished.c_str()) == 0);
+		if (ref_vids.empty()) break;
+		map_volumes(&options, vn, ref_vids, ref_vids[0], vn->num_vols, working_names, finished_names);
 	}
 	vn = delete_volume_names_t(vn);
+	report_workspace_usage();
 	
-	merge_results(options.output, options.wrk_dir, num_vols);
+	{
+		MetricsStage stage("merge_results");
+		merge_results(options.output, options.wrk_dir, num_vols);
+	}
 }
@@ -6,7 +6,7 @@ ifeq "$(strip ${TARGET_DIR})" ""
 endif
 
 TARGET   := mecat2pw
-SOURCES  := pw.cpp pw_impl.cpp pw_options.cpp
+SOURCES  := pw.cpp pw_impl.cpp pw_options.cpp pw_shard.cpp pw_writer.cpp
 
 SRC_INCDIRS  := ../common .
 
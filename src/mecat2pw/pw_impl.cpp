@@ -4,19 +4,24 @@
 #include "../common/xdrop_gapalign.h"
 #include "../common/packed_db.h"
 #include "../common/lookup_table.h"
+#include "../common/metrics.h"
 #include "pw_impl.h"
 
 #include <algorithm>
 
 #include <cassert>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <sys/stat.h>
+
 #define MSS MAX_SEQ_SIZE
 
 static int MAXC = 100;
 static int output_gapped_start_point = 1;
+static int output_binary = 0;
 static int kmer_size = 15;
 static const double ddfs_cutoff_pacbio = 0.25;
 static const double ddfs_cutoff_nanopore = 0.25;
@@ -24,60 +29,53 @@ static double ddfs_cutoff = ddfs_cutoff_pacbio;
 static int min_align_size = 0;
 static int min_kmer_match = 0;
 static int min_kmer_dist = 0;
+static int minimizer_window = 0;
+static int seed_binning = 0;
+static int chain_scoring = 0;
+static int prune_diagonal = 0;
+// ddfs_cutoff in units of 1/kDdfsDen, for the integer tests of the chain scorer
+static const int kDdfsDen = 1024;
+static int ddfs_num = 256;
+// query distance between consecutive seed numbers
+static int seed_stride = BC;
+// the next read volume is loaded while the workers map the current one
+static const int kMaxReadVolumesInMemory = 2;
+// mean read size assumed for the offsets of a volume in the memory plan
+static const idx_t kPlanReadSize = 1000;
+// the alignment workspaces of a thread (see report_workspace_usage()), generous for reads of tens of kb
+static const idx_t kPlanAlignerBytes = 64LL << 20;
 
 using namespace std;
 
-PWThreadData::PWThreadData(options_t* opt, volume_t* ref, volume_t* rd, ref_index* idx, std::ostream* o)
-	: options(opt), used_thread_id(0), reference(ref), reads(rd), ridx(idx), out(o), m4_results(NULL), ec_results(NULL), next_processed_id(0)
+PWThreadData::PWThreadData(options_t* opt, const int nrefs, const int* rvids, volume_t** refs, ref_index** idxs, std::ostream** outs)
+	: options(opt), used_thread_id(0), num_refs(nrefs), ref_vids(rvids), references(refs), ridxs(idxs),
+	  num_queued_chunks(0), num_chunks(0), next_deque(0), no_more_volumes(false)
 {
 	pthread_mutex_init(&id_lock, NULL);
-	if (options->task == TASK_SEED)
-	{
-		safe_malloc(ec_results, ExtensionCandidate*, options->num_threads);
-		for (int i = 0; i < options->num_threads; ++i)
-			safe_malloc(ec_results[i], ExtensionCandidate, kResultListSize);
-	}
-	else if (options->task == TASK_ALN)
-	{
-		safe_malloc(m4_results, M4Record*, options->num_threads);
-		for (int i = 0; i < options->num_threads; ++i)
-			safe_malloc(m4_results[i], M4Record, kResultListSize);
-	}
-	else
+	if (options->task != TASK_SEED && options->task != TASK_ALN)
 	{
 		LOG(stderr, "Task must be either %d or %d, not %d!", TASK_SEED, TASK_ALN, options->task);
 		abort();
 	}
-	pthread_mutex_init(&result_write_lock, NULL);
-	pthread_mutex_init(&read_retrieve_lock, NULL);
+	writers = new ResultWriter*[num_refs];
+	for (int r = 0; r < num_refs; ++r) writers[r] = new ResultWriter(outs[r], options->ordered_output, options->output_binary);
+	deques = new ChunkDeque[options->num_threads];
+	for (int i = 0; i < options->num_threads; ++i) pthread_mutex_init(&deques[i].lock, NULL);
+	pthread_mutex_init(&work_lock, NULL);
+	pthread_cond_init(&work_cond, NULL);
+	pthread_cond_init(&volume_done_cond, NULL);
 }
 
 PWThreadData::~PWThreadData()
 {
-	if (ec_results)
-	{
-		for (int i = 0; i < options->num_threads; ++i) safe_free(ec_results[i]);
-		safe_free(ec_results);
-	}
-	if (m4_results)
-	{
-		for (int i = 0; i < options->num_threads; ++i) safe_free(m4_results[i]);
-		safe_free(m4_results);
-	}
-}
-
-void
-reverse_complement(char* dst, const char* src, const int size)
-{
-	const uint8_t* rc_table = get_dna_complement_table();
-	int i;
-	for (i = 0; i < size; ++i)
-	{
-		uint8_t c = src[i];
-		assert(c >= 0 && c < 4);
-		c = rc_table[c];
-		dst[size - 1 - i] = c;
-	}
+	for (int r = 0; r < num_refs; ++r) delete writers[r];
+	delete[] writers;
+	for (int i = 0; i < options->num_threads; ++i) pthread_mutex_destroy(&deques[i].lock);
+	delete[] deques;
+	pthread_mutex_destroy(&id_lock);
+	pthread_mutex_destroy(&work_lock);
+	pthread_cond_destroy(&work_cond);
+	pthread_cond_destroy(&volume_done_cond);
 }
 
 int
@@ -96,13 +94,46 @@ extract_kmers(const char* s, const int ssize, int* kmer_ids)
 	return num_kmers;
 }
 
-SeedingBK::SeedingBK(const int ref_size)
+// the (minimizer_window,kmer_size)-minimizers of s, their query positions go to sbk->kmer_pos
+int
+extract_minimizers(const char* s, const int ssize, SeedingBK* sbk)
 {
+	const int num_kmers = ssize - kmer_size + 1;
+	if (num_kmers <= 0) return 0;
+	sbk->kmers.resize(num_kmers);
+	sbk->kmer_pos.resize(num_kmers);
+	sbk->work.resize(num_kmers);
+	uint32_t* kmers = sbk->kmers.data();
+	const uint32_t mask = (1U << (2 * kmer_size)) - 1;
+	uint32_t eit = 0;
+	int i;
+	for (i = 0; i < kmer_size - 1; ++i) eit = (eit << 2) | s[i];
+	for (i = 0; i < num_kmers; ++i)
+	{
+		eit = ((eit << 2) | s[i + kmer_size - 1]) & mask;
+		kmers[i] = eit;
+	}
+	int* pos = sbk->kmer_pos.data();
+	int n = select_minimizers(kmers, num_kmers, kmer_size, minimizer_window, pos, sbk->work.data());
+	for (i = 0; i < n; ++i) sbk->kmer_ids[i] = kmers[pos[i]];
+	return n;
+}
+
+SeedingBK::SeedingBK(const int ref_size, const bool binned_seeds)
+{
+	binned = binned_seeds;
+	index_list = NULL;
+	index_score = NULL;
+	database = NULL;
+	safe_malloc(kmer_ids, int, MAX_SEQ_SIZE);
+	num_lookups = 0;
+	num_hits = 0;
+	num_pruned = 0;
+	if (binned) return;
 	const int num_segs = ref_size / ZV + 5;
 	safe_malloc(index_list, int, num_segs);
 	safe_malloc(index_score, short, num_segs);
 	safe_malloc(database, Back_List, num_segs);
-	safe_malloc(kmer_ids, int, MAX_SEQ_SIZE);
 	for (int i = 0; i < num_segs; ++i) 
 	{
 		database[i].score = 0;
@@ -112,12 +143,39 @@ SeedingBK::SeedingBK(const int ref_size)
 
 SeedingBK::~SeedingBK()
 {
-	safe_free(index_list);
-	safe_free(index_score);
-	safe_free(database);
+	if (!binned)
+	{
+		safe_free(index_list);
+		safe_free(index_score);
+		safe_free(database);
+	}
 	safe_free(kmer_ids);
 }
 
+void
+DenseSegmentTable::clear(const int* index_list, const int num_segs)
+{
+	for (int i = 0; i < num_segs; ++i)
+	{
+		database[index_list[i]].score = 0;
+		database[index_list[i]].index = -1;
+	}
+}
+
+Back_List*
+SeedBins::seg(const int id)
+{
+	int left = 0, right = segments.size();
+	while (left < right)
+	{
+		int mid = (left + right) / 2;
+		if (segments[mid].seg < id) left = mid + 1;
+		else right = mid;
+	}
+	if (left < (int)segments.size() && segments[left].seg == id) return &segments[left].bl;
+	return NULL;
+}
+
 void insert_loc(Back_List *spr,int loc,int seedn,float len)
 {
     int list_loc[SI],list_score[SI],list_seed[SI],i,j,minval,mini;
@@ -238,8 +296,190 @@ int find_location(int *t_loc,int *t_seedn,int *t_score,int *loc,int k,int *rep_l
     else return(0);
 }
 
+/* the chain scorer: the same consistency rule as insert_loc() and find_location(), without floating point.
+ *
+ * an anchor (loc, seedn) lies on the diagonal loc - seedn * stride. two anchors are consistent when
+ * the diagonal drifts between them by less than ddfs_cutoff of their query distance, i.e.
+ *     |diag_j - diag_i| * kDdfsDen < (seedn_j - seedn_i) * stride * ddfs_num,
+ * so with both sides scaled once per anchor a pair costs two subtractions. the seeds of a segment
+ * are sorted by seedn; once the query distance alone puts an anchor beyond the read length, the
+ * rest of its run is skipped. the scores, and hence the candidates, are those of find_location().
+ */
+
+static inline bool
+drift_consistent(const int dl, const int ds)
+{
+	long long span = (long long)ds * seed_stride;
+	long long drift = dl - span;
+	if (span < 0) span = -span;
+	if (drift < 0) drift = -drift;
+	return drift * kDdfsDen < span * ddfs_num;
+}
+
+static inline void
+scale_anchor(const int loc, const int seedn, long long& diag, long long& span)
+{
+	diag = ((long long)loc - (long long)seedn * seed_stride) * kDdfsDen;
+	span = (long long)seedn * seed_stride * ddfs_num;
+}
+
+static inline bool
+anchors_consistent(const long long* diag, const long long* span, const int i, const int j)
+{
+	long long drift = diag[j] - diag[i];
+	if (drift < 0) drift = -drift;
+	return drift < span[j] - span[i];
+}
+
+static void
+insert_loc_chain(Back_List* spr, const int loc, const int seedn)
+{
+	int list_loc[SI], list_seed[SI], list_score[SI], i, j, minval, mini;
+	long long diag[SI], span[SI];
+	for (i = 0; i < SM; ++i)
+	{
+		list_loc[i] = spr->loczhi[i];
+		list_seed[i] = spr->seedno[i];
+	}
+	list_loc[SM] = loc;
+	list_seed[SM] = seedn;
+	for (i = 0; i < SI; ++i)
+	{
+		list_score[i] = 0;
+		scale_anchor(list_loc[i], list_seed[i], diag[i], span[i]);
+	}
+	for (i = 0; i < SM; ++i)
+		for (j = i + 1; j < SI; ++j)
+			if (list_seed[j] > list_seed[i] && list_loc[j] > list_loc[i] && anchors_consistent(diag, span, i, j))
+			{
+				++list_score[i];
+				++list_score[j];
+			}
+	mini = -1;
+	minval = 10000;
+	for (i = 0; i < SI; ++i)
+		if (minval > list_score[i]) { minval = list_score[i]; mini = i; }
+	if (minval == SM)
+	{
+		spr->loczhi[SM - 1] = loc;
+		spr->seedno[SM - 1] = seedn;
+	}
+	else if (minval < SM && mini < SM)
+	{
+		for (i = mini; i < SM; ++i)
+		{
+			spr->loczhi[i] = list_loc[i + 1];
+			spr->seedno[i] = list_seed[i + 1];
+		}
+		spr->score--;
+	}
+}
+
+static inline void
+set_location(int* loc, int* rep_loc, const int* t_loc, const int* t_seedn, const int j)
+{
+	if (loc[0] == 0)
+	{
+		loc[0] = t_loc[j];
+		loc[1] = t_seedn[j];
+		*rep_loc = j;
+	}
+	else
+	{
+		loc[2] = t_loc[j];
+		loc[3] = t_seedn[j];
+	}
+}
+
+static int
+chain_location(int* t_loc, int* t_seedn, int* t_score, int* loc, const int k, int* rep_loc, const int read_len1)
+{
+	long long diag[2 * SM + 10], span[2 * SM + 10];
+	int run_end[2 * SM + 10];
+	int i, j, maxval = 0, maxi = 0, rep = 0, lasti = 0, tempi;
+	r_assert(k <= 2 * SM + 10);
+	for (i = 0; i < k; ++i)
+	{
+		t_score[i] = 0;
+		scale_anchor(t_loc[i], t_seedn[i], diag[i], span[i]);
+	}
+	for (i = k - 1; i >= 0; --i)
+		run_end[i] = (i + 1 < k && t_seedn[i + 1] > t_seedn[i]) ? run_end[i + 1] : i + 1;
+	// consistent anchors are closer than read_len1 only if their query distance is below this
+	const long long max_span = (long long)read_len1 * kDdfsDen * ddfs_num / (kDdfsDen - ddfs_num) + ddfs_num;
+
+	for (i = 0; i < k - 1; ++i)
+		for (j = i + 1, tempi = t_seedn[i]; j < k; ++j)
+		{
+			if (run_end[j] == run_end[i] && span[j] - span[i] > max_span)
+			{
+				j = run_end[j] - 1;
+				continue;
+			}
+			const int dl = t_loc[j] - t_loc[i];
+			if (tempi != t_seedn[j] && t_seedn[j] > t_seedn[i] && dl > 0 && dl < read_len1 && anchors_consistent(diag, span, i, j))
+			{
+				++t_score[i];
+				++t_score[j];
+				tempi = t_seedn[j];
+			}
+		}
+
+	for (i = 0; i < k; ++i)
+	{
+		if (maxval < t_score[i])
+		{
+			maxval = t_score[i];
+			maxi = i;
+			rep = 0;
+		}
+		else if (maxval == t_score[i])
+		{
+			++rep;
+			lasti = i;
+		}
+	}
+	for (i = 0; i < 4; ++i) loc[i] = 0;
+	if (maxval < 5) return 0;
+	if (rep == maxval)
+	{
+		loc[0] = t_loc[maxi], loc[1] = t_seedn[maxi];
+		*rep_loc = maxi;
+		loc[2] = t_loc[lasti], loc[3] = t_seedn[lasti];
+		return 1;
+	}
+	for (j = 0; j < maxi; ++j)
+	{
+		const int dl = t_loc[maxi] - t_loc[j];
+		if (t_seedn[maxi] > t_seedn[j] && dl > 0 && dl < read_len1 && anchors_consistent(diag, span, j, maxi))
+			set_location(loc, rep_loc, t_loc, t_seedn, j);
+	}
+	set_location(loc, rep_loc, t_loc, t_seedn, maxi);
+	for (j = maxi + 1; j < k; ++j)
+	{
+		const int dl = t_loc[j] - t_loc[maxi];
+		if (t_seedn[j] > t_seedn[maxi] && dl > 0 && dl <= read_len1 && anchors_consistent(diag, span, maxi, j))
+			set_location(loc, rep_loc, t_loc, t_seedn, j);
+	}
+	return 1;
+}
+
+// the reference offsets of a k-mer below max_offset. the offsets of a k-mer are sorted.
+static inline int
+lookup_seeds(ref_index* ridx, const uint32_t kmer, const int max_offset, SeedingBK* sbk, const int** seed_arr)
+{
+	int num_seeds = ref_index_lookup(ridx, kmer, seed_arr);
+	if (max_offset < INT_MAX && num_seeds)
+	{
+		const int n = lower_bound(*seed_arr, *seed_arr + num_seeds, max_offset) - *seed_arr;
+		sbk->num_pruned += num_seeds - n;
+		num_seeds = n;
+	}
+	return num_seeds;
+}
+
 int
-seeding(const char* read, const int read_size, ref_index* ridx, SeedingBK* sbk)
+seeding(const char* read, const int read_size, ref_index* ridx, SeedingBK* sbk, const int max_offset)
 {
 	int* kmer_ids = sbk->kmer_ids;
 	int* index_list = sbk->index_list;
@@ -248,25 +488,30 @@ seeding(const char* read, const int read_size, ref_index* ridx, SeedingBK* sbk)
 	short* index_ss = index_score;
 	Back_List* database = sbk->database;
 	
-	int num_kmers = extract_kmers(read, read_size, kmer_ids);
+	int num_kmers = minimizer_window ? extract_minimizers(read, read_size, sbk) : extract_kmers(read, read_size, kmer_ids);
+	const int* kmer_pos = sbk->kmer_pos.data();
 	int km;
 	int used_segs = 0;
+	sbk->num_lookups += num_kmers;
 	for (km = 0; km < num_kmers; ++km)
 	{
-		int num_seeds = ridx->kmer_counts[kmer_ids[km]];
-		int* seed_arr = ridx->kmer_starts[kmer_ids[km]];
+		const int* seed_arr;
+		int num_seeds = lookup_seeds(ridx, kmer_ids[km], max_offset, sbk, &seed_arr);
+		const int seedn = minimizer_window ? kmer_pos[km] + 1 : km + 1;
 		int sid;
 		int endnum = 0;
+		sbk->num_hits += num_seeds;
 		for (sid = 0; sid < num_seeds; ++sid)
 		{
 			int seg_id = seed_arr[sid] / ZV;
 			int seg_off = seed_arr[sid] % ZV;
 			Back_List* spr = database + seg_id;
-			if (spr->score == 0 || spr->seednum < km + 1)
+			if (spr->score == 0 || spr->seednum < seedn)
 			{
 				int loc = ++spr->score;
-				if (loc <= SM) { spr->loczhi[loc - 1] = seg_off; spr->seedno[loc - 1] = km + 1; }
-				else insert_loc(spr, seg_off, km + 1, BC);
+				if (loc <= SM) { spr->loczhi[loc - 1] = seg_off; spr->seedno[loc - 1] = seedn; }
+				else if (chain_scoring) insert_loc_chain(spr, seg_off, seedn);
+				else insert_loc(spr, seg_off, seedn, seed_stride);
 				int s_k;
 				if (seg_id > 0) s_k = spr->score + (spr - 1)->score;
 				else s_k = spr->score;
@@ -279,15 +524,163 @@ seeding(const char* read, const int read_size, ref_index* ridx, SeedingBK* sbk)
 				}
 				else index_score[spr->index] = s_k;
 			}
-			spr->seednum = km + 1;
+			spr->seednum = seedn;
+		}
+	}
+	return used_segs;
+}
+
+// stable LSD radix sort of the hits by segment
+static void
+radix_sort_hits_by_segment(vector<SeedBins::Hit>& hits, vector<SeedBins::Hit>& tmp, const uint32_t max_seg)
+{
+	const int kBits = 11;
+	const uint32_t kRadix = 1U << kBits;
+	tmp.resize(hits.size());
+	uint32_t counts[kRadix];
+	for (int shift = 0; shift == 0 || (shift < 32 && (max_seg >> shift)); shift += kBits)
+	{
+		fill(counts, counts + kRadix, 0);
+		for (size_t i = 0; i < hits.size(); ++i) ++counts[(hits[i].seg >> shift) & (kRadix - 1)];
+		uint32_t sum = 0;
+		for (uint32_t d = 0; d < kRadix; ++d) { uint32_t c = counts[d]; counts[d] = sum; sum += c; }
+		for (size_t i = 0; i < hits.size(); ++i) tmp[counts[(hits[i].seg >> shift) & (kRadix - 1)]++] = hits[i];
+		hits.swap(tmp);
+	}
+}
+
+struct CmpSeedHitBySegment
+{
+	bool operator()(const SeedBins::Hit& a, const SeedBins::Hit& b)
+	{
+		return a.seg < b.seg;
+	}
+};
+
+// the score of segment sg right before the hit of the given time
+static inline int
+seed_bin_score_before(const vector<SeedBins::Event>& events, const SeedBins::Segment& sg, const int time)
+{
+	int left = sg.ev_begin, right = sg.ev_end;
+	while (left < right)
+	{
+		int mid = (left + right) / 2;
+		if (events[mid].time < time) left = mid + 1;
+		else right = mid;
+	}
+	return left > sg.ev_begin ? events[left - 1].score : 0;
+}
+
+// seeding() into sbk->bins instead of the dense table
+int
+bin_seeds(const char* read, const int read_size, ref_index* ridx, SeedingBK* sbk, const int max_offset)
+{
+	SeedBins& bins = sbk->bins;
+	vector<SeedBins::Hit>& hits = bins.hits;
+	int* kmer_ids = sbk->kmer_ids;
+	int num_kmers = minimizer_window ? extract_minimizers(read, read_size, sbk) : extract_kmers(read, read_size, kmer_ids);
+	const int* kmer_pos = sbk->kmer_pos.data();
+	uint32_t max_seg = 0;
+	hits.clear();
+	sbk->num_lookups += num_kmers;
+	for (int km = 0; km < num_kmers; ++km)
+	{
+		const int* seed_arr;
+		int num_seeds = lookup_seeds(ridx, kmer_ids[km], max_offset, sbk, &seed_arr);
+		const int seedn = minimizer_window ? kmer_pos[km] + 1 : km + 1;
+		sbk->num_hits += num_seeds;
+		for (int sid = 0; sid < num_seeds; ++sid)
+		{
+			SeedBins::Hit h;
+			h.seg = seed_arr[sid] / ZV;
+			h.off = seed_arr[sid] % ZV;
+			h.seedn = seedn;
+			h.time = hits.size();
+			if (max_seg < h.seg) max_seg = h.seg;
+			hits.push_back(h);
+		}
+	}
+	if (hits.size() < 256) stable_sort(hits.begin(), hits.end(), CmpSeedHitBySegment());
+	else radix_sort_hits_by_segment(hits, bins.sorted_hits, max_seg);
+
+	// replay the hits of every segment in query order, as seeding() applies them
+	vector<SeedBins::Event>& events = bins.events;
+	vector<SeedBins::Segment>& segments = bins.segments;
+	events.clear();
+	segments.clear();
+	size_t i = 0, j;
+	while (i < hits.size())
+	{
+		segments.push_back(SeedBins::Segment());
+		SeedBins::Segment& sg = segments.back();
+		Back_List* spr = &sg.bl;
+		sg.seg = hits[i].seg;
+		sg.first_time = -1;
+		sg.ev_begin = events.size();
+		spr->score = 0;
+		spr->seednum = 0;
+		spr->index = -1;
+		for (j = i; j < hits.size() && hits[j].seg == hits[i].seg; ++j)
+		{
+			const SeedBins::Hit& h = hits[j];
+			if (spr->score == 0 || spr->seednum < h.seedn)
+			{
+				int loc = ++spr->score;
+				if (loc <= SM) { spr->loczhi[loc - 1] = h.off; spr->seedno[loc - 1] = h.seedn; }
+				else if (chain_scoring) insert_loc_chain(spr, h.off, h.seedn);
+				else insert_loc(spr, h.off, h.seedn, seed_stride);
+				if (sg.first_time == -1) sg.first_time = h.time;
+				sg.last_time = h.time;
+				SeedBins::Event e = { h.time, spr->score };
+				events.push_back(e);
+			}
+			spr->seednum = h.seedn;
 		}
+		sg.ev_end = events.size();
+		i = j;
 	}
+
+	// segments are listed in the order they were first hit, with the score of their last hit
+	// plus the score the segment before had at that time
+	const int used_segs = segments.size();
+	bins.first_touch.resize(used_segs);
+	for (int k = 0; k < used_segs; ++k) bins.first_touch[k] = make_pair(segments[k].first_time, k);
+	sort(bins.first_touch.begin(), bins.first_touch.end());
+	bins.index_list.resize(used_segs);
+	bins.index_score.resize(used_segs);
+	for (int t = 0; t < used_segs; ++t)
+	{
+		const int k = bins.first_touch[t].second;
+		SeedBins::Segment& sg = segments[k];
+		int s_k = events[sg.ev_end - 1].score;
+		if (k > 0 && segments[k - 1].seg == sg.seg - 1) s_k += seed_bin_score_before(events, segments[k - 1], sg.last_time);
+		bins.index_list[t] = sg.seg;
+		bins.index_score[t] = s_k;
+		sg.bl.index = t;
+	}
+	sbk->index_list = bins.index_list.data();
+	sbk->index_score = bins.index_score.data();
 	return used_segs;
 }
 
+static inline int
+segment_score(DenseSegmentTable& table, const int id)
+{
+	return table.seg(id)->score;
+}
+
+static inline int
+segment_score(SeedBins& table, const int id)
+{
+	Back_List* spr = table.seg(id);
+	return spr ? spr->score : 0;
+}
+
+template <class SegmentTable>
 int
 get_candidates(volume_t* ref, 
 			   SeedingBK* sbk, 
+			   SegmentTable& table,
 			   const int num_segs, 
 			   const int read_id, 
 			   const int read_size, 
@@ -299,7 +692,6 @@ get_candidates(volume_t* ref,
 	int* index_spr = index_list;
 	short* index_score = sbk->index_score;
 	short* index_ss = index_score;
-	Back_List* database = sbk->database;
 	const int temp_arr_size = 2 * SM + 10;
 	int temp_list[temp_arr_size],temp_seedn[temp_arr_size],temp_score[temp_arr_size];
 	candidate_save *candidate_loc = candidates, candidate_temp;
@@ -308,7 +700,7 @@ get_candidates(volume_t* ref,
 	for (i = 0; i < num_segs; ++i, ++index_spr, ++index_ss) 
 		if (*index_ss >= 2 * min_kmer_match)
 		{
-			Back_List *spr = database + (*index_spr), *spr1;
+			Back_List *spr = table.seg(*index_spr), *spr1;
 			if (spr->score == 0) continue;
 			int s_k = spr->score;
 			int start_loc = *index_spr;
@@ -316,7 +708,7 @@ get_candidates(volume_t* ref,
 			int loc;
 			if ((*index_spr) > 0)
 			{
-				loc = (spr - 1)->score;
+				loc = segment_score(table, *index_spr - 1);
 				if (loc > 0) 
 				{
 					start_loc = (*index_spr - 1);
@@ -336,7 +728,7 @@ get_candidates(volume_t* ref,
 			{
 				k = loc;
 				u_k = 0;
-				spr1 = spr - 1;
+				spr1 = table.seg(*index_spr - 1);
 				for (j = 0; j < k && j < SM; ++j)
 				{
 					temp_list[u_k] = spr1->loczhi[j];
@@ -352,7 +744,9 @@ get_candidates(volume_t* ref,
 			}
 			
 			{
-				int f = find_location(temp_list, temp_seedn, temp_score, location_loc, u_k, &repeat_loc, BC, read_size);
+				int f = chain_scoring
+						? chain_location(temp_list, temp_seedn, temp_score, location_loc, u_k, &repeat_loc, read_size)
+						: find_location(temp_list, temp_seedn, temp_score, location_loc, u_k, &repeat_loc, seed_stride, read_size);
 				if (!f) continue;
 				if (temp_score[repeat_loc] < 2 * min_kmer_match + 2) continue;
 			}
@@ -371,21 +765,27 @@ get_candidates(volume_t* ref,
 			if (sid == read_id)
 			{
 				u_k = DIV_ZV(sstart);
-				spr = database + u_k;
 				s_k = MOD_ZV(sstart);
-				for (j = 0, k = 0; j < spr->score && j < SM; ++j)
-					if (spr->loczhi[j] < s_k) { spr->loczhi[k] = spr->loczhi[j]; ++k; }
-				spr->score = k;
-				for (++spr, ++u_k, k = DIV_ZV(send); u_k < k; ++u_k, ++spr) spr->score = 0;
-				for (j = 0, k = 0, s_k = MOD_ZV(send); j < spr->score && j < SM; ++j)
-					if (spr->loczhi[j] > s_k) { spr->loczhi[k] = spr->loczhi[j]; ++k; }
-				spr->score = k;
+				if ((spr = table.seg(u_k)) != NULL)
+				{
+					for (j = 0, k = 0; j < spr->score && j < SM; ++j)
+						if (spr->loczhi[j] < s_k) { spr->loczhi[k] = spr->loczhi[j]; ++k; }
+					spr->score = k;
+				}
+				for (++u_k, k = DIV_ZV(send); u_k < k; ++u_k) 
+					if ((spr = table.seg(u_k)) != NULL) spr->score = 0;
+				if ((spr = table.seg(u_k)) != NULL)
+				{
+					for (j = 0, k = 0, s_k = MOD_ZV(send); j < spr->score && j < SM; ++j)
+						if (spr->loczhi[j] > s_k) { spr->loczhi[k] = spr->loczhi[j]; ++k; }
+					spr->score = k;
+				}
 			}
 			else
 			{
 				candidate_temp.readno = sid;
 				candidate_temp.readstart = sstart;
-				location_loc[1] = (location_loc[1] - 1) * BC;
+				location_loc[1] = (location_loc[1] - 1) * seed_stride;
 				int left_length1 = location_loc[0] - sstart + kmer_size - 1;
 				int right_length1 = send - location_loc[0];
 				int left_length2 = location_loc[1] + kmer_size - 1;
@@ -405,11 +805,13 @@ get_candidates(volume_t* ref,
 				int seedcount = 0;
 				int nlb = (num1 + ZV - 1);
 				nlb = DIV_ZV(nlb);
-				for(u_k=*index_spr-1, spr1=spr-1; u_k>=0&&nlb>0; spr1--,--nlb,u_k--)if(spr1->score>0)
+				for(u_k=*index_spr-1; u_k>=0&&nlb>0; --nlb,u_k--)if((spr1=table.seg(u_k))&&spr1->score>0)
 					{
 						start_loc = MUL_ZV(u_k);
 						int scnt = min((int)spr1->score, SM);
-						for(j=0,s_k=0; j < scnt; j++)if(fabs((loc_list-start_loc-spr1->loczhi[j])/((loc_seed-spr1->seedno[j])*BC*1.0)-1.0)<ddfs_cutoff)
+						for(j=0,s_k=0; j < scnt; j++)if(chain_scoring
+								? drift_consistent(loc_list-start_loc-spr1->loczhi[j], loc_seed-spr1->seedno[j])
+								: fabs((loc_list-start_loc-spr1->loczhi[j])/((loc_seed-spr1->seedno[j])*seed_stride*1.0)-1.0)<ddfs_cutoff)
 							{
 								seedcount++;
 								s_k++;
@@ -422,11 +824,13 @@ get_candidates(volume_t* ref,
 				//find all right seed
 				int nrb = (num2 + ZV - 1);
 				nrb = DIV_ZV(nrb);
-				for(u_k=*index_spr+1,spr1=spr+1; nrb; spr1++,--nrb,u_k++)if(spr1->score>0)
+				for(u_k=*index_spr+1; nrb; --nrb,u_k++)if((spr1=table.seg(u_k))&&spr1->score>0)
 					{
 						start_loc = MUL_ZV(u_k);
 						int scnt = min((int)spr1->score, SM);
-						for(j=0,s_k=0; j < scnt; j++)if(fabs((start_loc+spr1->loczhi[j]-loc_list)/((spr1->seedno[j]-loc_seed)*BC*1.0)-1.0)<ddfs_cutoff)
+						for(j=0,s_k=0; j < scnt; j++)if(chain_scoring
+								? drift_consistent(start_loc+spr1->loczhi[j]-loc_list, spr1->seedno[j]-loc_seed)
+								: fabs((start_loc+spr1->loczhi[j]-loc_list)/((spr1->seedno[j]-loc_seed)*seed_stride*1.0)-1.0)<ddfs_cutoff)
 							{
 								seedcount++;
 								s_k++;
@@ -456,12 +860,39 @@ get_candidates(volume_t* ref,
 			}
 		}
 	
-	for(i=0,index_spr=index_list; i<num_segs; i++,index_spr++)
+	table.clear(index_list, num_segs);
+	return candidatenum;
+}
+
+// seeds one strand of a query and adds its candidates to the list. only the reference offsets
+// below max_offset are looked at.
+static int
+seed_one_strand(volume_t* reference, ref_index* ridx, SeedingBK* sbk, const char* read, const int read_size, const int read_id,
+				const char chain, candidate_save* candidates, const int num_candidates, const int max_offset)
+{
+	if (sbk->binned)
 	{
-		database[*index_spr].score=0;
-		database[*index_spr].index=-1;
+		int num_segs = bin_seeds(read, read_size, ridx, sbk, max_offset);
+		return get_candidates(reference, sbk, sbk->bins, num_segs, read_id, read_size, chain, candidates, num_candidates);
 	}
-	return candidatenum;
+	DenseSegmentTable table(sbk->database);
+	int num_segs = seeding(read, read_size, ridx, sbk, max_offset);
+	return get_candidates(reference, sbk, table, num_segs, read_id, read_size, chain, candidates, num_candidates);
+}
+
+/* get_candidates() drops the subjects after the query, so that every pair is reported once, with
+ * the larger id as the query. when the reads are the reference volume itself, the hits of those
+ * subjects can be skipped before seeding. the two segments after the one where the query starts
+ * are kept, they take part in scoring the subjects just before the query and in removing the
+ * self hits of the query.
+ */
+static int
+seeding_offset_limit(volume_t* reference, volume_t* reads, const int rid)
+{
+	if (!prune_diagonal || reads->start_read_id != reference->start_read_id) return INT_MAX;
+	const int qstart = reference->offset_list->offset_list[rid].offset;
+	const long long limit = (long long)MUL_ZV(DIV_ZV(qstart) + 3);
+	return limit < INT_MAX ? (int)limit : INT_MAX;
 }
 
 void
@@ -530,10 +961,18 @@ void output_m4record(ostream& out, const M4Record& m4)
 	out << "\n";
 }
 
-void
-print_m4record_list(ostream* out, M4Record* m4_list, int num_m4)
+static inline void
+add_m4record(ResultBatch* batch, const M4Record& m4)
+{
+	if (output_binary) batch->m4.push_back(m4);
+	else output_m4record(batch->text, m4);
+}
+
+static inline void
+add_candidate(ResultBatch* batch, const ExtensionCandidate& ec)
 {
-	for (int i = 0; i < num_m4; ++i) output_m4record(*out, m4_list[i]);
+	if (output_binary) batch->ec.push_back(ec);
+	else batch->text << ec;
 }
 
 struct CmpM4RecordByQidAndOvlpSize
@@ -573,10 +1012,9 @@ check_records_containment(M4Record* m4v, int s, int e, int* valid)
 	}
 }
 
+// removes the contained overlaps of a query and adds the rest to the batch
 void
-append_m4v(M4Record* glist, int* glist_size,
-		   M4Record* llist, int* llist_size,
-		   ostream* out, pthread_mutex_t* results_write_lock)
+append_m4v(M4Record* llist, int* llist_size, ResultBatch* batch)
 {
 	sort(llist, llist + *llist_size, CmpM4RecordByQidAndOvlpSize());
 	int i = 0, j;
@@ -591,33 +1029,141 @@ append_m4v(M4Record* glist, int* glist_size,
 		i = j;
 	}
 	
-	if ((*glist_size) + (*llist_size) > PWThreadData::kResultListSize)
-	{
-		pthread_mutex_lock(results_write_lock);
-		print_m4record_list(out, glist, *glist_size);
-		*glist_size = 0;
-		pthread_mutex_unlock(results_write_lock);
-	}
-	
 	for (i = 0; i < *llist_size; ++i)
-		if (valid[i])
+		if (valid[i]) add_m4record(batch, llist[i]);
+	
+	*llist_size = 0;
+}
+
+// cuts a read volume into chunks of about chunk_bases bases and deals them to the workers
+static void
+queue_read_volume(PWThreadData* data, PWReadVolume* vol)
+{
+	const int num_threads = data->options->num_threads;
+	const int num_reads = vol->reads->num_reads;
+	const offset_t* reads = vol->reads->offset_list->offset_list;
+	long long num_bases = 0;
+	for (int i = 0; i < num_reads; ++i) num_bases += reads[i].size;
+	// enough chunks for every thread to have several, so that the tail is short
+	long long chunk_bases = num_bases / (8LL * num_threads);
+	if (chunk_bases > CHUNK_BASES) chunk_bases = CHUNK_BASES;
+	
+	vector<ReadChunk> chunks;
+	ReadChunk chunk;
+	chunk.vol = vol;
+	chunk.Lid = 0;
+	long long bases = 0;
+	for (int i = 0; i < num_reads; ++i)
+	{
+		bases += reads[i].size;
+		if (bases >= chunk_bases || i + 1 == num_reads)
 		{
-			glist[*glist_size] = llist[i];
-			++(*glist_size);
+			chunk.Rid = i + 1;
+			chunks.push_back(chunk);
+			chunk.Lid = i + 1;
+			bases = 0;
 		}
+	}
 	
-	*llist_size = 0;
+	pthread_mutex_lock(&data->work_lock);
+	vol->num_pending_chunks = chunks.size();
+	vol->finished = chunks.empty();
+	for (size_t i = 0; i < chunks.size(); ++i)
+	{
+		chunks[i].seq = data->num_chunks++;
+		ChunkDeque& dq = data->deques[data->next_deque];
+		data->next_deque = (data->next_deque + 1) % num_threads;
+		pthread_mutex_lock(&dq.lock);
+		dq.chunks.push_back(chunks[i]);
+		pthread_mutex_unlock(&dq.lock);
+	}
+	data->num_queued_chunks += chunks.size();
+	pthread_cond_broadcast(&data->work_cond);
+	if (vol->finished) pthread_cond_broadcast(&data->volume_done_cond);
+	pthread_mutex_unlock(&data->work_lock);
+	metrics_count("read_chunks", chunks.size());
+}
+
+static bool
+take_chunk(ChunkDeque& dq, ReadChunk& chunk, const bool own)
+{
+	bool r = false;
+	pthread_mutex_lock(&dq.lock);
+	if (!dq.chunks.empty())
+	{
+		if (own) { chunk = dq.chunks.front(); dq.chunks.pop_front(); }
+		else { chunk = dq.chunks.back(); dq.chunks.pop_back(); }
+		r = true;
+	}
+	pthread_mutex_unlock(&dq.lock);
+	return r;
+}
+
+// the next chunk of worker tid, from its own deque or stolen from another one.
+// returns false once all volumes are queued and no chunk is left.
+static bool
+get_next_chunk(PWThreadData* data, const int tid, ReadChunk& chunk, long long& num_steals)
+{
+	const int num_threads = data->options->num_threads;
+	pthread_mutex_lock(&data->work_lock);
+	while (1)
+	{
+		while (data->num_queued_chunks == 0 && !data->no_more_volumes) pthread_cond_wait(&data->work_cond, &data->work_lock);
+		if (data->num_queued_chunks == 0) break;
+		// a chunk is queued somewhere, claim it before looking for it
+		--data->num_queued_chunks;
+		pthread_mutex_unlock(&data->work_lock);
+		if (take_chunk(data->deques[tid], chunk, true)) return true;
+		for (int i = 1; i < num_threads; ++i)
+			if (take_chunk(data->deques[(tid + i) % num_threads], chunk, false)) { ++num_steals; return true; }
+		// every claim is backed by a chunk in some deque, so another pass finds it
+		pthread_mutex_lock(&data->work_lock);
+		++data->num_queued_chunks;
+	}
+	pthread_mutex_unlock(&data->work_lock);
+	return false;
 }
 
-inline void
-get_next_chunk_reads(PWThreadData* data, int& Lid, int& Rid)
+static void
+finish_chunk(PWThreadData* data, const ReadChunk& chunk)
 {
-	pthread_mutex_lock(&data->read_retrieve_lock);
-	Lid = data->next_processed_id;
-	Rid = Lid + CHUNK_SIZE;
-	if (Rid > data->reads->num_reads) Rid = data->reads->num_reads;
-	data->next_processed_id += CHUNK_SIZE;
-	pthread_mutex_unlock(&data->read_retrieve_lock);
+	pthread_mutex_lock(&data->work_lock);
+	if (--chunk.vol->num_pending_chunks == 0)
+	{
+		chunk.vol->finished = true;
+		pthread_cond_broadcast(&data->volume_done_cond);
+	}
+	pthread_mutex_unlock(&data->work_lock);
+}
+
+// a result batch for every reference of the pool, those of the references after the read volume stay empty
+static void
+new_result_batches(PWThreadData* data, const ReadChunk& chunk, vector<ResultBatch*>& batches)
+{
+	batches.resize(data->num_refs);
+	for (int r = 0; r < data->num_refs; ++r)
+	{
+		batches[r] = new ResultBatch;
+		batches[r]->seq = chunk.seq;
+	}
+}
+
+static void
+submit_result_batches(PWThreadData* data, vector<ResultBatch*>& batches)
+{
+	for (int r = 0; r < data->num_refs; ++r) data->writers[r]->submit(batches[r]);
+}
+
+static void
+report_seeding_counts(vector<SeedingBK*>& sbks)
+{
+	for (size_t r = 0; r < sbks.size(); ++r)
+	{
+		metrics_count("seed_lookups", sbks[r]->num_lookups);
+		metrics_count("seed_hits", sbks[r]->num_hits);
+		metrics_count("seed_hits_pruned", sbks[r]->num_pruned);
+		delete sbks[r];
+	}
 }
 
 void
@@ -627,11 +1173,11 @@ pairwise_mapping(PWThreadData* data, int tid)
 	safe_malloc(read1, char, MSS);
 	safe_malloc(read2, char, MSS);
 	safe_malloc(subject, char, MSS);
-	SeedingBK* sbk = new SeedingBK(data->reference->curr);
+	vector<SeedingBK*> sbks(data->num_refs);
+	for (int r = 0; r < data->num_refs; ++r) sbks[r] = new SeedingBK(data->references[r]->curr, seed_binning);
+	vector<ResultBatch*> batches;
 	candidate_save candidates[MAXC];
 	int num_candidates = 0;
-	M4Record* m4_list = data->m4_results[tid];
-	int m4_list_size = 0;
 	M4Record* m4v = new M4Record[MAXC];
 	int num_m4 = 0;
 	GapAligner* aligner = NULL;
@@ -643,78 +1189,82 @@ pairwise_mapping(PWThreadData* data, int tid)
 		ERROR("TECH must be either %d or %d", TECH_PACBIO, TECH_NANOPORE);
 	}
 
-	int rid, Lid, Rid;
-	while (1)
+	MetricsStage stage("align");
+	long long num_reads = 0, num_aligned_candidates = 0, num_alignments = 0, num_steals = 0;
+	int rid, r;
+	ReadChunk chunk;
+	while (get_next_chunk(data, tid, chunk, num_steals))
 	{
-		get_next_chunk_reads(data, Lid, Rid);
-		if (Lid >= data->reads->num_reads) break;
-		for (rid = Lid; rid < Rid; ++rid)
+		volume_t* reads = chunk.vol->reads;
+		new_result_batches(data, chunk, batches);
+		num_reads += chunk.Rid - chunk.Lid;
+		for (rid = chunk.Lid; rid < chunk.Rid; ++rid)
 		{
-			int rsize = data->reads->offset_list->offset_list[rid].size;
-			extract_one_seq(data->reads, rid, read1);
-			reverse_complement(read2, read1, rsize);
-			int s;
-			char chain;
-			num_candidates = 0;
-			for (s = 0; s < 2; ++s)
+			int rsize = reads->offset_list->offset_list[rid].size;
+			extract_one_seq(reads, rid, read1);
+			extract_one_seq_rc(reads, rid, read2);
+			for (r = 0; r < data->num_refs && data->ref_vids[r] <= chunk.vol->vid; ++r)
 			{
-				if (s%2) { chain = 'R'; read = read2; }
-				else { chain = 'F'; read = read1; }
-				int num_segs = seeding(read, rsize, data->ridx, sbk);
-				num_candidates = get_candidates(data->reference, 
-												sbk, 
-												num_segs, 
-												rid + data->reads->start_read_id, 
-												rsize, 
-												chain, 
-												candidates, 
-												num_candidates); 
-			}
-
-			for (s = 0; s < num_candidates; ++s)
-			{
-				if (candidates[s].chain == 'F') read = read1;
-				else read = read2;
-				extract_one_seq(data->reference, candidates[s].readno - data->reference->start_read_id, subject);
-				int sstart = candidates[s].loc1;
-				int qstart = candidates[s].loc2;
-				if (qstart && sstart)
+				volume_t* reference = data->references[r];
+				const int max_offset = seeding_offset_limit(reference, reads, rid);
+				int s;
+				char chain;
+				num_candidates = 0;
+				for (s = 0; s < 2; ++s)
 				{
-					qstart += kmer_size / 2;
-					sstart += kmer_size / 2;
+					if (s%2) { chain = 'R'; read = read2; }
+					else { chain = 'F'; read = read1; }
+					num_candidates = seed_one_strand(reference, data->ridxs[r], sbks[r], read, rsize, 
+												  rid + reads->start_read_id, 
+												  chain, candidates, num_candidates, max_offset);
 				}
-				int ssize = data->reference->offset_list->offset_list[candidates[s].readno - data->reference->start_read_id].size;
+
+				for (s = 0; s < num_candidates; ++s)
+				{
+					if (candidates[s].chain == 'F') read = read1;
+					else read = read2;
+					extract_one_seq(reference, candidates[s].readno - reference->start_read_id, subject);
+					int sstart = candidates[s].loc1;
+					int qstart = candidates[s].loc2;
+					if (qstart && sstart)
+					{
+						qstart += kmer_size / 2;
+						sstart += kmer_size / 2;
+					}
+					int ssize = reference->offset_list->offset_list[candidates[s].readno - reference->start_read_id].size;
 				
-				int flag = aligner->go(read, qstart, rsize, subject, sstart, ssize, min_align_size);
+					int flag = aligner->go(read, qstart, rsize, subject, sstart, ssize, min_align_size);
+					++num_aligned_candidates;
 				
-				if (flag)
-				{
-					fill_m4record(aligner, rid + data->reads->start_read_id, 
-								  candidates[s].readno, candidates[s].chain, 
-								  rsize, ssize, qstart, sstart, candidates[s].score,
-								  m4v + num_m4);
-					++num_m4;
+					if (flag)
+					{
+						++num_alignments;
+						fill_m4record(aligner, rid + reads->start_read_id, 
+									  candidates[s].readno, candidates[s].chain, 
+									  rsize, ssize, qstart, sstart, candidates[s].score,
+									  m4v + num_m4);
+						++num_m4;
+					}
 				}
-			}
 			
-			append_m4v(m4_list, &m4_list_size, m4v, &num_m4, data->out, &data->result_write_lock);
+				append_m4v(m4v, &num_m4, batches[r]);
+			}
 		}
+		submit_result_batches(data, batches);
+		finish_chunk(data, chunk);
 	}
-		
-		if (m4_list_size)
-		{
-			pthread_mutex_lock(&data->result_write_lock);
-			print_m4record_list(data->out, m4_list, m4_list_size);
-			m4_list_size = 0;
-			pthread_mutex_unlock(&data->result_write_lock);
-		}
-		
-		safe_free(read1);
-		safe_free(read2);
-		safe_free(subject);
-		delete sbk;
-		delete aligner;
-		delete[] m4v;
+	
+	metrics_count("reads_processed", num_reads);
+	metrics_count("candidates_aligned", num_aligned_candidates);
+	metrics_count("alignments", num_alignments);
+	metrics_count("chunk_steals", num_steals);
+	
+	safe_free(read1);
+	safe_free(read2);
+	safe_free(subject);
+	report_seeding_counts(sbks);
+	delete aligner;
+	delete[] m4v;
 }
 
 void
@@ -724,97 +1274,90 @@ candidate_detect(PWThreadData* data, int tid)
 	safe_malloc(read1, char, MAX_SEQ_SIZE);
 	safe_malloc(read2, char, MAX_SEQ_SIZE);
 	safe_malloc(subject, char, MAX_SEQ_SIZE);
-	SeedingBK* sbk = new SeedingBK(data->reference->curr);
+	vector<SeedingBK*> sbks(data->num_refs);
+	for (int r = 0; r < data->num_refs; ++r) sbks[r] = new SeedingBK(data->references[r]->curr, seed_binning);
+	vector<ResultBatch*> batches;
 	Candidate candidates[MAXC];
 	int num_candidates = 0;
-	r_assert(data->ec_results);
-	ExtensionCandidate* eclist = data->ec_results[tid];
-	int nec = 0;
 	ExtensionCandidate ec;
+	MetricsStage stage("seed");
+	long long num_reads = 0, num_ec = 0, num_steals = 0;
 
-	int rid, Lid, Rid;
-	while (1)
-	{
-		get_next_chunk_reads(data, Lid, Rid);
-		if (Lid >= data->reads->num_reads) break;
-	for (rid = Lid; rid < Rid; ++rid)
+	int rid, r;
+	ReadChunk chunk;
+	while (get_next_chunk(data, tid, chunk, num_steals))
 	{
-		int rsize = data->reads->offset_list->offset_list[rid].size;
-        if (rsize >= MAX_SEQ_SIZE) {
-            cout << "rsize = " << rsize << "\t" << MAX_SEQ_SIZE << endl;
-            abort();
-        }
-		extract_one_seq(data->reads, rid, read1);
-		reverse_complement(read2, read1, rsize);
-		int s;
-		int chain;
-		num_candidates = 0;
-		for (s = 0; s < 2; ++s)
-		{
-			if (s%2) { chain = REV; read = read2; }
-			else { chain = FWD; read = read1; }
-			int num_segs = seeding(read, rsize, data->ridx, sbk);
-			num_candidates = get_candidates(data->reference, 
-											sbk, 
-											num_segs, 
-											rid + data->reads->start_read_id, 
-											rsize, 
-											chain, 
-											candidates, 
-											num_candidates); 
-		}
-		
-		for (s = 0; s < num_candidates; ++s)
+		volume_t* reads = chunk.vol->reads;
+		new_result_batches(data, chunk, batches);
+		num_reads += chunk.Rid - chunk.Lid;
+		for (rid = chunk.Lid; rid < chunk.Rid; ++rid)
 		{
-			int qstart = candidates[s].loc2;
-			int sstart = candidates[s].loc1;
-			if (qstart && sstart)
-			{
-				qstart += kmer_size / 2;
-				sstart += kmer_size / 2;
+			int rsize = reads->offset_list->offset_list[rid].size;
+			if (rsize >= MAX_SEQ_SIZE) {
+				cout << "rsize = " << rsize << "\t" << MAX_SEQ_SIZE << endl;
+				abort();
 			}
-			int qdir = candidates[s].chain;
-			int sdir = FWD;
-			int qid = rid + data->reads->start_read_id;
-			int sid = candidates[s].readno;
-			int score = candidates[s].score;
-			
-			ec.qid = qid;
-			ec.qdir = qdir;
-			ec.qext = qstart;
-			ec.sid = sid;
-			ec.sdir = sdir;
-			ec.sext = sstart;
-			ec.score = score;
-			ec.qsize = rsize;
-			ec.ssize = data->reference->offset_list->offset_list[sid - data->reference->start_read_id].size;
-            if (ec.qdir == REV) ec.qext = ec.qsize - 1 - ec.qext;
-            if (ec.sdir == REV) ec.sext = ec.ssize - 1 - ec.sext;
-			eclist[nec] = ec;
-			++nec;
-			if (nec == PWThreadData::kResultListSize)
+			extract_one_seq(reads, rid, read1);
+			extract_one_seq_rc(reads, rid, read2);
+			for (r = 0; r < data->num_refs && data->ref_vids[r] <= chunk.vol->vid; ++r)
 			{
-				pthread_mutex_lock(&data->result_write_lock);
-				for (int i = 0; i < nec; ++i) (*data->out) << eclist[i];
-				nec = 0;
-				pthread_mutex_unlock(&data->result_write_lock);
+				volume_t* reference = data->references[r];
+				const int max_offset = seeding_offset_limit(reference, reads, rid);
+				int s;
+				int chain;
+				num_candidates = 0;
+				for (s = 0; s < 2; ++s)
+				{
+					if (s%2) { chain = REV; read = read2; }
+					else { chain = FWD; read = read1; }
+					num_candidates = seed_one_strand(reference, data->ridxs[r], sbks[r], read, rsize, 
+												  rid + reads->start_read_id, 
+												  chain, candidates, num_candidates, max_offset);
+				}
+		
+				for (s = 0; s < num_candidates; ++s)
+				{
+					int qstart = candidates[s].loc2;
+					int sstart = candidates[s].loc1;
+					if (qstart && sstart)
+					{
+						qstart += kmer_size / 2;
+						sstart += kmer_size / 2;
+					}
+					int qdir = candidates[s].chain;
+					int sdir = FWD;
+					int qid = rid + reads->start_read_id;
+					int sid = candidates[s].readno;
+					int score = candidates[s].score;
+			
+					ec.qid = qid;
+					ec.qdir = qdir;
+					ec.qext = qstart;
+					ec.sid = sid;
+					ec.sdir = sdir;
+					ec.sext = sstart;
+					ec.score = score;
+					ec.qsize = rsize;
+					ec.ssize = reference->offset_list->offset_list[sid - reference->start_read_id].size;
+					if (ec.qdir == REV) ec.qext = ec.qsize - 1 - ec.qext;
+					if (ec.sdir == REV) ec.sext = ec.ssize - 1 - ec.sext;
+					add_candidate(batches[r], ec);
+					++num_ec;
+				}
 			}
 		}
-	}
+		submit_result_batches(data, batches);
+		finish_chunk(data, chunk);
 	}
 	
-	if (nec)
-	{
-		pthread_mutex_lock(&data->result_write_lock);
-		for (int i = 0; i < nec; ++i) (*data->out) << eclist[i];
-		nec = 0;
-		pthread_mutex_unlock(&data->result_write_lock);
-	}
+	metrics_count("reads_processed", num_reads);
+	metrics_count("candidates", num_ec);
+	metrics_count("chunk_steals", num_steals);
 	
 	safe_free(read1);
 	safe_free(read2);
 	safe_free(subject);
-	delete sbk;
+	report_seeding_counts(sbks);
 }
 
 void*
@@ -833,12 +1376,18 @@ multi_thread_func(void* p)
 }
 
 void
-process_one_volume(options_t* options, const int svid, const int evid, volume_names_t* vn, ostream* out)
+process_one_volume(options_t* options, const int* ref_vids, const int num_refs, const int first_read_vid, const int evid, volume_names_t* vn, ostream** outs)
 {
 	MAXC = options->num_candidates;
 	output_gapped_start_point = options->output_gapped_start_point;
+	output_binary = options->output_binary;
 	min_align_size = options->min_align_size;
 	min_kmer_match = options->min_kmer_match;
+	minimizer_window = options->minimizer_window;
+	seed_binning = options->seed_binning;
+	chain_scoring = options->chain_scoring;
+	prune_diagonal = options->prune_diagonal;
+	seed_stride = minimizer_window ? 1 : BC;
 	
 	if (options->tech == TECH_PACBIO) {
 		ddfs_cutoff = ddfs_cutoff_pacbio;
@@ -849,34 +1398,122 @@ process_one_volume(options_t* options, const int svid, const int evid, volume_na
 	} else {
 		ERROR("TECH must be either %d or %d", TECH_PACBIO, TECH_NANOPORE);
 	}
+	ddfs_num = (int)(ddfs_cutoff * kDdfsDen + 0.5);
 	
-	const char* ref_name = get_vol_name(vn, svid);
-	volume_t* ref = load_volume(ref_name);
-	ref_index* ridx = create_ref_index(ref, kmer_size, options->num_threads);
+	const int svid = first_read_vid;
+	r_assert(svid >= ref_vids[0]);
+	repeat_mask_t* mask = NULL;
+	if (options->repeat_mask)
+	{
+		mask = load_repeat_mask(options->repeat_mask);
+		if (mask->kmer_size != kmer_size)
+			ERROR("repeat mask \'%s\' holds %d-mers, but %d-mers are indexed", options->repeat_mask, mask->kmer_size, kmer_size);
+	}
+	vector<volume_t*> refs(num_refs);
+	vector<ref_index*> ridxs(num_refs);
+	for (int r = 0; r < num_refs; ++r)
+	{
+		r_assert(r == 0 || ref_vids[r] > ref_vids[r - 1]);
+		const char* ref_name = get_vol_name(vn, ref_vids[r]);
+		MetricsStage stage("load_reference");
+		refs[r] = load_volume(ref_name);
+		ridxs[r] = load_or_create_ref_index(ref_name, refs[r], kmer_size, minimizer_window, mask, options->num_threads);
+	}
+	char volume_process_info[1024];
+	sprintf(volume_process_info, "process volumes %d - %d against %d reference volume(s)", svid, evid - 1, num_refs);
+	DynamicTimer dtimer(volume_process_info);
+	PWThreadData* data = new PWThreadData(options, num_refs, ref_vids, refs.data(), ridxs.data(), outs);
 	pthread_t tids[options->num_threads];
-	char volume_process_info[1024];;
 	int vid, tid;
-	for(vid = svid; vid < evid; ++vid)
+	for (tid = 0; tid < options->num_threads; ++tid)
+	{
+		int err_code = pthread_create(tids + tid, NULL, multi_thread_func, (void*)data);
+		if (err_code)
+		{
+			LOG(stderr, "Error: return code is %d\n", err_code);
+			abort();
+		}
+	}
+	
+	deque<PWReadVolume*> volumes;
+	for (vid = svid; vid <= evid; ++vid)
 	{
-		sprintf(volume_process_info, "process volume %d", vid);
-		DynamicTimer dtimer(volume_process_info);
+		pthread_mutex_lock(&data->work_lock);
+		while (!volumes.empty() && (vid == evid || (int)volumes.size() >= kMaxReadVolumesInMemory))
+		{
+			while (!volumes.front()->finished) pthread_cond_wait(&data->volume_done_cond, &data->work_lock);
+			PWReadVolume* vol = volumes.front();
+			volumes.pop_front();
+			pthread_mutex_unlock(&data->work_lock);
+			LOG(stderr, "volume %d is finished\n", vol->vid);
+			metrics_count("read_volumes_mapped", 1);
+			vol->reads = delete_volume_t(vol->reads);
+			delete vol;
+			pthread_mutex_lock(&data->work_lock);
+		}
+		if (vid == evid) data->no_more_volumes = true;
+		pthread_cond_broadcast(&data->work_cond);
+		pthread_mutex_unlock(&data->work_lock);
+		if (vid == evid) break;
+		
 		const char* read_name = get_vol_name(vn, vid);
 		LOG(stderr, "processing %s\n", read_name);
-		volume_t* read = load_volume(read_name);
-		PWThreadData* data = new PWThreadData(options, ref, read, ridx, out);
-		for (tid = 0; tid < options->num_threads; ++tid)
+		PWReadVolume* vol = new PWReadVolume;
+		vol->vid = vid;
 		{
-			int err_code = pthread_create(tids + tid, NULL, multi_thread_func, (void*)data);
-			if (err_code)
-			{
-				LOG(stderr, "Error: return code is %d\n", err_code);
-				abort();
-			}
+			MetricsStage stage("load_volume");
+			vol->reads = load_volume(read_name);
 		}
-		for (tid = 0; tid < options->num_threads; ++tid) pthread_join(tids[tid], NULL);
-		read = delete_volume_t(read);
-		delete data;
+		volumes.push_back(vol);
+		queue_read_volume(data, vol);
 	}
-	ref = delete_volume_t(ref);
-	ridx = destroy_ref_index(ridx);
+	for (tid = 0; tid < options->num_threads; ++tid) pthread_join(tids[tid], NULL);
+	delete data;
+	for (int r = 0; r < num_refs; ++r)
+	{
+		refs[r] = delete_volume_t(refs[r]);
+		ridxs[r] = destroy_ref_index(ridxs[r]);
+	}
+	if (mask) mask = destroy_repeat_mask(mask);
+}
+
+// a volume of num_bases bases, with reads of kPlanReadSize bases
+static idx_t
+plan_volume_bytes(const idx_t num_bases)
+{
+	return num_bases / 4 + num_bases / kPlanReadSize * (idx_t)sizeof(offset_t);
+}
+
+static void
+add_mem_item(vector<mem_item_t>& items, const char* name, const idx_t bytes, const int per_thread)
+{
+	mem_item_t item;
+	item.name = name;
+	item.bytes = bytes;
+	item.per_thread = per_thread;
+	items.push_back(item);
+}
+
+void
+pw_memory_items(const options_t* options, const idx_t volume_bases, vector<mem_item_t>& items)
+{
+	const idx_t num_refs = options->ref_batch;
+	items.clear();
+	add_mem_item(items, "reference volumes", num_refs * plan_volume_bytes(volume_bases), 0);
+	// the index holds 4 bytes per position and 8 per distinct k-mer; create_ref_index() keeps
+	// one bucket table and builds with three more, of about one bucket per 16 bases
+	const idx_t num_positions = options->minimizer_window ? 2 * volume_bases / (options->minimizer_window + 1) : volume_bases;
+	const idx_t num_kmers = min(num_positions, (idx_t)1 << (2 * kmer_size));
+	idx_t num_buckets = 256;
+	while (num_buckets < (1 << 24) && num_buckets * 16 < volume_bases) num_buckets *= 2;
+	add_mem_item(items, "k-mer indices", num_refs * (4 * num_positions + 8 * num_kmers + 16 * num_buckets), 0);
+	struct stat st;
+	if (options->repeat_mask && stat(options->repeat_mask, &st) == 0) add_mem_item(items, "repeat mask", st.st_size, 0);
+	add_mem_item(items, "read volumes", kMaxReadVolumesInMemory * plan_volume_bytes(volume_bases), 0);
+
+	add_mem_item(items, "read buffers", 3 * MSS, 1);
+	idx_t seeding_bytes = sizeof(int) * MAX_SEQ_SIZE;
+	if (!options->seed_binning) seeding_bytes += (volume_bases / ZV + 5) * (sizeof(Back_List) + sizeof(int) + sizeof(short));
+	add_mem_item(items, "seeding tables", num_refs * seeding_bytes, 1);
+	if (options->task == TASK_ALN) add_mem_item(items, "alignment workspace", kPlanAlignerBytes, 1);
 }
@@ -1,18 +1,22 @@
 #ifndef PW_IMPL_H
 #define PW_IMPL_H
 
+#include <deque>
 #include <iostream>
+#include <vector>
 
 #include "../common/alignment.h"
 #include "../common/packed_db.h"
 #include "../common/lookup_table.h"
+#include "../common/mem_budget.h"
+#include "pw_writer.h"
 
 #define RM 			100000
 #define DN 			500
 #define BC 			10
 #define SM 			40
 #define SI 			41
-#define CHUNK_SIZE 	500
+#define CHUNK_BASES 	5000000
 #define ZV 			2000
 #define MUL_ZV(a) 	((a)*ZV)
 #define DIV_ZV(a) 	((a)/ZV)
@@ -26,44 +30,158 @@ struct candidate_save
 
 typedef candidate_save Candidate;
 
+// seedno and seednum are query positions in units of the seed stride, which is 1 with minimizer seeding
 struct Back_List
 {
-    short score,loczhi[SM],seedno[SM],seednum;
+    short score,loczhi[SM];
+    int seedno[SM],seednum;
     int index;
 };
 
+// a read volume being mapped against the reference
+struct PWReadVolume
+{
+	int						vid;
+	volume_t*				reads;
+	int						num_pending_chunks;
+	bool					finished;
+};
+
+// the reads [Lid, Rid) of a read volume
+struct ReadChunk
+{
+	PWReadVolume*			vol;
+	int						Lid, Rid;
+	idx_t					seq;	// chunks are numbered in the order of their query ids
+};
+
+// the chunks queued for one worker. the owner takes from the front, thieves from the back.
+struct ChunkDeque
+{
+	pthread_mutex_t			lock;
+	std::deque<ReadChunk>	chunks;
+};
+
+/* the worker pool of one reference volume.
+ *
+ * the threads live as long as the reference is loaded. the read volumes are loaded one ahead
+ * by the calling thread and cut into chunks of about equal number of bases, which are dealt
+ * round robin to the deques of the workers. a worker whose deque runs dry steals from the
+ * others, so the tail of a volume is shared by all threads and the next volume is started
+ * while the last chunks of the previous one are still being mapped. the results of a chunk
+ * go to the writer as one batch, numbered by the position of the chunk.
+ */
 struct PWThreadData
 {
 	options_t*				options;
 	int 					used_thread_id;
 	pthread_mutex_t 		id_lock;
-	volume_t* 				reference;
-	volume_t* 				reads;
-	ref_index* 				ridx;
-	std::ostream*			out;	
-	M4Record** 				m4_results;
-	ExtensionCandidate**	ec_results;
-	static const int		kResultListSize = 10000;
-	pthread_mutex_t			result_write_lock;
-	int						next_processed_id;
-	pthread_mutex_t			read_retrieve_lock;
+	// the reference volumes mapped in the same pass over the reads, by increasing volume id,
+	// with their indices and writers. a read volume is mapped against those up to its own id.
+	int						num_refs;
+	const int*				ref_vids;
+	volume_t**				references;
+	ref_index**				ridxs;
+	ResultWriter**			writers;
 	
-	PWThreadData(options_t* opt, volume_t* ref, volume_t* rd, ref_index* idx, std::ostream* o);
+	ChunkDeque*				deques;
+	// guards everything below
+	pthread_mutex_t			work_lock;
+	pthread_cond_t			work_cond;			// a chunk is queued or no more will be
+	pthread_cond_t			volume_done_cond;	// a read volume is finished
+	int						num_queued_chunks;
+	idx_t					num_chunks;
+	int						next_deque;
+	bool					no_more_volumes;
+	
+	PWThreadData(options_t* opt, const int nrefs, const int* rvids, volume_t** refs, ref_index** idxs, std::ostream** outs);
 	~PWThreadData();
 };
 
+// the segment table of seeding(): one Back_List per ZV bases of the reference, indexed by segment id
+struct DenseSegmentTable
+{
+	Back_List* database;
+
+	DenseSegmentTable(Back_List* db) : database(db) {}
+	Back_List* seg(const int id) { return database + id; }
+	// resets the segments seeding() touched
+	void clear(const int* index_list, const int num_segs);
+};
+
+/* the segment table of bin_seeds(): only the segments hit by the current query strand.
+ *
+ * the k-mer hits of the query are collected as (segment, seed number, offset) in query order,
+ * radix sorted by segment and replayed segment by segment into Back_Lists. the result is what
+ * seeding() leaves in the dense table, but the memory follows the number of hits of the read
+ * instead of the size of the reference.
+ */
+struct SeedBins
+{
+	struct Hit
+	{
+		uint32_t	seg;
+		int			seedn;
+		int			off;
+		int			time;		// index of the hit in query order
+	};
+	// the score of a segment after it accepted the hit of the given time
+	struct Event
+	{
+		int			time;
+		int			score;
+	};
+	struct Segment
+	{
+		int			seg;
+		int			first_time;
+		int			last_time;
+		int			ev_begin;
+		int			ev_end;
+		Back_List	bl;
+	};
+
+	std::vector<Hit>		hits;
+	std::vector<Hit>		sorted_hits;
+	std::vector<Event>		events;
+	std::vector<Segment>	segments;		// sorted by seg
+	std::vector<std::pair<int, int> >	first_touch;	// (first_time, index into segments)
+	std::vector<int>		index_list;		// storage of SeedingBK::index_list and index_score
+	std::vector<short>		index_score;
+
+	// NULL for a segment without hits, which reads as a Back_List of score 0
+	Back_List* seg(const int id);
+	void clear(const int*, const int) {}
+};
+
 struct SeedingBK
 {
 	int* index_list;
 	short* index_score;
 	Back_List* database;
 	int* kmer_ids;
+	// minimizer seeding: all k-mers of the query, the positions of the selected ones and scratch space
+	std::vector<uint32_t> kmers;
+	std::vector<int> kmer_pos;
+	std::vector<int> work;
+	long long num_lookups;
+	long long num_hits;
+	long long num_pruned;
+	// with seed binning the dense database is not allocated
+	bool binned;
+	SeedBins bins;
 	
-	SeedingBK(const int ref_size);
+	SeedingBK(const int ref_size, const bool binned);
 	~SeedingBK();
 };
 
+// maps the read volumes first_read_vid .. evid - 1 against the reference volumes ref_vids,
+// the results of ref_vids[r] go to outs[r]. first_read_vid must not be less than ref_vids[0].
+void
+process_one_volume(options_t* options, const int* ref_vids, const int num_refs, const int first_read_vid, const int evid, volume_names_t* vn, std::ostream** outs);
+
+// the estimated memory of process_one_volume() with volumes of at most volume_bases bases
 void
-process_one_volume(options_t* options, const int svid, const int evid, volume_names_t* vn, std::ostream* out);
+pw_memory_items(const options_t* options, const idx_t volume_bases, std::vector<mem_item_t>& items);
 
 #endif // PW_IMPL_H
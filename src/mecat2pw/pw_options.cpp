@@ -1,5 +1,8 @@
 #include "pw_options.h"
+#include "../common/mem_budget.h"
+#include "../common/split_database.h"
 
+#include <getopt.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
@@ -23,7 +26,17 @@ print_options(options_t* options)
 	LOG(stderr, "# of candidates\t%d", options->num_candidates);
 	LOG(stderr, "min align size\t%d", options->min_align_size);
 	LOG(stderr, "min block score\t%d", options->min_kmer_match);
+	LOG(stderr, "minimizer window\t%d", options->minimizer_window);
+	LOG(stderr, "seed binning\t%c", options->seed_binning ? 'Y' : 'N');
+	LOG(stderr, "seed scorer\t%s", options->chain_scoring ? "chain" : "pairwise");
 	LOG(stderr, "output gapped start\t%c", options->output_gapped_start_point ? 'Y' : 'N'); 
+	LOG(stderr, "binary output\t%c", options->output_binary ? 'Y' : 'N');
+	LOG(stderr, "ordered output\t%c", options->ordered_output ? 'Y' : 'N');
+	LOG(stderr, "prune diagonal\t%c", options->prune_diagonal ? 'Y' : 'N');
+	LOG(stderr, "reference batch\t%d", options->ref_batch);
+	if (options->num_shards) LOG(stderr, "shard\t\t%d/%d", options->shard_index, options->num_shards);
+	if (options->repeat_mask) LOG(stderr, "repeat mask\t%s", options->repeat_mask);
+	if (options->mem_budget) LOG(stderr, "memory budget\t%lld", (long long)options->mem_budget);
 	///LOG(stderr, "tech\t%d", options->tech);
 }
 
@@ -37,7 +50,18 @@ init_options(options_t* options, int tech)
     options->wrk_dir = NULL;
     options->num_threads = 1;
     options->num_candidates = 100;
+	options->minimizer_window = 0;
+	options->seed_binning = 0;
+	options->chain_scoring = 0;
     options->output_gapped_start_point = 0;
+	options->output_binary = 0;
+	options->ordered_output = 1;
+	options->prune_diagonal = 0;
+	options->ref_batch = 1;
+	options->shard_index = 0;
+	options->num_shards = 0;
+	options->repeat_mask = NULL;
+	options->mem_budget = 0;
 	options->tech = tech;
 	
 	if (tech == TECH_PACBIO) {
@@ -53,7 +77,10 @@ void print_usage(const char* prog)
 {
 	fprintf(stderr, "\n\n");
 	fprintf(stderr, "usage:\n");
-	fprintf(stderr, "%s [-j task] [-d dataset] [-o output] [-w working dir] [-t threads] [-n candidates] [-g 0/1]", prog);
+	fprintf(stderr, "%s [-j task] [-d dataset] [-o output] [-w working dir] [-t threads] [-n candidates] [-g 0/1] [-b 0/1] [-q 0/1] [-m window] [-s 0/1] [-c 0/1] [-p 0/1] [--ref-batch K] [--shard i/N] [--repeat-mask file] [--mem-budget size] [--metrics-json path]", prog);
+	fprintf(stderr, "\n%s split -d dataset -w working dir [-t threads] [-M size]", prog);
+	fprintf(stderr, "\n%s merge -w working dir -o output", prog);
+	fprintf(stderr, "\n%s mask -w working dir -o mask file -G genome size [-f factor] [-n count] [-s MB] [-t threads]", prog);
 	fprintf(stderr, "\n\n");
 	fprintf(stderr, "options:\n");
 	fprintf(stderr, "-j <integer>\tjob: %d = seeding, %d = align\n\t\tdefault: %d\n", TASK_SEED, TASK_ALN, TASK_ALN);
@@ -67,6 +94,17 @@ void print_usage(const char* prog)
 	fprintf(stderr, "-k <integer>\tminimum number of kmer match a matched block has\n\t\t");
 	fprintf(stderr, "Default: %d\n", kDefaultKmerMatchPacbio);
 	fprintf(stderr, "-g <0/1>\twhether print gapped extension start point, 0 = no, 1 = yes\n\t\tDefault: 0\n");
+	fprintf(stderr, "-m <integer>\tminimizer window w: index and query only the (w,k)-minimizers\n\t\t0 = index every k-mer and query k-mers at a fixed stride\n\t\tDefault: 0\n");
+	fprintf(stderr, "-s <0/1>\tseed binning: 1 = sort the k-mer hits of every read by reference segment instead of\n\t\tscattering them into a per-thread table of the whole volume, same candidates, less memory\n\t\tDefault: 0\n");
+	fprintf(stderr, "-c <0/1>\tseed scorer: 0 = pairwise floating point tests, 1 = integer diagonal drift chaining,\n\t\tsame candidates\n\t\tDefault: 0\n");
+	fprintf(stderr, "-p <0/1>\tprune the diagonal volume pair: a pair of reads is reported once, with the larger id as\n\t\tthe query, 1 = skip the k-mer hits in reads after the query instead of scoring and dropping them\n\t\tDefault: 0\n");
+	fprintf(stderr, "-b <0/1>\toutput format, 0 = text, 1 = binary record stream (see mecat2conv)\n\t\tDefault: 0\n");
+	fprintf(stderr, "-q <0/1>\twrite the results in the order of the query ids, so that the output does not depend on\n\t\tthe number of threads, 0 = in the order they are computed\n\t\tDefault: 1\n");
+	fprintf(stderr, "--ref-batch <integer>\tindex K reference volumes together and map every read volume against them\n\t\tin one pass, the reads are loaded once per K reference volumes, K times the index memory\n\t\tDefault: 1\n");
+	fprintf(stderr, "--shard <i/N>\trun the i-th (0-based) of N equal parts of the volume pairs and list the results in a\n\t\tmanifest in the working folder instead of writing the output. the reads must be split\n\t\tbefore with 'split', 'merge' checks the manifests of all N shards and writes the output\n");
+	fprintf(stderr, "--repeat-mask <string>\tleave the k-mers of this repeat mask (see 'mask') out of the k-mer index\n");
+	fprintf(stderr, "--mem-budget <size>\tmemory of the run, e.g. 64G: the volumes are made as large as the budget allows\n\t\tfor -t threads (at most %lld bases) and the threads are reduced if even small volumes do not\n\t\tfit. the plan is printed at startup\n", (long long)MCS);
+	fprintf(stderr, "--metrics-json <string>\twrite timings, counters and resource usage of the run to this file\n");
 	///fprintf(stderr, "-x <0/x>\tsequencing technology: 0 = pacbio, 1 = nanopore\n\t\tDefault: 0\n");
 }
 
@@ -87,9 +125,30 @@ parse_arguments(int argc, char* argv[], options_t* options)
 	int min_align_size = -1;
 	int min_kmer_match = -1;
 	int output_gapped_start_point = -1;
+	int output_binary = -1;
+	int ordered_output = -1;
+	int prune_diagonal = -1;
+	int ref_batch = -1;
+	int minimizer_window = -1;
+	int seed_binning = -1;
+	int chain_scoring = -1;
 	int tech = TECH_PACBIO;
     
-    while((opt_char = getopt(argc, argv, "j:d:o:w:t:n:g:a:k:")) != -1)
+	int shard_index = 0;
+	int num_shards = 0;
+	char shard_sep;
+	const char* repeat_mask = NULL;
+	int64_t mem_budget = 0;
+	
+	enum { kOptRefBatch = 256, kOptShard, kOptRepeatMask, kOptMemBudget };
+	static struct option long_options[] = {
+		{ "ref-batch", required_argument, NULL, kOptRefBatch },
+		{ "shard", required_argument, NULL, kOptShard },
+		{ "repeat-mask", required_argument, NULL, kOptRepeatMask },
+		{ "mem-budget", required_argument, NULL, kOptMemBudget },
+		{ NULL, 0, NULL, 0 }
+	};
+    while((opt_char = getopt_long(argc, argv, "j:d:o:w:t:n:g:a:k:b:m:s:c:q:p:", long_options, NULL)) != -1)
     {
         switch(opt_char)
         {
@@ -117,6 +176,31 @@ parse_arguments(int argc, char* argv[], options_t* options)
 			case 'k':
 				min_kmer_match = atoi(optarg);
 				break;
+			case 'm':
+				minimizer_window = atoi(optarg);
+				break;
+            case 's':
+                if (optarg[0] == '0') 
+                    seed_binning = 0;
+                else if (optarg[0] == '1')
+                    seed_binning = 1;
+                else
+                {
+                    LOG(stderr, "argument to option \'-s\' must be either \'0\' or \'1\'");
+                    return 1;
+                }
+                break;
+            case 'c':
+                if (optarg[0] == '0') 
+                    chain_scoring = 0;
+                else if (optarg[0] == '1')
+                    chain_scoring = 1;
+                else
+                {
+                    LOG(stderr, "argument to option \'-c\' must be either \'0\' or \'1\'");
+                    return 1;
+                }
+                break;
             case 'g':
                 if (optarg[0] == '0') 
                     output_gapped_start_point = 0;
@@ -128,6 +212,61 @@ parse_arguments(int argc, char* argv[], options_t* options)
                     return 1;
                 }
                 break;
+            case 'b':
+                if (optarg[0] == '0') 
+                    output_binary = 0;
+                else if (optarg[0] == '1')
+                    output_binary = 1;
+                else
+                {
+                    LOG(stderr, "argument to option \'-b\' must be either \'0\' or \'1\'");
+                    return 1;
+                }
+                break;
+            case 'q':
+                if (optarg[0] == '0') 
+                    ordered_output = 0;
+                else if (optarg[0] == '1')
+                    ordered_output = 1;
+                else
+                {
+                    LOG(stderr, "argument to option \'-q\' must be either \'0\' or \'1\'");
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (optarg[0] == '0') 
+                    prune_diagonal = 0;
+                else if (optarg[0] == '1')
+                    prune_diagonal = 1;
+                else
+                {
+                    LOG(stderr, "argument to option \'-p\' must be either \'0\' or \'1\'");
+                    return 1;
+                }
+                break;
+			case kOptRefBatch:
+				ref_batch = atoi(optarg);
+				break;
+			case kOptShard:
+				if (sscanf(optarg, "%d/%d%c", &shard_index, &num_shards, &shard_sep) != 2
+					|| num_shards < 1 || shard_index < 0 || shard_index >= num_shards)
+				{
+					LOG(stderr, "argument to option '--shard' must be i/N with 0 <= i < N, not '%s'", optarg);
+					return 1;
+				}
+				break;
+			case kOptRepeatMask:
+				repeat_mask = optarg;
+				break;
+			case kOptMemBudget:
+				mem_budget = parse_mem_size(optarg);
+				if (mem_budget <= 0)
+				{
+					LOG(stderr, "argument to option '--mem-budget' must be a size such as 64G, not '%s'", optarg);
+					return 1;
+				}
+				break;
 			case 'x':
 				if (optarg[0] == '0') {
 					tech = TECH_PACBIO;
@@ -160,6 +299,17 @@ parse_arguments(int argc, char* argv[], options_t* options)
 	if (min_align_size != -1) options->min_align_size = min_align_size;
 	if (min_kmer_match != -1) options->min_kmer_match = min_kmer_match;
 	if (output_gapped_start_point != -1) options->output_gapped_start_point = output_gapped_start_point;
+	if (output_binary != -1) options->output_binary = output_binary;
+	if (ordered_output != -1) options->ordered_output = ordered_output;
+	if (prune_diagonal != -1) options->prune_diagonal = prune_diagonal;
+	if (ref_batch != -1) options->ref_batch = ref_batch;
+	if (minimizer_window != -1) options->minimizer_window = minimizer_window;
+	if (seed_binning != -1) options->seed_binning = seed_binning;
+	if (chain_scoring != -1) options->chain_scoring = chain_scoring;
+	options->shard_index = shard_index;
+	options->num_shards = num_shards;
+	options->repeat_mask = repeat_mask;
+	options->mem_budget = mem_budget;
 	
 	if (options->task != TASK_SEED && options->task != TASK_ALN)
 	{
@@ -167,12 +317,13 @@ parse_arguments(int argc, char* argv[], options_t* options)
 		ret = 1;
 	}
 
-    if (!options->reads)
+    // a shard maps the volumes in the working folder and leaves the output to 'merge'
+    if (!options->reads && !options->num_shards)
     {
         LOG(stderr, "dataset must be specified.");
         ret = 1;
     }
-    else if (!options->output)
+    else if (!options->output && !options->num_shards)
     {
         LOG(stderr, "output must be specified.");
         ret = 1;
@@ -192,6 +343,16 @@ parse_arguments(int argc, char* argv[], options_t* options)
         LOG(stderr, "number of candidates must be > 0.");
         ret = 1;
     }
+    else if (options->minimizer_window < 0)
+    {
+        LOG(stderr, "minimizer window must be >= 0.");
+        ret = 1;
+    }
+    else if (options->ref_batch < 1)
+    {
+        LOG(stderr, "reference batch size must be > 0.");
+        ret = 1;
+    }
 
     if (ret) return ret;
 
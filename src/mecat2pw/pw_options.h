@@ -16,7 +16,18 @@ typedef struct
     int         num_candidates;
 	int			min_align_size;
 	int			min_kmer_match;
+	int			minimizer_window;
+	int			seed_binning;
+	int			chain_scoring;
+	int			ordered_output;
+	int			prune_diagonal;
+	int			ref_batch;
+	int			shard_index;
+	int			num_shards;		// 0 = the whole run
+	const char*	repeat_mask;	// NULL = no global repeat mask
+	int64_t		mem_budget;		// bytes, 0 = no budget
     int         output_gapped_start_point;
+	int			output_binary;
 	int 		tech;
 } options_t;
 
@@ -24,7 +35,7 @@ void
 print_options(options_t* options);
 
 void
-init_options(options_t* options);
+init_options(options_t* options, int tech);
 
 int
 parse_arguments(int argc, char* argv[], options_t* options);
@@ -0,0 +1,311 @@
+#include "pw_shard.h"
+
+#include "../common/metrics.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+using namespace std;
+
+static const char* kManifestMagic = "mecat2pw-shard-manifest";
+static const int kManifestVersion = 1;
+
+static string
+wrk_file_name(const char* wrk_dir, const string& name)
+{
+	string path = wrk_dir;
+	if (path[path.size() - 1] != '/') path += '/';
+	return path + name;
+}
+
+static string
+manifest_file_name(const int shard, const int num_shards)
+{
+	ostringstream os;
+	os << "shard_" << shard << "_of_" << num_shards << ".manifest";
+	return os.str();
+}
+
+void
+plan_shard(const int num_vols, const int shard, const int num_shards, vector<ShardPiece>& pieces)
+{
+	r_assert(shard >= 0 && shard < num_shards);
+	pieces.clear();
+	const long long num_pairs = (long long)num_vols * (num_vols + 1) / 2;
+	const long long first = num_pairs * shard / num_shards;
+	const long long last = num_pairs * (shard + 1) / num_shards;
+	long long pair = 0;
+	for (int ref = 0; ref < num_vols && pair < last; ++ref)
+	{
+		// the pairs (ref, ref) .. (ref, num_vols - 1) are [pair, pair + num_vols - ref)
+		const long long n = num_vols - ref;
+		const long long from = max(first, pair), to = min(last, pair + n);
+		if (from < to)
+		{
+			ShardPiece p;
+			p.ref_vid = ref;
+			p.first_read_vid = ref + (from - pair);
+			p.end_read_vid = ref + (to - pair);
+			shard_piece_file_name(p, p.file);
+			p.bytes = -1;
+			pieces.push_back(p);
+		}
+		pair += n;
+	}
+}
+
+void
+shard_piece_file_name(const ShardPiece& piece, string& name)
+{
+	ostringstream os;
+	os << "p_" << piece.ref_vid << "_" << piece.first_read_vid << "_" << piece.end_read_vid;
+	name = os.str();
+}
+
+static long long
+file_size(const string& path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st)) return -1;
+	return st.st_size;
+}
+
+void
+write_shard_manifest(const options_t* options, const int num_vols, vector<ShardPiece>& pieces)
+{
+	const string name = wrk_file_name(options->wrk_dir, manifest_file_name(options->shard_index, options->num_shards));
+	const string working = name + ".working";
+	ofstream out;
+	open_fstream(out, working.c_str(), ios::out);
+	out << kManifestMagic << "\t" << kManifestVersion << "\n";
+	out << "shard\t" << options->shard_index << "\t" << options->num_shards << "\n";
+	out << "volumes\t" << num_vols << "\n";
+	out << "task\t" << options->task << "\n";
+	out << "binary\t" << options->output_binary << "\n";
+	for (size_t i = 0; i < pieces.size(); ++i)
+	{
+		ShardPiece& p = pieces[i];
+		p.bytes = file_size(wrk_file_name(options->wrk_dir, p.file));
+		if (p.bytes < 0) ERROR("result file \'%s\' of shard %d/%d is missing", p.file.c_str(), options->shard_index, options->num_shards);
+		out << "piece\t" << p.ref_vid << "\t" << p.first_read_vid << "\t" << p.end_read_vid << "\t" << p.file << "\t" << p.bytes << "\n";
+	}
+	close_fstream(out);
+	if (rename(working.c_str(), name.c_str()))
+		ERROR("cannot rename \'%s\' to \'%s\': %s", working.c_str(), name.c_str(), strerror(errno));
+	LOG(stderr, "shard %d/%d is finished, %d pieces listed in %s", options->shard_index, options->num_shards, (int)pieces.size(), name.c_str());
+}
+
+// copies the rest of in_fd to out_fd: copy_file_range, then sendfile, then read and write
+static void
+copy_fd(const int in_fd, const int out_fd, const char* in_name)
+{
+	bool use_copy_file_range = true, use_sendfile = true;
+	while (1)
+	{
+		ssize_t n = -1;
+		if (use_copy_file_range)
+		{
+			n = copy_file_range(in_fd, NULL, out_fd, NULL, 1 << 30, 0);
+			if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF))
+			{
+				use_copy_file_range = false;
+				continue;
+			}
+		}
+		else if (use_sendfile)
+		{
+			n = sendfile(out_fd, in_fd, NULL, 1 << 30);
+			if (n < 0 && (errno == ENOSYS || errno == EINVAL))
+			{
+				use_sendfile = false;
+				continue;
+			}
+		}
+		else
+		{
+			char buf[1 << 16];
+			n = read(in_fd, buf, sizeof(buf));
+			for (ssize_t done = 0; n > 0 && done < n; )
+			{
+				ssize_t w = write(out_fd, buf + done, n - done);
+				if (w < 0 && errno == EINTR) continue;
+				if (w < 0) ERROR("write failed while copying \'%s\': %s", in_name, strerror(errno));
+				done += w;
+			}
+		}
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) ERROR("cannot copy \'%s\': %s", in_name, strerror(errno));
+		if (n == 0) break;
+	}
+}
+
+void
+concatenate_files(const vector<string>& inputs, const char* output)
+{
+	int out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0) ERROR("cannot open file \'%s\' for writing: %s", output, strerror(errno));
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		int in_fd = open(inputs[i].c_str(), O_RDONLY);
+		if (in_fd < 0) ERROR("cannot open file \'%s\' for reading: %s", inputs[i].c_str(), strerror(errno));
+		copy_fd(in_fd, out_fd, inputs[i].c_str());
+		close(in_fd);
+	}
+	if (close(out_fd)) ERROR("cannot close file \'%s\': %s", output, strerror(errno));
+}
+
+struct ShardManifest
+{
+	int shard, num_shards, num_vols, task, binary;
+	vector<ShardPiece> pieces;
+};
+
+static void
+read_shard_manifest(const string& path, ShardManifest& m)
+{
+	ifstream in;
+	open_fstream(in, path.c_str(), ios::in);
+	string magic, key;
+	int version;
+	if (!(in >> magic >> version) || magic != kManifestMagic || version != kManifestVersion)
+		ERROR("\'%s\' is not a version %d shard manifest", path.c_str(), kManifestVersion);
+	if (!(in >> key >> m.shard >> m.num_shards) || key != "shard"
+		|| !(in >> key >> m.num_vols) || key != "volumes"
+		|| !(in >> key >> m.task) || key != "task"
+		|| !(in >> key >> m.binary) || key != "binary")
+		ERROR("\'%s\': corrupted shard manifest header", path.c_str());
+	ShardPiece p;
+	while (in >> key)
+	{
+		if (key != "piece" || !(in >> p.ref_vid >> p.first_read_vid >> p.end_read_vid >> p.file >> p.bytes))
+			ERROR("\'%s\': corrupted shard manifest entry", path.c_str());
+		m.pieces.push_back(p);
+	}
+	close_fstream(in);
+}
+
+struct CmpShardPieceByVolumes
+{
+	bool operator()(const ShardPiece& a, const ShardPiece& b) const
+	{
+		if (a.ref_vid != b.ref_vid) return a.ref_vid < b.ref_vid;
+		return a.first_read_vid < b.first_read_vid;
+	}
+};
+
+static void
+print_merge_usage(const char* prog)
+{
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "%s merge -w working dir -o output", prog);
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "checks the manifests left by the runs of all shards (--shard i/N) in the working folder\n");
+	fprintf(stderr, "and concatenates their results into output, in the order of a run without shards\n");
+}
+
+int
+merge_shards_main(int argc, char* argv[])
+{
+	const char* prog = "mecat2pw";
+	const char* wrk_dir = NULL;
+	const char* output = NULL;
+	int opt_char;
+	opterr = 0;
+	while ((opt_char = getopt(argc, argv, "w:o:")) != -1)
+	{
+		switch (opt_char)
+		{
+			case 'w':
+				wrk_dir = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				LOG(stderr, "unrecognised option \'%c\'", (char)optopt);
+				print_merge_usage(prog);
+				return 1;
+		}
+	}
+	if (!wrk_dir || !output || optind != argc)
+	{
+		print_merge_usage(prog);
+		return 1;
+	}
+
+	DynamicTimer dtimer(__func__);
+	// the manifests in the working folder, by number of shards
+	map<int, vector<string> > manifests;
+	DIR* dir = opendir(wrk_dir);
+	if (!dir) ERROR("cannot open working folder \'%s\': %s", wrk_dir, strerror(errno));
+	struct dirent* ent;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		int shard, num_shards, consumed = 0;
+		if (sscanf(ent->d_name, "shard_%d_of_%d.manifest%n", &shard, &num_shards, &consumed) == 2
+			&& ent->d_name[consumed] == '\0')
+			manifests[num_shards].push_back(wrk_file_name(wrk_dir, ent->d_name));
+	}
+	closedir(dir);
+	if (manifests.empty()) ERROR("there is no shard manifest in \'%s\'", wrk_dir);
+	if (manifests.size() > 1) ERROR("\'%s\' holds manifests of runs with different numbers of shards", wrk_dir);
+
+	const int num_shards = manifests.begin()->first;
+	const vector<string>& names = manifests.begin()->second;
+	vector<bool> seen(num_shards, false);
+	vector<ShardPiece> pieces;
+	ShardManifest first;
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		ShardManifest m;
+		read_shard_manifest(names[i], m);
+		if (m.num_shards != num_shards || m.shard < 0 || m.shard >= num_shards || seen[m.shard])
+			ERROR("\'%s\' does not fit a run of %d shards", names[i].c_str(), num_shards);
+		seen[m.shard] = true;
+		if (i == 0) first = m;
+		else if (m.num_vols != first.num_vols || m.task != first.task || m.binary != first.binary)
+			ERROR("\'%s\' and \'%s\' describe different runs", names[i].c_str(), names[0].c_str());
+		pieces.insert(pieces.end(), m.pieces.begin(), m.pieces.end());
+	}
+	for (int i = 0; i < num_shards; ++i)
+		if (!seen[i]) ERROR("shard %d/%d is not finished: its manifest is missing", i, num_shards);
+
+	// every volume pair (ref, read >= ref) must be in exactly one piece
+	sort(pieces.begin(), pieces.end(), CmpShardPieceByVolumes());
+	int ref = 0, read = 0;
+	vector<string> files;
+	long long total_bytes = 0;
+	for (size_t i = 0; i < pieces.size(); ++i)
+	{
+		const ShardPiece& p = pieces[i];
+		if (read == first.num_vols) { ++ref; read = ref; }
+		if (p.ref_vid != ref || p.first_read_vid != read || p.end_read_vid <= read || p.end_read_vid > first.num_vols)
+			ERROR("the shards do not cover the volume pairs once: expected (%d, %d), found piece %s", ref, read, p.file.c_str());
+		read = p.end_read_vid;
+		const string path = wrk_file_name(wrk_dir, p.file);
+		const long long bytes = file_size(path);
+		if (bytes != p.bytes)
+			ERROR("result file \'%s\' has %lld bytes, its manifest lists %lld", path.c_str(), bytes, p.bytes);
+		files.push_back(path);
+		total_bytes += bytes;
+	}
+	if (first.num_vols > 0 && (ref != first.num_vols - 1 || read != first.num_vols))
+		ERROR("the shards do not cover the volume pairs: the last one is (%d, %d) of %d volumes", ref, read - 1, first.num_vols);
+
+	LOG(stderr, "merging %d pieces of %d shards, %lld bytes", (int)files.size(), num_shards, total_bytes);
+	concatenate_files(files, output);
+	metrics_count("bytes_written_results", total_bytes);
+	return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef PW_SHARD_H
+#define PW_SHARD_H
+
+#include <string>
+#include <vector>
+
+#include "pw_options.h"
+
+/* shard-addressable runs.
+ *
+ * the work of an all-vs-all run is the set of volume pairs (ref, read) with read >= ref, taken
+ * in the order (ref, read), which is also the order of the merged output. --shard i/N takes the
+ * i-th of N equal parts of that list. a part is cut into pieces, one per reference volume, each
+ * mapping the read volumes [first_read_vid, end_read_vid) against ref_vid into a file of its own.
+ * when all pieces are written the shard leaves a manifest listing them, and 'mecat2pw merge'
+ * checks that the manifests of all shards cover every volume pair once before concatenating.
+ */
+
+struct ShardPiece
+{
+	int			ref_vid;
+	int			first_read_vid;
+	int			end_read_vid;
+	std::string	file;		// relative to the working folder
+	long long	bytes;
+};
+
+// the pieces of shard [0, num_shards) of a run over num_vols volumes
+void
+plan_shard(const int num_vols, const int shard, const int num_shards, std::vector<ShardPiece>& pieces);
+
+// the result file of a piece, relative to the working folder
+void
+shard_piece_file_name(const ShardPiece& piece, std::string& name);
+
+void
+write_shard_manifest(const options_t* options, const int num_vols, std::vector<ShardPiece>& pieces);
+
+// appends the files to output, which is truncated first. the copy stays in the kernel where it can.
+void
+concatenate_files(const std::vector<std::string>& inputs, const char* output);
+
+// 'mecat2pw merge': argv[0] is "merge"
+int
+merge_shards_main(int argc, char* argv[]);
+
+#endif // PW_SHARD_H
@@ -0,0 +1,149 @@
+#include "pw_writer.h"
+
+#include "../common/metrics.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+ResultWriter::ResultWriter(ostream* out, const bool ordered, const bool binary)
+	: out_(out), ordered_(ordered), binary_(binary), queue_(NULL), done_(false),
+	  next_seq_(0), num_batches_(0), max_held_(0)
+{
+	pthread_mutex_init(&lock_, NULL);
+	pthread_cond_init(&queue_cond_, NULL);
+	int err_code = pthread_create(&writer_tid_, NULL, writer_func, (void*)this);
+	if (err_code) ERROR("cannot create the result writer thread, return code is %d", err_code);
+}
+
+ResultWriter::~ResultWriter()
+{
+	pthread_mutex_lock(&lock_);
+	done_ = true;
+	pthread_cond_signal(&queue_cond_);
+	pthread_mutex_unlock(&lock_);
+	pthread_join(writer_tid_, NULL);
+	r_assert(held_.empty());
+	pthread_mutex_destroy(&lock_);
+	pthread_cond_destroy(&queue_cond_);
+	metrics_count("result_batches", num_batches_);
+	metrics_gauge_max("result_batches_held", max_held_);
+}
+
+void
+ResultWriter::submit(ResultBatch* batch)
+{
+	ResultBatch* head;
+	do {
+		head = queue_;
+		batch->next = head;
+	} while (!__sync_bool_compare_and_swap(&queue_, head, batch));
+	// the writer may be asleep on an empty queue
+	if (!head)
+	{
+		pthread_mutex_lock(&lock_);
+		pthread_cond_signal(&queue_cond_);
+		pthread_mutex_unlock(&lock_);
+	}
+}
+
+void*
+ResultWriter::writer_func(void* arg)
+{
+	((ResultWriter*)arg)->x_write_batches();
+	return NULL;
+}
+
+void
+ResultWriter::x_write_batches()
+{
+	while (1)
+	{
+		ResultBatch* list = __sync_lock_test_and_set(&queue_, (ResultBatch*)NULL);
+		if (!list)
+		{
+			pthread_mutex_lock(&lock_);
+			while (!queue_ && !done_) pthread_cond_wait(&queue_cond_, &lock_);
+			const bool stop = !queue_ && done_;
+			pthread_mutex_unlock(&lock_);
+			if (stop) break;
+			continue;
+		}
+
+		// the list is newest first
+		ResultBatch* arrived = NULL;
+		while (list)
+		{
+			ResultBatch* next = list->next;
+			list->next = arrived;
+			arrived = list;
+			list = next;
+		}
+		for (ResultBatch* batch = arrived; batch; )
+		{
+			ResultBatch* next = batch->next;
+			++num_batches_;
+			if (!ordered_)
+			{
+				x_write_batch(batch);
+			}
+			else
+			{
+				held_[batch->seq] = batch;
+				map<idx_t, ResultBatch*>::iterator it;
+				while ((it = held_.begin()) != held_.end() && it->first == next_seq_)
+				{
+					x_write_batch(it->second);
+					held_.erase(it);
+					++next_seq_;
+				}
+				if (held_.size() > max_held_) max_held_ = held_.size();
+			}
+			batch = next;
+		}
+	}
+	x_flush_records(true);
+	out_->flush();
+}
+
+void
+ResultWriter::x_write_batch(ResultBatch* batch)
+{
+	if (binary_)
+	{
+		m4_.insert(m4_.end(), batch->m4.begin(), batch->m4.end());
+		ec_.insert(ec_.end(), batch->ec.begin(), batch->ec.end());
+		x_flush_records(false);
+	}
+	else
+	{
+		const string text = batch->text.str();
+		out_->write(text.data(), text.size());
+	}
+	delete batch;
+}
+
+template <class T>
+static void
+write_record_blocks(ostream* out, vector<T>& list, const bool all, const size_t block_size, vector<char>& buf)
+{
+	size_t i = 0;
+	while (list.size() - i >= block_size || (all && i < list.size()))
+	{
+		const size_t n = min(list.size() - i, block_size);
+		buf.clear();
+		encode_record_block(list.data() + i, n, buf);
+		out->write(buf.data(), buf.size());
+		i += n;
+	}
+	list.erase(list.begin(), list.begin() + i);
+}
+
+// encodes the records in blocks of kRecordBlockSize, and the rest too if all is set
+void
+ResultWriter::x_flush_records(const bool all)
+{
+	write_record_blocks(out_, m4_, all, kRecordBlockSize, buf_);
+	write_record_blocks(out_, ec_, all, kRecordBlockSize, buf_);
+}
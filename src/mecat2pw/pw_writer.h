@@ -0,0 +1,78 @@
+#ifndef PW_WRITER_H
+#define PW_WRITER_H
+
+#include <pthread.h>
+
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "../common/alignment.h"
+
+/* the results of one chunk of reads, filled by a mapping thread without any lock.
+ *
+ * text output is formatted into text by the worker. for a binary record stream the records are
+ * kept as they are and the writer encodes them, so that the record blocks do not depend on how
+ * the reads were cut into chunks.
+ */
+struct ResultBatch
+{
+	idx_t							seq;
+	std::ostringstream				text;
+	std::vector<M4Record>			m4;
+	std::vector<ExtensionCandidate>	ec;
+	ResultBatch*					next;
+};
+
+/* writes the result batches of the mapping threads from a thread of its own.
+ *
+ * workers hand over their batches through a lock-free list and go on mapping; the lock of the
+ * writer is only taken to wake it up when the list was empty. with ordered set the batches are
+ * written in the order of their seq numbers, which must be 0, 1, 2, ... without gaps, so that the
+ * output does not depend on the number of threads or their timing. batches that arrive ahead of
+ * their turn are held in memory until the missing ones are written.
+ *
+ * records come out in the order of the former single-threaded output. a binary stream is cut into
+ * blocks of exactly kRecordBlockSize records, where the former output flushed blocks of varying size
+ * once more than 10000 records were pending, so the block boundaries are not those of old files.
+ */
+class ResultWriter
+{
+public:
+	ResultWriter(std::ostream* out, const bool ordered, const bool binary);
+	// writes what is left and stops the writer thread
+	~ResultWriter();
+
+	// the writer takes over the batch
+	void submit(ResultBatch* batch);
+
+private:
+	static void* writer_func(void* arg);
+	void x_write_batches();
+	void x_write_batch(ResultBatch* batch);
+	void x_flush_records(const bool all);
+
+private:
+	static const int		kRecordBlockSize = 10000;
+
+	std::ostream*			out_;
+	bool					ordered_;
+	bool					binary_;
+	pthread_t				writer_tid_;
+
+	ResultBatch* volatile	queue_;				// pushed by the workers, newest first
+	pthread_mutex_t			lock_;
+	pthread_cond_t			queue_cond_;		// the queue is not empty, or no more batches will come
+	bool					done_;
+
+	// owned by the writer thread
+	std::map<idx_t, ResultBatch*>	held_;
+	idx_t					next_seq_;
+	std::vector<M4Record>	m4_;
+	std::vector<ExtensionCandidate>	ec_;
+	std::vector<char>		buf_;
+	long long				num_batches_;
+	size_t					max_held_;
+};
+
+#endif // PW_WRITER_H
@@ -12,7 +12,9 @@
 #define RM 100000
 
 #include "output.h"
+#include "reference_index.h"
 #include "../common/defs.h"
+#include "../common/metrics.h"
 
 static const char* prog_name = NULL;
 static const int kDefaultNumCandidates = 10;
@@ -22,6 +24,7 @@ static int num_output;
 static int output_format = FMT_REF;
 static const int kDefaultOutputFormat = FMT_REF;
 static int tech;
+static const char* repeat_mask = NULL;
 static const int kDefaultTech = TECH_PACBIO;
 
 typedef struct
@@ -35,6 +38,7 @@ typedef struct
 	int			num_output;
 	int			output_format;
 	int 		tech;
+	const char* repeat_mask;
 } meap_ref_options;
 
 void init_meap_ref_options(meap_ref_options* options)
@@ -48,23 +52,27 @@ void init_meap_ref_options(meap_ref_options* options)
 	options->num_output = kDefaultNumOutput;
 	options->output_format = kDefaultOutputFormat;
 	options->tech = kDefaultTech;
+	options->repeat_mask = NULL;
 }
 
 void print_usage()
 {
 	fprintf(stderr, "\n\n");
 	fprintf(stderr, "usage:\n");
-	fprintf(stderr, "%s [-d reads] [-r reference] [-o output] [-w working dir] [-t threads]", prog_name);
+	fprintf(stderr, "%s [-d reads] [-r reference] [-o output] [-w working dir] [-t threads] [-M repeat mask] [--metrics-json path]", prog_name);
+	fprintf(stderr, "\n%s index -r reference -o index [-t threads] [-M repeat mask]", prog_name);
 	fprintf(stderr, "\n\n");
 	fprintf(stderr, "options:\n");
-	fprintf(stderr, "-d <string>\treads file name\n");
-	fprintf(stderr, "-r <string>\treference file name\n");
+	fprintf(stderr, "-d <string>\treads file name, FASTA or FASTQ, may be gzip compressed\n");
+	fprintf(stderr, "-r <string>\treference file name, FASTA or an index written by '%s index'\n", prog_name);
 	fprintf(stderr, "-o <string>\toutput file name\n");
 	fprintf(stderr, "-w <string>\tworking folder name, will be created if not exist\n");
 	fprintf(stderr, "-t <integer>\tnumber of cput threads\n\t\tdefault: 1\n");
 	fprintf(stderr, "-n <integer>\tnumber of of candidates for gap extension\n\t\tdefault: %d\n", kDefaultNumCandidates);
 	fprintf(stderr, "-b <integer>\toutput the best b alignments\n\t\tdefault: %d\n", kDefaultNumOutput);
 	fprintf(stderr, "-m <0/1/2>\toutput format: 0 = ref, 1 = m4, 2 = sam\n\t\tdefault: %d\n", kDefaultOutputFormat);
+	fprintf(stderr, "-M <string>\trepeat mask of 15-mers (see 'mecat2pw mask'), they are left out of the reference index\n");
+	fprintf(stderr, "--metrics-json <string>\twrite timings, counters and resource usage of the run to this file\n");
 	///fprintf(stderr, "-x <0/1>\tsequencing technology: 0 = pacbio, 1 = nanopore\n\t\tdefault: %d\n", kDefaultTech);
 }
 
@@ -77,7 +85,7 @@ param_read_t(int argc, char* argv[], meap_ref_options* options)
 	int ret = 1;
 	
 	init_meap_ref_options(options);
-	while((opt_char = getopt(argc, argv, "d:r:w:o:t:n:b:m:x:")) != -1)
+	while((opt_char = getopt(argc, argv, "d:r:w:o:t:n:b:m:x:M:")) != -1)
 	{
 		switch(opt_char)
 		{
@@ -105,6 +113,9 @@ param_read_t(int argc, char* argv[], meap_ref_options* options)
 			case 'm':
 				options->output_format = atoi(optarg);
 				break;
+			case 'M':
+				options->repeat_mask = optarg;
+				break;
 			case 'x':
 				if (optarg[0] == '0') {
 					options->tech = TECH_PACBIO;
@@ -189,81 +200,23 @@ int str2num(char *str)
     }
     return (sum);
 }
-int chang_fastqfile(const char *fastaq, const char *fenfolder)
-{
-    FILE *fp, *ot;
-    int kk = 0,read_len;
-    char read_name[1000], onedata[RM], buff1[1000], buff2[RM], *fq, tempstr[200], *oq,ch;
-    sprintf(tempstr, "%s/0.fq", fenfolder);
-    fp = fopen(fastaq, "r");
-    ot = fopen(tempstr, "w");
-    fq = (char *)malloc(100000000);
-    setvbuf(fp, fq, _IOFBF, 100000000);
-    oq = (char *)malloc(100000000);
-    setvbuf(ot, oq, _IOFBF, 100000000);
-	int num_read_items;
-    ch=getc(fp);
-    if(ch=='>')
-    {
-        kk=0;
-        for (; ch!=EOF; ch=getc(fp))
-        {
-            if(ch=='>')
-            {
-                num_read_items = fscanf(fp,"%[^\n]s",read_name);
-				assert(num_read_items = 1);
-                if(kk>0)
-                {
-                    onedata[read_len]='\0';
-                    fprintf(ot, "%d\t\%d\t%s\n", kk-1,read_len,onedata);
-                    read_len=0;
-                    kk++;
-                }
-                else
-                {
-                    kk++;
-                    read_len=0;
-                }
-            }
-            else if(ch!='\n'&&ch!='\r')onedata[read_len++]=ch;
-        }
-        onedata[read_len]='\0';
-        fprintf(ot, "%d\t\%d\t%s\n", kk-1,read_len,onedata);
-    }
-    else
-    {
-        fseek(fp, 0L, SEEK_SET);
-        while (fscanf(fp, "%[^\n]s", read_name) != EOF && fscanf(fp, "%s\n", onedata) != EOF && fscanf(fp, "%[^\n]s", buff1) != EOF && fscanf(fp, "%s\n", buff2) != EOF)
-        {
-            read_len=strlen(onedata);
-            fprintf(ot, "%d\t%d\t%s\n", ++kk,read_len,onedata);
-        }
-    }
-    fclose(fp);
-    fclose(ot);
-    free(fq);
-    free(oq);
-    return (kk);
-
-}
-
 int firsttask(int argc, char *argv[])
 {
 	meap_ref_options* options = (meap_ref_options*)malloc(sizeof(meap_ref_options));
 	int flag = param_read_t(argc, argv, options);
 	if (flag == -1) { print_usage(); exit(1); }
 	
-    int readcount = chang_fastqfile(options->reads, options->wrk_dir);
 	char kkkkk[1024];
     sprintf(kkkkk, "config.txt");
     FILE* fileout = fopen(kkkkk, "w");
-    fprintf(fileout, "%s\n%s\n%s\n%s\n%d\t%d\n", options->wrk_dir, options->reference, options->reads, options->output, options->num_cores, readcount);
+    fprintf(fileout, "%s\n%s\n%s\n%s\n%d\n", options->wrk_dir, options->reference, options->reads, options->output, options->num_cores);
     fclose(fileout);
 	int corenum = options->num_cores;
 	num_candidates = options->num_candidates;
 	num_output = options->num_output;
 	output_format = options->output_format;
 	tech = options->tech;
+	repeat_mask = options->repeat_mask;
 	free(options);
     return (corenum);
 }
@@ -353,9 +306,10 @@ output_query_results(fastaindexinfo* chr_idx, const int num_chr, TempResult** pp
 		++output_cnt;
 		if (output_cnt == num_output) break;
 	}
+	metrics_count("alignments_written", output_cnt);
 }
 
-int result_combine(int readcount, int filecount, char *workpath, char *outfile, char *fastaq, int main_argc, char* main_argv[])
+int result_combine(int filecount, char *workpath, char *outfile, int main_argc, char* main_argv[])
 {
 	char path[1024], buffer[1024];
 	sprintf(path, "%s/chrindex.txt", workpath);
@@ -448,7 +402,66 @@ long get_file_size(const char *path)
     return filesize;
 }
 
-extern int meap_ref_impl_large(int, int, int);
+extern int meap_ref_impl_large(int, int, int, const char*);
+
+static void
+print_index_usage()
+{
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "%s index -r reference -o index [-t threads] [-M repeat mask]", prog_name);
+	fprintf(stderr, "\n\n");
+	fprintf(stderr, "packs the reference and indexes its %d-mers into a file that can be given to -r of mapping runs,\n", REFERENCE_INDEX_KMER_SIZE);
+	fprintf(stderr, "which mmap it instead of reading the reference and building the index again\n");
+	fprintf(stderr, "a repeat mask given here must also be given to the mapping runs\n");
+}
+
+// 'mecat2ref index': argv[0] is "index"
+static int
+index_main(int argc, char* argv[])
+{
+	const char* reference = NULL;
+	const char* output = NULL;
+	const char* mask = NULL;
+	int num_threads = 1;
+	int opt_char;
+	opterr = 0;
+	while ((opt_char = getopt(argc, argv, "r:o:t:M:")) != -1)
+	{
+		switch (opt_char)
+		{
+			case 'r':
+				reference = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 't':
+				num_threads = atoi(optarg);
+				break;
+			case 'M':
+				mask = optarg;
+				break;
+			default:
+				fprintf(stderr, "Error: unrecognised option '%c'\n", (char)optopt);
+				print_index_usage();
+				return 1;
+		}
+	}
+	if (!reference || !output || num_threads < 1 || optind != argc)
+	{
+		print_index_usage();
+		return 1;
+	}
+	if (is_reference_index_file(reference)) ERROR("'%s' is already a reference index", reference);
+
+	MetricsStage stage("build_index");
+	reference_index_t* index = build_reference_index(reference, REFERENCE_INDEX_KMER_SIZE, mask, num_threads);
+	dump_reference_index(output, index);
+	destroy_reference_index(index);
+	LOG(stderr, "reference index is written to '%s'", output);
+	return 0;
+}
 
 #define __run_system(cmd) \
 	do { \
@@ -458,7 +471,9 @@ extern int meap_ref_impl_large(int, int, int);
 
 int main(int argc, char *argv[])
 {
+	argc = metrics_init(argc, argv);
 	prog_name = argv[0];
+	if (argc > 1 && strcmp(argv[1], "index") == 0) return index_main(argc - 1, argv + 1);
 	
     char cmd[300], outfile[200];
     int corenum;
@@ -466,7 +481,7 @@ int main(int argc, char *argv[])
     struct timeval tpstart, tpend;
     struct timeval mapstart, mapend;
     float timeuse;
-    char saved[150], fastqfile[150], fastafile[150], tempstr[150];
+    char saved[150], fastqfile[150], fastafile[150];
     int  readcount;
     FILE *fid1, *fid2;
 
@@ -489,22 +504,26 @@ int main(int argc, char *argv[])
     read_results = fgets(outfile, 150, fid1);
 	assert(read_results);
     outfile[strlen(outfile) - 1] = '\0';
-    int num_read_items = fscanf(fid1, "%d %d\n", &corenum,&readcount);
-	assert(num_read_items == 2);
+    int num_read_items = fscanf(fid1, "%d\n", &corenum);
+	assert(num_read_items == 1);
     fclose(fid1);
     filelength=get_file_size(fastafile);
     gettimeofday(&mapstart, NULL);
-	meap_ref_impl_large(num_candidates, num_output, tech);
+	readcount = meap_ref_impl_large(num_candidates, num_output, tech, repeat_mask);
+	metrics_gauge("reads", readcount);
     gettimeofday(&mapend, NULL);
     timeuse = 1000000 * (mapend.tv_sec - mapstart.tv_sec) + mapend.tv_usec - mapstart.tv_usec;
     timeuse /= 1000000;
 
-    sprintf(tempstr,"%s/0.fq",saved);
-    result_combine(readcount, corenum, saved, outfile,tempstr, argc, argv);
+    {
+        MetricsStage stage("combine_results");
+        result_combine(corenum, saved, outfile, argc, argv);
+    }
     gettimeofday(&tpend, NULL);
     timeuse = 1000000 * (tpend.tv_sec - tpstart.tv_sec) + tpend.tv_usec - tpstart.tv_usec;
     timeuse /= 1000000;
     fid2 = fopen("config.txt", "a");
+    fprintf(fid2, "The number of reads: %d\n", readcount);
     fprintf(fid2, "The total Time : %f sec\n", timeuse);
     fclose(fid2);
     sprintf(cmd, "cp -r config.txt \"%s.config\"", outfile);
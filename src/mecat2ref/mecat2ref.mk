@@ -6,7 +6,7 @@ ifeq "$(strip ${TARGET_DIR})" ""
 endif
 
 TARGET   := mecat2ref
-SOURCES  := mecat2ref.cpp mecat2ref_impl_large.cpp output.cpp mecat2ref_aux.cpp
+SOURCES  := mecat2ref.cpp mecat2ref_impl_large.cpp output.cpp mecat2ref_aux.cpp reference_index.cpp read_batches.cpp
 
 SRC_INCDIRS  := . 
 
@@ -1,5 +1,6 @@
 #include "mecat2ref_aux.h"
 #include "../common/defs.h"
+#include "../common/packed_seq.h"
 #include <algorithm>
 using namespace std;
 
@@ -82,8 +83,35 @@ int find_location(int *t_loc,int *t_seedn,int *t_score,long *loc,int k,int *rep_
     else return(0);
 }
 
+AlignStringArena::~AlignStringArena()
+{
+	for (size_t i = 0; i < chunks_.size(); ++i) safe_free(chunks_[i].first);
+}
+
+char*
+AlignStringArena::copy(const char* s)
+{
+	const size_t n = strlen(s) + 1;
+	while (curr_ < chunks_.size() && used_ + n > chunks_[curr_].second)
+	{
+		++curr_;
+		used_ = 0;
+	}
+	if (curr_ == chunks_.size())
+	{
+		const size_t size = max(n, kChunkSize);
+		char* p;
+		safe_malloc(p, char, size);
+		chunks_.push_back(make_pair(p, size));
+	}
+	char* dst = chunks_[curr_].first + used_;
+	memcpy(dst, s, n);
+	used_ += n;
+	return dst;
+}
+
 void
-extract_sequences(const char* raw_ref,
+extract_sequences(const u1_t* ref_pac,
 				  const char* raw_read,
 				  const long ref_start,
 				  const int read_start,
@@ -101,15 +129,8 @@ extract_sequences(const char* raw_ref,
 	right_ref_size = min(R2, (long)(R * 1.2));
 	const u1_t* et = get_dna_encode_table();
 	
-	const char* rs = raw_ref + ref_start - left_ref_size;
-	const char* re = raw_ref + ref_start + right_ref_size;
-	tstr.clear();
-	for (const char* r = rs; r != re; ++r) {
-		u1_t c = *r;
-		c = et[c];
-		if (c > 3) c = 0;
-		tstr.push_back((char)c);
-	}
+	tstr.resize(left_ref_size + right_ref_size);
+	unpack_bases(ref_pac, ref_start - left_ref_size, left_ref_size + right_ref_size, tstr.data());
 	
 	qstr.clear();
 	for (int i = 0; i < read_size; ++i) {
@@ -122,12 +143,13 @@ extract_sequences(const char* raw_ref,
 
 bool extend_candidate(candidate_save& can,
 					  GapAligner* aligner,
-					  const char* raw_ref,
+					  const u1_t* ref_pac,
 					  const long ref_size,
 					  const char* fwd_raw_read,
 					  const char* rev_raw_read,
 					  vector<char>& qstr,
 					  vector<char>& tstr,
+					  AlignStringArena& aln_strings,
 					  int read_name,
 					  int read_len,
 					  AlignInfo* alns,
@@ -139,7 +161,7 @@ bool extend_candidate(candidate_save& can,
 	int read_start = can.loc2;
 	long ref_start = can.loc1 - 1;
 	long left_ref_size, right_ref_size;
-	extract_sequences(raw_ref, 
+	extract_sequences(ref_pac, 
 					  raw_read, 
 					  ref_start, 
 					  read_start,
@@ -160,8 +182,8 @@ bool extend_candidate(candidate_save& can,
 		r.qs = read_len;
 		r.sb = ref_start - left_ref_size + aligner->target_start();
 		r.se = ref_start - left_ref_size + aligner->target_end();
-		strcpy(r.qmap, aligner->query_mapped_string());
-		strcpy(r.smap, aligner->target_mapped_string());
+		r.qmap = aln_strings.copy(aligner->query_mapped_string());
+		r.smap = aln_strings.copy(aligner->target_mapped_string());
 
 		if (alns) {
 			alns[*naln].qoff = r.qb;
@@ -311,12 +333,13 @@ rescue_clipped_align(AlignInfo* alnv,
 					  TempResult* results,
 					  int& nresults,
 					  GapAligner* aligner,
-					  const char* raw_ref,
+					  const u1_t* ref_pac,
 					  const long ref_size,
 					  const char* fwd_raw_read,
 					  const char* rev_raw_read,
 					  vector<char>& qstr,
 					  vector<char>& tstr,
+					  AlignStringArena& aln_strings,
 					  int read_name,
 					  int read_len,
 					  int block_size,
@@ -365,12 +388,13 @@ rescue_clipped_align(AlignInfo* alnv,
 		if (alnv[i].prev_id == -1 && find_left_clipped_candidate(alnv[i], can, database, block_size, read_len, BC, ddfs_cutoff)) {
 			bool r = extend_candidate(can, 
 							 aligner, 
-							 raw_ref, 
+							 ref_pac, 
 							 ref_size,
 							 fwd_raw_read, 
 							 rev_raw_read, 
 							 qstr, 
 							 tstr, 
+							 aln_strings, 
 							 read_name, 
 							 read_len, 
 							 NULL, 
@@ -401,12 +425,13 @@ rescue_clipped_align(AlignInfo* alnv,
 		if (alnv[i].next_id == -1 && find_right_clipped_candidate(alnv[i], can, database, block_size, read_len, ref_size, BC, ddfs_cutoff)) {
 			bool r = extend_candidate(can, 
 									  aligner, 
-									  raw_ref, 
+									  ref_pac, 
 									  ref_size,
 									  fwd_raw_read, 
 									  rev_raw_read, 
 									  qstr, 
 									  tstr, 
+									  aln_strings, 
 									  read_name, 
 									  read_len, 
 									  NULL, 
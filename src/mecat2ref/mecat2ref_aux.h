@@ -1,11 +1,36 @@
 #ifndef AUX_H
 #define AUX_H
 
+#include "../common/defs.h"
 #include "../common/gapalign.h"
 #include "output.h"
 #include "mecat2ref_defs.h"
 #include <vector>
 
+/* per-thread storage of the mapped strings (qmap, smap) of the TempResults of a read.
+ * it grows in chunks of at least kChunkSize bytes as the alignments need and is reset before the
+ * next read, so it holds about read length x candidates bytes, not MAX_SEQ_SIZE per candidate. */
+class AlignStringArena
+{
+public:
+	AlignStringArena() : curr_(0), used_(0) {}
+	~AlignStringArena();
+
+	// a copy of s, valid until the next reset()
+	char* copy(const char* s);
+
+	void reset() { curr_ = 0; used_ = 0; }
+
+private:
+	AlignStringArena(const AlignStringArena&);
+	AlignStringArena& operator=(const AlignStringArena&);
+
+	static const size_t kChunkSize = 1 << 20;
+	std::vector<std::pair<char*, size_t> > chunks_;
+	size_t curr_; 	// chunk being filled
+	size_t used_; 	// bytes used in it
+};
+
 struct AlignInfo
 {
 	int qid, qoff, qend;
@@ -46,12 +71,13 @@ find_location(int *t_loc,int *t_seedn,int *t_score,long *loc,int k,int *rep_loc,
 
 bool extend_candidate(candidate_save& can,
 					  GapAligner* aligner,
-					  const char* raw_ref,
+					  const u1_t* ref_pac,
 					  const long ref_size,
 					  const char* fwd_raw_read,
 					  const char* rev_raw_read,
 					  std::vector<char>& qstr,
 					  std::vector<char>& tstr,
+					  AlignStringArena& aln_strings,
 					  int read_name,
 					  int read_len,
 					  AlignInfo* alns,
@@ -65,12 +91,13 @@ rescue_clipped_align(AlignInfo* alnv,
 					 TempResult* results,
 					 int& nresults,
 					 GapAligner* aligner,
-					 const char* raw_ref,
+					 const u1_t* ref_pac,
 					 const long ref_size,
 					 const char* fwd_raw_read,
 					 const char* rev_raw_read,
 					 std::vector<char>& qstr,
 					 std::vector<char>& tstr,
+					 AlignStringArena& aln_strings,
 					 int read_name,
 					 int read_len,
 					 int block_size,
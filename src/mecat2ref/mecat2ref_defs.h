@@ -23,7 +23,6 @@
 #define SI 21
 #define MK 100
 #define MAXSTR 1000000000
-#define MAX 10
 #define SVM 100000
 #define PLL 1000
 
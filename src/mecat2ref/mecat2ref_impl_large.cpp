@@ -1,8 +1,11 @@
 #include "mecat2ref_defs.h"
 #include "output.h"
 #include "mecat2ref_aux.h"
+#include "read_batches.h"
+#include "reference_index.h"
 #include "../common/diff_gapalign.h"
 #include "../common/xdrop_gapalign.h"
+#include "../common/metrics.h"
 
 #include <algorithm>
 using namespace std;
@@ -18,27 +21,122 @@ static pthread_t *thread;
 static int threadnum=2;
 static FILE **outfile;
 static pthread_mutex_t mutilock; 
-static int runnumber=0,runthreadnum=0, readcount,terminalnum;
-static int *countin;
-static long **databaseindex,*allloc,seqcount,sumcount;
+static pthread_mutex_t fetchlock;
+static int runthreadnum=0;
+static reference_index_t* ref_index;
+static long seqcount;
 static int seed_len;
-static char *REFSEQ;
-static char *savework,workpath[300],fastqfile[300];
-static ReadFasta *readinfo;
+static char workpath[300],fastqfile[300];
+
+/* the mapping threads live for the whole run and take blocks of reads from the current batch.
+ * a thread that finds the batch handed out fetches the next one, which the loader has read
+ * meanwhile; a batch goes back to the loader when its last block is finished. blocks shrink
+ * towards the end of a batch (at most PLL reads, about 1/(2 * threads) of the reads left) so
+ * that the threads finish the input together. */
+typedef struct
+{
+    ReadBatchLoader::Batch* batch;
+    int next_read;          // first read not handed out
+    int blocks_in_flight;   // handed out and not finished
+    bool retired;           // no longer the current batch
+} MappedBatch;
 
-static long get_file_size(const char *path)
+typedef struct
 {
-    long filesize = -1;
-    struct stat statbuff;
-    if(stat(path, &statbuff) < 0)
-    {
-        return filesize;
-    }
-    else
+    MappedBatch* mb;
+    int first,end;
+} ReadBlock;
+
+static const int kMinBlockReads = 10;
+static const int kReadBatchSlots = 3;
+static ReadBatchLoader* loader;
+static MappedBatch* curr_batch;
+static bool input_done;
+static int num_batches_fetched;
+static int num_reads_loaded;
+
+static void release_mapped_batch(MappedBatch* mb)
+{
+    loader->release_batch(mb->batch);
+    delete mb;
+}
+
+static bool next_read_block(ReadBlock* block)
+{
+    while(1)
     {
-        filesize = statbuff.st_size;
+        pthread_mutex_lock(&mutilock);
+        if(curr_batch&&curr_batch->next_read<(int)curr_batch->batch->reads.size())
+        {
+            const int left=curr_batch->batch->reads.size()-curr_batch->next_read;
+            int n=left/(2*threadnum);
+            if(n>PLL)n=PLL;
+            if(n<kMinBlockReads)n=kMinBlockReads;
+            if(n>left)n=left;
+            block->mb=curr_batch;
+            block->first=curr_batch->next_read;
+            block->end=block->first+n;
+            curr_batch->next_read+=n;
+            ++curr_batch->blocks_in_flight;
+            pthread_mutex_unlock(&mutilock);
+            return true;
+        }
+        if(input_done)
+        {
+            pthread_mutex_unlock(&mutilock);
+            return false;
+        }
+        // a batch number, not the pointer, tells whether another thread fetched meanwhile: a new batch may reuse the address
+        const int seen=num_batches_fetched;
+        pthread_mutex_unlock(&mutilock);
+
+        // one thread fetches the next batch. mutilock is not held while waiting for the loader,
+        // which may need a batch back from the threads finishing their blocks.
+        pthread_mutex_lock(&fetchlock);
+        pthread_mutex_lock(&mutilock);
+        const bool stale=(num_batches_fetched!=seen||input_done);
+        pthread_mutex_unlock(&mutilock);
+        if(!stale)
+        {
+            ReadBatchLoader::Batch* batch;
+            {
+                MetricsStage stage("load_reads");
+                batch=loader->next_batch();
+            }
+            MappedBatch* done=NULL;
+            pthread_mutex_lock(&mutilock);
+            if(curr_batch)
+            {
+                curr_batch->retired=true;
+                if(curr_batch->blocks_in_flight==0)done=curr_batch;
+            }
+            curr_batch=NULL;
+            ++num_batches_fetched;
+            if(batch)
+            {
+                curr_batch=new MappedBatch;
+                curr_batch->batch=batch;
+                curr_batch->next_read=0;
+                curr_batch->blocks_in_flight=0;
+                curr_batch->retired=false;
+                num_reads_loaded+=batch->reads.size();
+                metrics_count("reads_processed", batch->reads.size());
+                metrics_count("batches", 1);
+            }
+            else input_done=true;
+            pthread_mutex_unlock(&mutilock);
+            if(done)release_mapped_batch(done);
+        }
+        pthread_mutex_unlock(&fetchlock);
     }
-    return filesize;
+}
+
+static void finish_read_block(ReadBlock* block)
+{
+    pthread_mutex_lock(&mutilock);
+    const bool done=(--block->mb->blocks_in_flight==0&&block->mb->retired);
+    pthread_mutex_unlock(&mutilock);
+    if(done)release_mapped_batch(block->mb);
 }
 
 static unsigned short atcttrans(char c)
@@ -50,17 +148,6 @@ static unsigned short atcttrans(char c)
     else return 4;
 }
 
-static long sumvalue_x(int *intarry,int count)
-{
-    long i,sumval=0;
-    for(i=0; i<count; i++)
-    {
-        if(intarry[i]>0&&intarry[i]<129)sumval=sumval+intarry[i];
-        else if(intarry[i]>128)intarry[i]=0;
-    }
-    return(sumval);
-}
-
 static int transnum_buchang(char *seqm,int *value,int *endn,int len_str,int readnum,int BC)
 {
     int eit=0,temp;
@@ -130,158 +217,28 @@ static void insert_loc(struct Back_List *spr,int loc,int seedn,float len)
 }
 
 
-static void creat_ref_index(char *fastafile)
-{
-    unsigned int eit,temp;
-    int  indexcount=0,leftnum=0;
-    long length,count,i,start, rsize = 0;
-    FILE *fasta,*fastaindex;
-    char *seq,ch,nameall[200];
-
-	indexcount = 1 << (2 * seed_len);
-    leftnum=34-2*seed_len;
-    //read reference seq
-    length=get_file_size(fastafile);
-    fasta=fopen(fastafile, "r");
-    sprintf(nameall,"%s/chrindex.txt",workpath);
-    fastaindex=fopen(nameall,"w");
-
-    REFSEQ=(char *)malloc((length+1000)*sizeof(char));
-    seq=REFSEQ;
-    for (ch=getc(fasta),count=0; ch!=EOF; ch=getc(fasta))
-    {
-        if(ch=='>')
-        {
-            assert(fscanf(fasta,"%[^\n]s",nameall) == 1);
-			if (rsize) fprintf(fastaindex, "%ld\n", rsize);
-			rsize = 0;
-			for(i=0;i<strlen(nameall);i++)if(nameall[i]==' '||nameall[i]=='\t')break;
-			nameall[i]='\0';
-            fprintf(fastaindex,"%ld\t%s\t",count,nameall);
-        }
-        else if(ch!='\n'&&ch!='\r')
-        {
-            if(ch>'Z')ch=toupper(ch);
-            seq[count]=ch;
-            count=count+1;
-			++rsize;
-        }
-    }
-    fclose(fasta);
-	fprintf(fastaindex, "%ld\n", rsize);
-    fprintf(fastaindex,"%ld\t%s\n",count,"FileEnd");
-    seq[count]='\0';
-    fclose(fastaindex);
-    seqcount=count;
-    printf("%ld\n",seqcount);
-//printf("Constructing look-up table...\n");
-    countin=(int *)malloc((indexcount)*sizeof(int));
-    for(i=0; i<indexcount; i++)countin[i]=0;
-
-// Count the number
-    eit=0;
-    start=0;
-    for(i=0; i<seqcount; i++)
-    {
-        if(seq[i]=='N'||(temp=atcttrans(seq[i]))==4)
-        {
-            eit=0;
-            start=0;
-            continue;
-        }
-        temp=atcttrans(seq[i]);
-        if(start<seed_len-1)
-        {
-            eit=eit<<2;
-            eit=eit+temp;
-            start=start+1;
-        }
-        else if(start>=seed_len-1)
-        {
-            eit=eit<<2;
-            eit=eit+temp;
-            start=start+1;
-            countin[eit]=countin[eit]+1;
-            eit=eit<<leftnum;
-            eit=eit>>leftnum;
-        }
-    }
-
-
-//Max_index
-    sumcount=sumvalue_x(countin,indexcount);
-    allloc=(long *)malloc(sumcount*sizeof(long));
-    databaseindex=(long **)malloc((indexcount)*sizeof(long*));
-//allocate memory
-    sumcount=0;
-    for(i=0; i<indexcount; i++)
-    {
-        if(countin[i]>0)
-        {
-            databaseindex[i]=allloc+sumcount;
-            sumcount=sumcount+countin[i];
-            countin[i]=0;
-        }
-        else databaseindex[i]=NULL;
-    }
-
-    // printf("xiao");//10834098
-
-//constructing the look-up table
-    eit=0;
-    start=0;
-    for(i=0; i<seqcount; i++)
-    {
-        if(seq[i]=='N'||(temp=atcttrans(seq[i]))==4)
-        {
-            eit=0;
-            start=0;
-            continue;
-        }
-        temp=atcttrans(seq[i]);
-        if(start<seed_len-1)
-        {
-            eit=eit<<2;
-            eit=eit+temp;
-            start=start+1;
-        }
-        else if(start>=seed_len-1)
-        {
-            eit=eit<<2;
-            eit=eit+temp;
-            start=start+1;
-
-            if(databaseindex[eit]!=NULL)
-            {
-                countin[eit]=countin[eit]+1;
-                databaseindex[eit][countin[eit]-1]=i+2-seed_len;
-            }
-            eit=eit<<leftnum;
-            eit=eit>>leftnum;
-        }
-    }
-}
-
-
 static void reference_mapping(int threadint)
 {
     int cleave_num,read_len;
     int mvalue[20000],flag_end;
-    long *leadarray,u_k,s_k,loc;
-    int count1=0,i,j,k,templong,read_name;
+    long u_k,s_k,loc;
+    idx_t kmer_loc,first_loc,last_loc,loc_i;
+    int i,j,k,templong,read_name;
     struct Back_List *database,*temp_spr,*temp_spr1;
     int repeat_loc = 0,*index_list,*index_spr;
     long location_loc[4],left_length1,right_length1,left_length2,right_length2,loc_list,start_loc;
     short int *index_score,*index_ss;
     int temp_list[200],temp_seedn[200],temp_score[200];
-    int localnum,read_i,read_end,fileid;
+    int read_i;
+    ReadBlock block;
+    const ReadFasta* readinfo;
     int endnum,ii;
-    char *seq,*onedata,onedata1[RM],onedata2[RM],FR;
+    char *onedata,onedata1[RM],onedata2[RM],FR;
     int cc1,canidatenum,loc_seed;
     int num1,num2,BC;
     int low,high,mid,seedcount;
     candidate_save canidate_loc[MAXC],canidate_temp;
-    seq=REFSEQ;
+    const u1_t* ref_pac=ref_index->pac;
     j=seqcount/ZV+5;
 	
 	int* fwd_index_list = (int*)malloc(sizeof(int) * j);
@@ -304,19 +261,10 @@ static void reference_mapping(int threadint)
 	int naln;
 	TempResult results[MAXC + 6];
 	int nresults;
-	long aln_bytes = 1;
-	aln_bytes = aln_bytes * 2 * (MAXC + 6) * MAX_SEQ_SIZE;
-	char* aln_seqs = new char[aln_bytes];
-	u_k = 0;
-	for (int i = 0; i < MAXC + 6; ++i) {
-		results[i].qmap = aln_seqs + u_k;
-		u_k += MAX_SEQ_SIZE;
-		results[i].smap = aln_seqs + u_k;
-		u_k += MAX_SEQ_SIZE;
-	}
 	
 	vector<char> qstr;
 	vector<char> tstr;
+	AlignStringArena aln_strings; 	// qmap and smap of results
 	GapAligner* aligner = NULL;
 	if (TECH == TECH_PACBIO) {
 		aligner = new DiffAligner(0);
@@ -326,21 +274,10 @@ static void reference_mapping(int threadint)
 		ERROR("TECH must be either %d or %d", TECH_PACBIO, TECH_NANOPORE);
 	}
 
-    fileid=1;
-    while(fileid)
+    while(next_read_block(&block))
     {
-        pthread_mutex_lock(&mutilock);
-        localnum=runnumber;
-        runnumber++;
-        pthread_mutex_unlock(&mutilock);
-        if(localnum>=terminalnum)
-        {
-            fileid=0;
-            break;
-        }
-        if(localnum==terminalnum-1)read_end=readcount;
-        else read_end=(localnum+1)*PLL;
-        for(read_i=localnum*PLL; read_i<read_end; read_i++)
+        readinfo=block.mb->batch->reads.data();
+        for(read_i=block.first; read_i<block.end; read_i++)
         {
             read_name=readinfo[read_i].readno;
             read_len=readinfo[read_i].readlen;
@@ -408,13 +345,12 @@ static void reference_mapping(int threadint)
                 endnum=0;
                 for(k=0; k<cleave_num; k++)if(mvalue[k]>=0)
                     {
-                        count1=countin[mvalue[k]];
-                        //if(count1>20)continue;
-                        leadarray=databaseindex[mvalue[k]];
-                        for(i=0; i<count1; i++,leadarray++)
+                        reference_index_kmer_range(ref_index,mvalue[k],&first_loc,&last_loc);
+                        for(loc_i=first_loc; loc_i<last_loc; loc_i++)
                         {
-                            templong=(*leadarray)/ZV;
-                            u_k=(*leadarray)%ZV;
+                            kmer_loc=reference_index_position(ref_index,loc_i);
+                            templong=kmer_loc/ZV;
+                            u_k=kmer_loc%ZV;
                             if(templong>=0)
                             {
                                 temp_spr=database+templong;
@@ -555,16 +491,18 @@ static void reference_mapping(int threadint)
 
 			naln = 0;
 			nresults = 0;
+			aln_strings.reset();
             for(i=0; i<canidatenum; i++)
             {
 				extend_candidate(canidate_loc[i], 
 								 aligner, 
-								 seq, 
+								 ref_pac, 
 								 seqcount,
 								 onedata1, 
 								 onedata2, 
 								 qstr, 
 								 tstr, 
+								 aln_strings, 
 								 read_name, 
 								 read_len, 
 								 alns, 
@@ -578,12 +516,13 @@ static void reference_mapping(int threadint)
 								  results,
 								  nresults,
 								  aligner, 
-								  seq, 
+								  ref_pac, 
 								  seqcount,
 								  onedata1, 
 								  onedata2, 
 								  qstr, 
 								  tstr, 
+								  aln_strings, 
 								  read_name, 
 								  read_len, 
 								  ZV, 
@@ -671,13 +610,12 @@ static void reference_mapping(int threadint)
                     endnum=0;
                     for(k=0; k<cleave_num; k++)if(mvalue[k]>=0)
                         {
-                            count1=countin[mvalue[k]];
-                            //if(count1>20)continue;
-                            leadarray=databaseindex[mvalue[k]];
-                            for(i=0; i<count1; i++,leadarray++)
+                            reference_index_kmer_range(ref_index,mvalue[k],&first_loc,&last_loc);
+                            for(loc_i=first_loc; loc_i<last_loc; loc_i++)
                             {
-                                templong=(*leadarray)/ZVS;
-                                u_k=(*leadarray)%ZVS;
+                                kmer_loc=reference_index_position(ref_index,loc_i);
+                                templong=kmer_loc/ZVS;
+                                u_k=kmer_loc%ZVS;
                                 if(templong>=0)
                                 {
                                     temp_spr=database+templong;
@@ -818,16 +756,18 @@ static void reference_mapping(int threadint)
 
 				naln = 0;
 				nresults = 0;
+				aln_strings.reset();
                 for(i=0; i<canidatenum; i++)
                 {
 					extend_candidate(canidate_loc[i], 
 									 aligner, 
-									 seq, 
+									 ref_pac, 
 									 seqcount,
 									 onedata1, 
 									 onedata2, 
 									 qstr, 
 									 tstr, 
+									 aln_strings, 
 									 read_name, 
 									 read_len, 
 									 alns, 
@@ -841,12 +781,13 @@ static void reference_mapping(int threadint)
 									  results,
 									  nresults,
 									  aligner, 
-									  seq, 
+									  ref_pac, 
 									  seqcount,
 									  onedata1, 
 									  onedata2, 
 									  qstr, 
 									  tstr, 
+									  aln_strings, 
 									  read_name, 
 									  read_len, 
 									  ZVS, 
@@ -871,6 +812,7 @@ static void reference_mapping(int threadint)
 				}
             }
         }
+        finish_read_block(&block);
     }
 	delete aligner;
     free(fwd_database);
@@ -879,7 +821,6 @@ static void reference_mapping(int threadint)
 	free(rev_database);
     free(rev_index_list);
     free(rev_index_score);
-	delete[] aln_seqs;
 }
 
 
@@ -890,58 +831,39 @@ static void* multithread(void* arg)
     localthreadno=runthreadnum;
     runthreadnum++;
     pthread_mutex_unlock(&mutilock);
+    MetricsStage stage("map");
     reference_mapping(localthreadno);
 	return NULL;
 }
 
-static int load_fastq(FILE *fq)
-{
-    int readlen,readno,sum=0,flag;
-    char *pre;
-    readcount=0;
-    pre=savework;
-    while((flag=fscanf(fq,"%d\t%d\t%s\n",&readno,&readlen,pre))!=EOF&&readcount<SVM&&sum<MAXSTR)
-    {
-        readinfo[readcount].seqloc=pre;
-        readinfo[readcount].readno=readno;
-        readlen=strlen(pre);
-        readinfo[readcount].readlen=readlen;
-        sum=sum+readlen+1;
-        pre=pre+readlen+1;
-        readcount++;
-    }
-    if(flag!=EOF)
-    {
-        readinfo[readcount].seqloc=pre;
-        readinfo[readcount].readno=readno;
-        readlen=strlen(pre);
-        readinfo[readcount].readlen=readlen;
-        readcount++;
-        return(1);
-    }
-    else return(0);
-}
-
-
-int meap_ref_impl_large(int maxc, int noutput, int tech)
+int meap_ref_impl_large(int maxc, int noutput, int tech, const char* repeat_mask)
 {
 	MAXC = maxc;
 	TECH = tech;
 	num_output = noutput;
     char tempstr[300],fastafile[300];
-    int corenum,readall;
-    int fileflag,threadno,threadflag;
-    FILE *fp,*fastq;
+    int corenum,num_reads=0;
+    int threadno,threadflag;
+    FILE *fp;
     struct timeval tpstart, tpend;
     float timeuse;
     fp=fopen("config.txt","r");
-    assert(fscanf(fp,"%s\n%s\n%s\n%s\n%d %d\n",workpath,fastafile,fastqfile,tempstr,&corenum,&readall) == 6);
+    assert(fscanf(fp,"%s\n%s\n%s\n%s\n%d\n",workpath,fastafile,fastqfile,tempstr,&corenum) == 5);
     fclose(fp);
     threadnum=corenum;
     //building reference index
     gettimeofday(&tpstart, NULL);
-    seed_len=15;
-    creat_ref_index(fastafile);
+    seed_len=REFERENCE_INDEX_KMER_SIZE;
+    {
+        MetricsStage stage("build_index");
+        // -r is either a FASTA file or an index written by 'mecat2ref index'
+        if(is_reference_index_file(fastafile))ref_index=load_reference_index(fastafile,seed_len,repeat_mask);
+        else ref_index=build_reference_index(fastafile,seed_len,repeat_mask,threadnum);
+        sprintf(tempstr,"%s/chrindex.txt",workpath);
+        write_chromosome_table(ref_index,tempstr);
+        seqcount=ref_index->ref_size;
+        printf("%ld\n",seqcount);
+    }
     gettimeofday(&tpend, NULL);
     timeuse = 1000000 * (tpend.tv_sec - tpstart.tv_sec) + tpend.tv_usec - tpstart.tv_usec;
     timeuse /= 1000000;
@@ -951,8 +873,6 @@ int meap_ref_impl_large(int maxc, int noutput, int tech)
 
     gettimeofday(&tpstart, NULL);
 
-    savework=(char *)malloc((MAXSTR+RM)*sizeof(char));
-    readinfo=(ReadFasta*)malloc((SVM+2)*sizeof(ReadFasta));
     thread=(pthread_t*)malloc(threadnum*sizeof(pthread_t));
     outfile=(FILE **)malloc(threadnum*sizeof(FILE *));
     for(threadno=0; threadno<threadnum; threadno++)
@@ -960,46 +880,30 @@ int meap_ref_impl_large(int maxc, int noutput, int tech)
         sprintf(tempstr,"%s/%d.r",workpath,threadno+1);
         outfile[threadno]=fopen(tempstr,"w");
     }
-    sprintf(tempstr,"%s/0.fq",workpath);
-    fastq=fopen(tempstr,"r");
-    //multi process thread
-    fileflag=1;
-    while(fileflag)
+    // the reads are streamed from the input. of the kReadBatchSlots batches, the tail of one and the
+    // next one can be mapped while the loader reads the third. together they hold about MAXSTR
+    // bases, the size of the former savework buffer, more only while a read larger than a batch is mapped.
+    loader=new ReadBatchLoader(fastqfile,SVM,MAXSTR/kReadBatchSlots,kReadBatchSlots);
+    curr_batch=NULL;
+    input_done=false;
+    num_batches_fetched=0;
+    num_reads_loaded=0;
+    runthreadnum=0;
+    pthread_mutex_init(&mutilock,NULL);
+    pthread_mutex_init(&fetchlock,NULL);
+    for(threadno=0; threadno<threadnum; threadno++)
     {
-        fileflag=load_fastq(fastq);
-        if(readcount%PLL==0)terminalnum=readcount/PLL;
-        else terminalnum=readcount/PLL+1;
-        if(readcount<=0)break;
-        runnumber=0;
-        runthreadnum=0;
-
-
-        pthread_mutex_init(&mutilock,NULL);
-        //creat thread
-        if(readcount>0)
-        {
-            for(threadno=0; threadno<threadnum; threadno++)
-            {
-                threadflag= pthread_create(&thread[threadno], NULL, multithread, NULL);
-                if(threadflag)
-                {
-                    printf("ERROR; return code is %d\n", threadflag);
-                    return EXIT_FAILURE;
-                }
-            }
-            //waiting thread
-            for(threadno=0; threadno<threadnum; threadno++)pthread_join(thread[threadno],NULL);
-
-        }
-
-        // reference_mapping(1);
+        threadflag= pthread_create(&thread[threadno], NULL, multithread, NULL);
+        if(threadflag)ERROR("failed to create a mapping thread, return code is %d", threadflag);
     }
-    fclose(fastq);
+    for(threadno=0; threadno<threadnum; threadno++)pthread_join(thread[threadno],NULL);
+    num_reads=num_reads_loaded;
+    delete loader;
+    loader=NULL;
+    pthread_mutex_destroy(&mutilock);
+    pthread_mutex_destroy(&fetchlock);
     //clear creat index memory
-    free(countin);
-    free(databaseindex);
-    free(allloc);
-    free(REFSEQ);
+    ref_index=destroy_reference_index(ref_index);
 
     gettimeofday(&tpend, NULL);
     timeuse = 1000000 * (tpend.tv_sec - tpstart.tv_sec) + tpend.tv_usec - tpstart.tv_usec;
@@ -1007,11 +911,10 @@ int meap_ref_impl_large(int maxc, int noutput, int tech)
     fp = fopen("config.txt", "a");
     fprintf(fp, "The Mapping Time: %f sec\n", timeuse);
     fclose(fp);
+    report_workspace_usage();
 
     for(threadno=0; threadno<threadnum; threadno++)fclose(outfile[threadno]);
     free(outfile);
-    free(savework);
-    free(readinfo);
     free(thread);
-    return 0;
+    return num_reads;
 }
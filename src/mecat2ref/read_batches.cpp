@@ -0,0 +1,165 @@
+#include "read_batches.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "../common/block_fasta_reader.h"
+
+using namespace std;
+
+ReadBatchLoader::ReadBatchLoader(const char* file_name, const int max_batch_reads, const idx_t max_batch_bases, const int num_slots)
+	: file_name_(file_name), max_batch_reads_(max_batch_reads), max_batch_bases_(max_batch_bases),
+	  loading_done_(false), stop_(false)
+{
+	r_assert(max_batch_reads > 0 && max_batch_bases > 0 && num_slots > 0);
+	gzFile in = gzopen(file_name, "rb");
+	if (!in) ERROR("cannot open file \'%s\' for reading", file_name);
+	first_read_id_ = (gzgetc(in) == '>') ? 0 : 1;
+	gzclose(in);
+
+	for (int i = 0; i < num_slots; ++i)
+	{
+		batches_.push_back(new Batch);
+		free_batches_.push_back(batches_.back());
+	}
+	pthread_mutex_init(&lock_, NULL);
+	pthread_cond_init(&free_cond_, NULL);
+	pthread_cond_init(&full_cond_, NULL);
+	int err_code = pthread_create(&loader_tid_, NULL, loader_func, (void*)this);
+	if (err_code) ERROR("cannot create the read loader thread, return code is %d", err_code);
+}
+
+ReadBatchLoader::~ReadBatchLoader()
+{
+	pthread_mutex_lock(&lock_);
+	stop_ = true;
+	pthread_cond_broadcast(&free_cond_);
+	pthread_mutex_unlock(&lock_);
+	pthread_join(loader_tid_, NULL);
+
+	for (size_t i = 0; i < batches_.size(); ++i) delete batches_[i];
+	pthread_mutex_destroy(&lock_);
+	pthread_cond_destroy(&free_cond_);
+	pthread_cond_destroy(&full_cond_);
+}
+
+ReadBatchLoader::Batch*
+ReadBatchLoader::next_batch()
+{
+	pthread_mutex_lock(&lock_);
+	while (full_batches_.empty() && !loading_done_) pthread_cond_wait(&full_cond_, &lock_);
+	Batch* batch = NULL;
+	if (!full_batches_.empty())
+	{
+		batch = full_batches_.front();
+		full_batches_.pop_front();
+	}
+	pthread_mutex_unlock(&lock_);
+	return batch;
+}
+
+void
+ReadBatchLoader::release_batch(Batch* batch)
+{
+	pthread_mutex_lock(&lock_);
+	free_batches_.push_back(batch);
+	pthread_cond_signal(&free_cond_);
+	pthread_mutex_unlock(&lock_);
+}
+
+void*
+ReadBatchLoader::loader_func(void* arg)
+{
+	ReadBatchLoader* loader = (ReadBatchLoader*)arg;
+	loader->x_load_batches();
+	pthread_mutex_lock(&loader->lock_);
+	loader->loading_done_ = true;
+	pthread_cond_broadcast(&loader->full_cond_);
+	pthread_mutex_unlock(&loader->lock_);
+	return NULL;
+}
+
+// an empty batch to fill, NULL if the loader is stopped
+ReadBatchLoader::Batch*
+ReadBatchLoader::x_free_batch()
+{
+	pthread_mutex_lock(&lock_);
+	while (free_batches_.empty() && !stop_) pthread_cond_wait(&free_cond_, &lock_);
+	Batch* batch = NULL;
+	if (!stop_)
+	{
+		batch = free_batches_.front();
+		free_batches_.pop_front();
+	}
+	pthread_mutex_unlock(&lock_);
+	if (batch)
+	{
+		// a read larger than max_batch_bases_ grew the buffer of its batch, give that back
+		if ((idx_t)batch->seqs.capacity() > max_batch_bases_) vector<char>().swap(batch->seqs);
+		batch->seqs.clear();
+		batch->reads.clear();
+	}
+	return batch;
+}
+
+void
+ReadBatchLoader::x_publish_batch(Batch* batch)
+{
+	// seqs may have been reallocated while the batch was filled
+	char* seq = batch->seqs.data();
+	for (size_t i = 0; i < batch->reads.size(); ++i)
+	{
+		batch->reads[i].seqloc = seq;
+		seq += batch->reads[i].readlen + 1;
+	}
+	pthread_mutex_lock(&lock_);
+	full_batches_.push_back(batch);
+	pthread_cond_signal(&full_cond_);
+	pthread_mutex_unlock(&lock_);
+}
+
+// room for size more bytes in seqs; the capacity grows geometrically up to max_batch_bases_ and
+// beyond that only for a single read larger than max_batch_bases_
+void
+ReadBatchLoader::x_reserve(Batch* batch, const idx_t size)
+{
+	const idx_t needed = batch->seqs.size() + size;
+	if (needed <= (idx_t)batch->seqs.capacity()) return;
+	const idx_t grown = min(max_batch_bases_, 2 * (idx_t)batch->seqs.capacity());
+	batch->seqs.reserve(max(needed, grown));
+}
+
+void
+ReadBatchLoader::x_load_batches()
+{
+	BlockFastaReader reader(file_name_, 1);
+	const char* header;
+	const char* seq;
+	idx_t header_size, seq_size;
+	int read_id = first_read_id_;
+	Batch* batch = NULL;
+	while (reader.next_record(header, header_size, seq, seq_size))
+	{
+		if (batch && (idx_t)batch->seqs.size() + seq_size + 1 > max_batch_bases_)
+		{
+			x_publish_batch(batch);
+			batch = NULL;
+		}
+		if (!batch && !(batch = x_free_batch())) return;
+		x_reserve(batch, seq_size + 1);
+		batch->seqs.insert(batch->seqs.end(), seq, seq + seq_size);
+		batch->seqs.push_back('\0');
+		ReadFasta read;
+		read.readno = read_id++;
+		read.readlen = seq_size;
+		read.seqloc = NULL;
+		batch->reads.push_back(read);
+		if ((int)batch->reads.size() >= max_batch_reads_)
+		{
+			x_publish_batch(batch);
+			batch = NULL;
+		}
+	}
+	if (batch) x_publish_batch(batch);
+}
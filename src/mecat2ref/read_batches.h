@@ -0,0 +1,69 @@
+#ifndef READ_BATCHES_H
+#define READ_BATCHES_H
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "mecat2ref_defs.h"
+#include "../common/defs.h"
+
+/* streaming read input of mecat2ref.
+ *
+ * a loader thread parses the reads (FASTA or FASTQ, gzip compressed or not) with BlockFastaReader and
+ * fills batches of at most max_batch_reads reads and max_batch_bases bytes of sequence (a read larger
+ * than that gets a batch of its own). there are num_slots batches: the loader waits for one to be
+ * released while all are being mapped or waiting to be. a batch keeps its buffer of up to
+ * max_batch_bases bytes for the next reads, so the reads take about num_slots * max_batch_bases bytes.
+ * a read larger than max_batch_bases grows the buffer of its batch to its size for as long as it is
+ * mapped; the buffer is freed when the batch is reused.
+ *
+ * reads are numbered in input order from 0 in FASTA input and from 1 in FASTQ input, the ids the
+ * former 0.fq conversion gave them.
+ */
+
+class ReadBatchLoader
+{
+public:
+	struct Batch
+	{
+		std::vector<char>		seqs;		// the reads back to back, each '\0' terminated
+		std::vector<ReadFasta>	reads;		// seqloc points into seqs
+	};
+
+public:
+	ReadBatchLoader(const char* file_name, const int max_batch_reads, const idx_t max_batch_bases, const int num_slots);
+	~ReadBatchLoader();
+
+	// the next batch in input order, NULL at the end of input
+	Batch* next_batch();
+
+	// hands a batch returned by next_batch() back to the loader
+	void release_batch(Batch* batch);
+
+private:
+	static void* loader_func(void* arg);
+	void x_load_batches();
+	Batch* x_free_batch();
+	void x_reserve(Batch* batch, const idx_t size);
+	void x_publish_batch(Batch* batch);
+
+private:
+	const char*				file_name_;
+	int						first_read_id_;
+	int						max_batch_reads_;
+	idx_t					max_batch_bases_;
+	pthread_t				loader_tid_;
+
+	pthread_mutex_t			lock_;
+	pthread_cond_t			free_cond_;		// a batch was released
+	pthread_cond_t			full_cond_;		// a batch is loaded, or loading is done
+	std::vector<Batch*>		batches_;
+	std::deque<Batch*>		free_batches_;
+	std::deque<Batch*>		full_batches_;
+	bool					loading_done_;
+	bool					stop_;
+};
+
+#endif // READ_BATCHES_H
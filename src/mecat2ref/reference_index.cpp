@@ -0,0 +1,464 @@
+#include "reference_index.h"
+
+#include "../common/block_fasta_reader.h"
+#include "../common/metrics.h"
+#include "../common/packed_db.h"
+#include "../common/repeat_mask.h"
+#include "../common/split_database.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// get_dna_encode_table() code of a base -> its atcttrans() code
+static const uint32_t kKmerCode[4] = { 0, 2, 3, 1 };
+
+// runs [first, second) of bases other than A, C, G and T
+typedef vector<pair<idx_t, idx_t> > base_runs_t;
+
+// the k-mers of a repeat mask are 2-bit packed with the get_dna_encode_table() codes
+static uint32_t
+mask_kmer_to_index(const uint32_t kmer, const int kmer_size)
+{
+	uint32_t k = 0;
+	for (int i = kmer_size - 1; i >= 0; --i) k = (k << 2) | kKmerCode[(kmer >> (2 * i)) & 3];
+	return k;
+}
+
+static inline void
+set_reference_index_value(uint32_t* lo, u1_t* hi, const idx_t i, const idx_t v)
+{
+	lo[i] = (uint32_t)v;
+	if (hi) hi[i] = (u1_t)(v >> 32);
+}
+
+/* packs the reference into index->pac and fills the chromosome table. bases other than A, C, G and T
+ * are packed as A and listed in ambiguous. */
+static void
+read_reference(const char* fasta, const int num_threads, reference_index_t* index, base_runs_t& ambiguous)
+{
+	struct stat st;
+	idx_t capacity = (stat(fasta, &st) == 0 && st.st_size > 0) ? st.st_size : (1 << 20);
+	u1_t* pac;
+	safe_calloc(pac, u1_t, (capacity + 3) / 4);
+	vector<reference_chr_t> chromosomes;
+	string names;
+	idx_t size = 0;
+
+	BlockFastaReader reader(fasta, num_threads, true);
+	const char* header;
+	const char* seq;
+	idx_t header_size, seq_size;
+	while (reader.next_record(header, header_size, seq, seq_size))
+	{
+		reference_chr_t chr;
+		chr.start = size;
+		chr.size = seq_size;
+		chr.name_offset = names.size();
+		idx_t n = 0;
+		while (n < header_size && header[n] != ' ' && header[n] != '\t') ++n;
+		names.append(header, n);
+		names.push_back('\0');
+		chromosomes.push_back(chr);
+
+		if (size + seq_size > capacity)
+		{
+			const idx_t old_bytes = (capacity + 3) / 4;
+			capacity = MAX(2 * capacity, size + seq_size);
+			const idx_t new_bytes = (capacity + 3) / 4;
+			safe_realloc(pac, u1_t, new_bytes);
+			memset(pac + old_bytes, 0, new_bytes - old_bytes);
+		}
+		for (idx_t i = 0; i < seq_size; ++i, ++size)
+		{
+			const u1_t c = seq[i];
+			if (c < 4) PackedDB::set_char(pac, size, c);
+			else if (!ambiguous.empty() && ambiguous.back().second == size) ++ambiguous.back().second;
+			else ambiguous.push_back(make_pair(size, size + 1));
+		}
+	}
+	if (chromosomes.empty()) ERROR("there is no sequence in reference \'%s\'", fasta);
+
+	index->ref_size = size;
+	index->pac = pac;
+	index->num_chr = chromosomes.size();
+	safe_malloc(index->chromosomes, reference_chr_t, chromosomes.size());
+	memcpy(index->chromosomes, chromosomes.data(), sizeof(reference_chr_t) * chromosomes.size());
+	index->names_bytes = names.size();
+	safe_malloc(index->names, char, names.size());
+	memcpy(index->names, names.data(), names.size());
+}
+
+// calls visit(kmer, position) for every k-mer free of ambiguous bases, position is its 1-based start
+template <typename Visitor>
+static void
+for_each_reference_kmer(const reference_index_t* index, const base_runs_t& ambiguous, Visitor& visit)
+{
+	const int kmer_size = index->kmer_size;
+	const uint32_t kmer_mask = ((uint32_t)1 << (2 * kmer_size)) - 1;
+	uint32_t kmer = 0;
+	int num_bases = 0;
+	size_t run = 0;
+	for (idx_t i = 0; i < index->ref_size; ++i)
+	{
+		if (run < ambiguous.size() && i == ambiguous[run].first)
+		{
+			i = ambiguous[run].second - 1;
+			++run;
+			kmer = 0;
+			num_bases = 0;
+			continue;
+		}
+		kmer = ((kmer << 2) | kKmerCode[PackedDB::get_char(index->pac, i)]) & kmer_mask;
+		if (++num_bases >= kmer_size) visit(kmer, i + 2 - kmer_size);
+	}
+}
+
+struct CountReferenceKmers
+{
+	uint32_t* counts;
+	void operator()(const uint32_t kmer, const idx_t)
+	{
+		if (counts[kmer] <= REFERENCE_INDEX_MAX_KMER_OCC) ++counts[kmer];
+	}
+};
+
+struct FillReferencePositions
+{
+	reference_index_t* index;
+	uint32_t* filled;
+	void operator()(const uint32_t kmer, const idx_t position)
+	{
+		idx_t first, last;
+		reference_index_kmer_range(index, kmer, &first, &last);
+		if (first == last) return;
+		set_reference_index_value(index->positions_lo, index->positions_hi, first + filled[kmer]++, position);
+	}
+};
+
+reference_index_t*
+build_reference_index(const char* fasta, const int kmer_size, const char* repeat_mask, const int num_threads)
+{
+	r_assert(kmer_size >= 3 && kmer_size <= 15);
+	DynamicTimer dtimer(__func__);
+	reference_index_t* index;
+	safe_calloc(index, reference_index_t, 1);
+	index->kmer_size = kmer_size;
+	base_runs_t ambiguous;
+	read_reference(fasta, num_threads, index, ambiguous);
+
+	const idx_t num_possible = (idx_t)1 << (2 * kmer_size);
+	uint32_t* counts;
+	safe_calloc(counts, uint32_t, num_possible);
+	CountReferenceKmers count = { counts };
+	for_each_reference_kmer(index, ambiguous, count);
+
+	// masked repeat k-mers are dropped like the ones occurring more than REFERENCE_INDEX_MAX_KMER_OCC times
+	if (repeat_mask)
+	{
+		repeat_mask_t* mask = load_repeat_mask(repeat_mask);
+		if (mask->kmer_size != kmer_size)
+			ERROR("repeat mask \'%s\' holds %d-mers, but %d-mers are indexed", repeat_mask, mask->kmer_size, kmer_size);
+		long num_masked = 0;
+		for (idx_t k = 0; k < mask->num_kmers; ++k)
+		{
+			// the mask lists canonical k-mers, both strands are dropped
+			const uint32_t kmers[2] = { mask->kmers[k], repeat_mask_reverse_complement(mask->kmers[k], kmer_size) };
+			for (int s = 0; s < (kmers[0] == kmers[1] ? 1 : 2); ++s)
+			{
+				uint32_t* c = counts + mask_kmer_to_index(kmers[s], kmer_size);
+				if (*c <= REFERENCE_INDEX_MAX_KMER_OCC) num_masked += *c;
+				*c = 0;
+			}
+		}
+		fprintf(stderr, "positions of masked repeat kmers: %ld\n", num_masked);
+		metrics_count("repeat_positions_masked", num_masked);
+		index->mask_checksum = mask->checksum;
+		destroy_repeat_mask(mask);
+	}
+
+	const idx_t num_words = num_possible >> 6;
+	safe_calloc(index->kmer_bits, uint64_t, num_words);
+	safe_malloc(index->kmer_ranks, uint32_t, num_words);
+	for (idx_t w = 0; w < num_words; ++w)
+	{
+		index->kmer_ranks[w] = index->num_kmers;
+		uint64_t bits = 0;
+		for (int b = 0; b < 64; ++b)
+		{
+			const uint32_t c = counts[(w << 6) + b];
+			if (c == 0 || c > REFERENCE_INDEX_MAX_KMER_OCC) continue;
+			bits |= 1ULL << b;
+			++index->num_kmers;
+			index->num_positions += c;
+		}
+		index->kmer_bits[w] = bits;
+	}
+
+	const idx_t max_32bit = (idx_t)UINT32_MAX;
+	index->pos_bits = (index->ref_size < max_32bit && index->num_positions < max_32bit) ? 32 : 40;
+	safe_malloc(index->kmer_starts_lo, uint32_t, index->num_kmers + 1);
+	safe_malloc(index->positions_lo, uint32_t, index->num_positions);
+	if (index->pos_bits == 40)
+	{
+		safe_malloc(index->kmer_starts_hi, u1_t, index->num_kmers + 1);
+		safe_malloc(index->positions_hi, u1_t, index->num_positions);
+	}
+	idx_t r = 0, s = 0;
+	for (idx_t k = 0; k < num_possible; ++k)
+	{
+		if (!((index->kmer_bits[k >> 6] >> (k & 63)) & 1)) continue;
+		set_reference_index_value(index->kmer_starts_lo, index->kmer_starts_hi, r++, s);
+		s += counts[k];
+		counts[k] = 0;
+	}
+	set_reference_index_value(index->kmer_starts_lo, index->kmer_starts_hi, r, s);
+
+	FillReferencePositions fill = { index, counts };
+	for_each_reference_kmer(index, ambiguous, fill);
+	safe_free(counts);
+
+	fprintf(stderr, "reference: %lld bases in %d sequences\n", (long long)index->ref_size, index->num_chr);
+	fprintf(stderr, "number of kmers: %lld (%lld distinct), %d-bit positions\n",
+			(long long)index->num_positions, (long long)index->num_kmers, index->pos_bits);
+	return index;
+}
+
+reference_index_t*
+destroy_reference_index(reference_index_t* index)
+{
+	if (index->map_addr)
+	{
+		munmap(index->map_addr, index->map_size);
+		safe_free(index);
+		return NULL;
+	}
+	safe_free(index->chromosomes);
+	safe_free(index->names);
+	safe_free(index->pac);
+	safe_free(index->kmer_bits);
+	safe_free(index->kmer_ranks);
+	safe_free(index->kmer_starts_lo);
+	if (index->kmer_starts_hi) safe_free(index->kmer_starts_hi);
+	safe_free(index->positions_lo);
+	if (index->positions_hi) safe_free(index->positions_hi);
+	safe_free(index);
+	return NULL;
+}
+
+static inline int64_t
+align_index_offset(int64_t offset)
+{
+	return (offset + VOLUME_ALIGN - 1) / VOLUME_ALIGN * VOLUME_ALIGN;
+}
+
+static uint64_t
+reference_index_header_checksum(const reference_index_header_t* hdr)
+{
+	const uint8_t* p = (const uint8_t*)hdr;
+	const size_t n = offsetof(reference_index_header_t, header_checksum);
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 0x100000001B3ULL; }
+	return h;
+}
+
+static void
+write_index_section(FILE* out, int64_t* curr, const int64_t offset, const void* p, const int64_t bytes)
+{
+	static const char zeros[VOLUME_ALIGN] = { 0 };
+	r_assert(offset >= *curr && offset - *curr <= VOLUME_ALIGN);
+	if (offset > *curr) SAFE_WRITE(zeros, char, offset - *curr, out);
+	if (bytes) SAFE_WRITE(p, char, bytes, out);
+	*curr = offset + bytes;
+}
+
+void
+dump_reference_index(const char* path, reference_index_t* index)
+{
+	DynamicTimer dtimer(__func__);
+	reference_index_header_t hdr;
+	memset(&hdr, 0, sizeof(reference_index_header_t));
+	memcpy(hdr.magic, REFERENCE_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = REFERENCE_INDEX_VERSION;
+	hdr.kmer_size = index->kmer_size;
+	hdr.pos_bits = index->pos_bits;
+	hdr.max_kmer_occ = REFERENCE_INDEX_MAX_KMER_OCC;
+	hdr.num_chr = index->num_chr;
+	hdr.ref_size = index->ref_size;
+	hdr.names_bytes = index->names_bytes;
+	hdr.num_kmers = index->num_kmers;
+	hdr.num_positions = index->num_positions;
+	hdr.mask_checksum = index->mask_checksum;
+	const int64_t num_words = ((int64_t)1 << (2 * index->kmer_size)) >> 6;
+	const int64_t chr_bytes = sizeof(reference_chr_t) * index->num_chr;
+	const int64_t pac_bytes = (index->ref_size + 3) / 4;
+	const int64_t bits_bytes = sizeof(uint64_t) * num_words;
+	const int64_t ranks_bytes = sizeof(uint32_t) * num_words;
+	const int64_t starts_bytes = sizeof(uint32_t) * (index->num_kmers + 1);
+	const int64_t positions_bytes = sizeof(uint32_t) * index->num_positions;
+	const bool hi = index->pos_bits == 40;
+	hdr.chromosomes_offset = align_index_offset(sizeof(reference_index_header_t));
+	hdr.names_offset = align_index_offset(hdr.chromosomes_offset + chr_bytes);
+	hdr.pac_offset = align_index_offset(hdr.names_offset + hdr.names_bytes);
+	hdr.kmer_bits_offset = align_index_offset(hdr.pac_offset + pac_bytes);
+	hdr.kmer_ranks_offset = align_index_offset(hdr.kmer_bits_offset + bits_bytes);
+	hdr.kmer_starts_lo_offset = align_index_offset(hdr.kmer_ranks_offset + ranks_bytes);
+	int64_t end = hdr.kmer_starts_lo_offset + starts_bytes;
+	if (hi)
+	{
+		hdr.kmer_starts_hi_offset = align_index_offset(end);
+		end = hdr.kmer_starts_hi_offset + starts_bytes / 4;
+	}
+	hdr.positions_lo_offset = align_index_offset(end);
+	end = hdr.positions_lo_offset + positions_bytes;
+	if (hi)
+	{
+		hdr.positions_hi_offset = align_index_offset(end);
+		end = hdr.positions_hi_offset + positions_bytes / 4;
+	}
+	hdr.file_size = align_index_offset(end);
+	hdr.header_checksum = reference_index_header_checksum(&hdr);
+
+	// write to a private file first so that mapping runs never see a partial index
+	char tmp_name[2048];
+	sprintf(tmp_name, "%s.tmp.%d", path, (int)getpid());
+	FILE* out = fopen(tmp_name, "wb");
+	if (!out) ERROR("failed to open file \'%s\' for writing", tmp_name);
+	int64_t curr = 0;
+	write_index_section(out, &curr, 0, &hdr, sizeof(reference_index_header_t));
+	write_index_section(out, &curr, hdr.chromosomes_offset, index->chromosomes, chr_bytes);
+	write_index_section(out, &curr, hdr.names_offset, index->names, hdr.names_bytes);
+	write_index_section(out, &curr, hdr.pac_offset, index->pac, pac_bytes);
+	write_index_section(out, &curr, hdr.kmer_bits_offset, index->kmer_bits, bits_bytes);
+	write_index_section(out, &curr, hdr.kmer_ranks_offset, index->kmer_ranks, ranks_bytes);
+	write_index_section(out, &curr, hdr.kmer_starts_lo_offset, index->kmer_starts_lo, starts_bytes);
+	if (hi) write_index_section(out, &curr, hdr.kmer_starts_hi_offset, index->kmer_starts_hi, starts_bytes / 4);
+	write_index_section(out, &curr, hdr.positions_lo_offset, index->positions_lo, positions_bytes);
+	if (hi) write_index_section(out, &curr, hdr.positions_hi_offset, index->positions_hi, positions_bytes / 4);
+	write_index_section(out, &curr, hdr.file_size, NULL, 0);
+	if (fclose(out)) ERROR("failed to close file \'%s\'", tmp_name);
+	if (rename(tmp_name, path))
+	{
+		unlink(tmp_name);
+		ERROR("failed to rename \'%s\' to \'%s\'", tmp_name, path);
+	}
+	metrics_count("bytes_written_index", hdr.file_size);
+}
+
+bool
+is_reference_index_file(const char* path)
+{
+	char magic[8];
+	FILE* in = fopen(path, "rb");
+	if (!in) return false;
+	const bool r = fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, REFERENCE_INDEX_MAGIC, sizeof(magic)) == 0;
+	fclose(in);
+	return r;
+}
+
+reference_index_t*
+load_reference_index(const char* path, const int kmer_size, const char* repeat_mask)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) ERROR("cannot open reference index \'%s\'", path);
+	struct stat sbuf;
+	reference_index_header_t hdr;
+	bool valid = fstat(fd, &sbuf) == 0
+				 &&
+				 (size_t)sbuf.st_size >= sizeof(reference_index_header_t)
+				 &&
+				 pread(fd, &hdr, sizeof(reference_index_header_t), 0) == (ssize_t)sizeof(reference_index_header_t)
+				 &&
+				 memcmp(hdr.magic, REFERENCE_INDEX_MAGIC, sizeof(hdr.magic)) == 0
+				 &&
+				 hdr.version == REFERENCE_INDEX_VERSION
+				 &&
+				 hdr.header_checksum == reference_index_header_checksum(&hdr)
+				 &&
+				 hdr.file_size == (int64_t)sbuf.st_size
+				 &&
+				 (hdr.pos_bits == 32 || hdr.pos_bits == 40)
+				 &&
+				 hdr.positions_lo_offset + (int64_t)sizeof(uint32_t) * hdr.num_positions <= hdr.file_size
+				 &&
+				 (hdr.pos_bits == 32 || hdr.positions_hi_offset + hdr.num_positions <= hdr.file_size);
+	if (!valid)
+	{
+		close(fd);
+		ERROR("\'%s\' is not a version %d mecat2ref index or is corrupted, rebuild it with \'mecat2ref index\'", path, REFERENCE_INDEX_VERSION);
+	}
+	if (hdr.kmer_size != kmer_size || hdr.max_kmer_occ != REFERENCE_INDEX_MAX_KMER_OCC)
+	{
+		close(fd);
+		ERROR("reference index \'%s\' holds %d-mers occurring at most %d times, %d-mers occurring at most %d times are expected",
+			  path, hdr.kmer_size, hdr.max_kmer_occ, kmer_size, REFERENCE_INDEX_MAX_KMER_OCC);
+	}
+	if (repeat_mask)
+	{
+		repeat_mask_t* mask = load_repeat_mask(repeat_mask);
+		const bool same_mask = mask->checksum == hdr.mask_checksum;
+		destroy_repeat_mask(mask);
+		if (!same_mask)
+		{
+			close(fd);
+			ERROR("reference index \'%s\' was not built with repeat mask \'%s\', build it with \'mecat2ref index -M\'", path, repeat_mask);
+		}
+	}
+	else if (hdr.mask_checksum)
+	{
+		LOG(stderr, "reference index \'%s\' was built with a repeat mask, its k-mers are not indexed", path);
+	}
+
+	void* addr = mmap(NULL, hdr.file_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) ERROR("failed to mmap reference index \'%s\'", path);
+	char* base = (char*)addr;
+	const bool hi = hdr.pos_bits == 40;
+	reference_index_t* index;
+	safe_calloc(index, reference_index_t, 1);
+	index->kmer_size = hdr.kmer_size;
+	index->pos_bits = hdr.pos_bits;
+	index->ref_size = hdr.ref_size;
+	index->num_chr = hdr.num_chr;
+	index->chromosomes = (reference_chr_t*)(base + hdr.chromosomes_offset);
+	index->names = base + hdr.names_offset;
+	index->names_bytes = hdr.names_bytes;
+	index->pac = (u1_t*)(base + hdr.pac_offset);
+	index->num_kmers = hdr.num_kmers;
+	index->num_positions = hdr.num_positions;
+	index->kmer_bits = (uint64_t*)(base + hdr.kmer_bits_offset);
+	index->kmer_ranks = (uint32_t*)(base + hdr.kmer_ranks_offset);
+	index->kmer_starts_lo = (uint32_t*)(base + hdr.kmer_starts_lo_offset);
+	index->kmer_starts_hi = hi ? (u1_t*)(base + hdr.kmer_starts_hi_offset) : NULL;
+	index->positions_lo = (uint32_t*)(base + hdr.positions_lo_offset);
+	index->positions_hi = hi ? (u1_t*)(base + hdr.positions_hi_offset) : NULL;
+	index->mask_checksum = hdr.mask_checksum;
+	index->map_addr = addr;
+	index->map_size = hdr.file_size;
+	LOG(stderr, "load reference index from \'%s\': %lld bases in %d sequences, %lld kmers", path, (long long)index->ref_size, index->num_chr, (long long)index->num_positions);
+	return index;
+}
+
+void
+write_chromosome_table(const reference_index_t* index, const char* path)
+{
+	FILE* out = fopen(path, "w");
+	if (!out) ERROR("failed to open file \'%s\' for writing", path);
+	for (int i = 0; i < index->num_chr; ++i)
+	{
+		const reference_chr_t& chr = index->chromosomes[i];
+		fprintf(out, "%lld\t%s\t%lld\n", (long long)chr.start, index->names + chr.name_offset, (long long)chr.size);
+	}
+	fprintf(out, "%lld\t%s\n", (long long)index->ref_size, "FileEnd");
+	fclose(out);
+}
@@ -0,0 +1,139 @@
+#ifndef REFERENCE_INDEX_H
+#define REFERENCE_INDEX_H
+
+#include "../common/defs.h"
+
+/* reference and k-mer index of mecat2ref.
+ *
+ * the reference is kept 2-bit packed (PackedDB layout, codes of get_dna_encode_table()); bases other
+ * than A, C, G and T are stored as A and break the k-mers around them. the chromosomes are concatenated
+ * in input order, chromosomes[i] gives the start, size and name of the i-th one.
+ *
+ * the k-mers (atcttrans() codes: A = 0, T = 1, C = 2, G = 3, the first base in the highest bits) are
+ * indexed like the former countin/databaseindex tables:
+ * 		kmer_bits 	one bit per possible k-mer, set if it is indexed
+ * 		kmer_ranks[w] 	number of bits set in kmer_bits[0 .. w)
+ * the r-th indexed k-mer (r = its rank) occurs at positions[kmer_starts[r] .. kmer_starts[r + 1]),
+ * a position being the 1-based start of the k-mer in the reference, in increasing order.
+ * k-mers occurring more than REFERENCE_INDEX_MAX_KMER_OCC times and the k-mers of a repeat mask are
+ * not indexed.
+ *
+ * kmer_starts and positions hold 32-bit values, or 40-bit ones (pos_bits = 40) for references of 4G
+ * bases or more: the low 32 bits in *_lo and the high 8 bits in *_hi.
+ *
+ * 'mecat2ref index' writes the index to a file that mapping runs mmap instead of building it again:
+ * [reference_index_header_t][chromosomes][names][pac][kmer_bits][kmer_ranks][kmer_starts][positions]
+ * every section starts at a VOLUME_ALIGN boundary.
+ */
+
+#define REFERENCE_INDEX_MAGIC 			"MECATRIX"
+#define REFERENCE_INDEX_VERSION 		1
+#define REFERENCE_INDEX_MAX_KMER_OCC 	128
+#define REFERENCE_INDEX_KMER_SIZE 		15 		// k-mers of the mapper
+
+typedef struct
+{
+	int64_t 	start;
+	int64_t 	size;
+	int64_t 	name_offset; 	// into names, '\0' terminated
+} reference_chr_t;
+
+typedef struct
+{
+	int 				kmer_size;
+	int 				pos_bits; 			// 32 or 40
+	idx_t 				ref_size; 			// bases
+	int 				num_chr;
+	reference_chr_t* 	chromosomes;
+	char* 				names;
+	idx_t 				names_bytes;
+	u1_t* 				pac;
+	idx_t 				num_kmers; 			// indexed distinct k-mers
+	idx_t 				num_positions;
+	uint64_t* 			kmer_bits; 			// 4^kmer_size / 64 words
+	uint32_t* 			kmer_ranks; 		// 4^kmer_size / 64 entries
+	uint32_t* 			kmer_starts_lo; 	// num_kmers + 1 entries
+	u1_t* 				kmer_starts_hi; 	// NULL with 32-bit values
+	uint32_t* 			positions_lo; 		// num_positions entries
+	u1_t* 				positions_hi; 		// NULL with 32-bit values
+	uint64_t 			mask_checksum; 		// 0 = no repeat mask
+	// non-NULL when the arrays above point into a read-only mapping of an index file
+	void* 				map_addr;
+	size_t 				map_size;
+} reference_index_t;
+
+typedef struct
+{
+	char 		magic[8];
+	int 		version;
+	int 		kmer_size;
+	int 		pos_bits;
+	int 		max_kmer_occ;
+	int 		num_chr;
+	int 		reserved;
+	int64_t 	ref_size;
+	int64_t 	names_bytes;
+	int64_t 	num_kmers;
+	int64_t 	num_positions;
+	uint64_t 	mask_checksum;
+	int64_t 	chromosomes_offset;
+	int64_t 	names_offset;
+	int64_t 	pac_offset;
+	int64_t 	kmer_bits_offset;
+	int64_t 	kmer_ranks_offset;
+	int64_t 	kmer_starts_lo_offset;
+	int64_t 	kmer_starts_hi_offset; 	// 0 with 32-bit values
+	int64_t 	positions_lo_offset;
+	int64_t 	positions_hi_offset; 	// 0 with 32-bit values
+	int64_t 	file_size;
+	uint64_t 	header_checksum;
+} reference_index_header_t;
+
+// reads the reference with num_threads parser threads and indexes its k-mers. repeat_mask may be NULL.
+reference_index_t*
+build_reference_index(const char* fasta, const int kmer_size, const char* repeat_mask, const int num_threads);
+
+reference_index_t*
+destroy_reference_index(reference_index_t* index);
+
+void
+dump_reference_index(const char* path, reference_index_t* index);
+
+// true if path starts with REFERENCE_INDEX_MAGIC, that is, it is an index and not a FASTA file
+bool
+is_reference_index_file(const char* path);
+
+/* mmaps an index written by dump_reference_index(). exits with an error if it is corrupted, was not
+ * built with kmer_size or, if repeat_mask is not NULL, was built without that mask. */
+reference_index_t*
+load_reference_index(const char* path, const int kmer_size, const char* repeat_mask);
+
+// writes the chromosome table in the format of chrindex.txt ("start\tname\tsize" lines, then "size\tFileEnd")
+void
+write_chromosome_table(const reference_index_t* index, const char* path);
+
+static inline idx_t
+reference_index_value(const uint32_t* lo, const u1_t* hi, const idx_t i)
+{
+	return hi ? (((idx_t)hi[i] << 32) | lo[i]) : (idx_t)lo[i];
+}
+
+// [*first, *last) is the range of positions of kmer, empty if it is not indexed
+static inline void
+reference_index_kmer_range(const reference_index_t* index, const uint32_t kmer, idx_t* first, idx_t* last)
+{
+	const uint64_t w = index->kmer_bits[kmer >> 6];
+	const int b = kmer & 63;
+	if (!((w >> b) & 1)) { *first = *last = 0; return; }
+	const idx_t r = index->kmer_ranks[kmer >> 6] + __builtin_popcountll(w & ((1ULL << b) - 1));
+	*first = reference_index_value(index->kmer_starts_lo, index->kmer_starts_hi, r);
+	*last = reference_index_value(index->kmer_starts_lo, index->kmer_starts_hi, r + 1);
+}
+
+static inline idx_t
+reference_index_position(const reference_index_t* index, const idx_t i)
+{
+	return reference_index_value(index->positions_lo, index->positions_hi, i);
+}
+
+#endif // REFERENCE_INDEX_H